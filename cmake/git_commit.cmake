@@ -0,0 +1,26 @@
+# Writes the commit the sources were built from to OUTPUT, run by the DiplomaGitCommit target on every build.
+# Commits of work trees with uncommitted changes to tracked files get a -dirty suffix.
+# The header is only rewritten when the commit changes, so unchanged builds recompile nothing.
+execute_process(COMMAND git rev-parse --short HEAD
+        WORKING_DIRECTORY ${SOURCE_DIR}
+        OUTPUT_VARIABLE commit
+        OUTPUT_STRIP_TRAILING_WHITESPACE
+        ERROR_QUIET)
+if (commit)
+    execute_process(COMMAND git status --porcelain --untracked-files=no
+            WORKING_DIRECTORY ${SOURCE_DIR}
+            OUTPUT_VARIABLE changes
+            OUTPUT_STRIP_TRAILING_WHITESPACE
+            ERROR_QUIET)
+    if (changes)
+        set(commit "${commit}-dirty")
+    endif ()
+endif ()
+
+set(content "// Generated by cmake/git_commit.cmake\n#define DIPLOMA_GIT_COMMIT \"${commit}\"\n")
+if (EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} previous)
+endif ()
+if (NOT "${content}" STREQUAL "${previous}")
+    file(WRITE ${OUTPUT} "${content}")
+endif ()
@@ -0,0 +1,248 @@
+#include "alloc_tracker.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Note: Counters are plain atomics, nothing here may allocate
+static std::atomic<int> currentPhase{int(AllocPhase::None)};
+static std::atomic<uint64_t> allocationCounts[AllocTracker::numPhases]{};
+static std::atomic<uint64_t> byteCounts[AllocTracker::numPhases]{};
+static std::atomic<uint64_t> freeCounts[AllocTracker::numPhases]{};
+static std::atomic<uint64_t> newCounts[AllocTracker::numPhases]{};
+
+#ifdef DIPLOMA_ALLOC_TRACKING
+static void countAllocation(size_t size) {
+    int phase = currentPhase.load(std::memory_order_relaxed);
+    allocationCounts[phase].fetch_add(1, std::memory_order_relaxed);
+    byteCounts[phase].fetch_add(size, std::memory_order_relaxed);
+}
+
+static void countFree(void *ptr) {
+    if (ptr) {
+        freeCounts[currentPhase.load(std::memory_order_relaxed)].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+#if defined(__GLIBC__)
+// glibc lets the program replace malloc, the originals stay available under __libc_ names
+#define DIPLOMA_HOOK_MALLOC
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) noexcept {
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) noexcept {
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept {
+    countAllocation(size);
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : 12; // ENOMEM
+}
+
+void free(void *ptr) noexcept {
+    countFree(ptr);
+    __libc_free(ptr);
+}
+}
+#endif
+
+// C++ allocations are counted separately, so they can be told apart from allocations in C libraries (eg. GL driver).
+// Note: With hooked malloc they are also counted as heap allocations by the malloc below.
+static void countNew(size_t size) {
+    newCounts[currentPhase.load(std::memory_order_relaxed)].fetch_add(1, std::memory_order_relaxed);
+#ifndef DIPLOMA_HOOK_MALLOC
+    countAllocation(size);
+#else
+    (void) size;
+#endif
+}
+
+static void countDelete(void *ptr) {
+#ifndef DIPLOMA_HOOK_MALLOC
+    countFree(ptr);
+#else
+    (void) ptr;
+#endif
+}
+
+void *operator new(size_t size) {
+    countNew(size);
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    countNew(size);
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept {
+    return operator new(size, tag);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    countNew(size);
+    size_t align = size_t(alignment);
+    // Note: aligned_alloc needs the size to be a multiple of the alignment
+    if (void *ptr = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void operator delete(void *ptr) noexcept {
+    countDelete(ptr);
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+    operator delete(ptr);
+}
+#endif
+
+bool AllocTracker::enabled() {
+#ifdef DIPLOMA_ALLOC_TRACKING
+    return true;
+#else
+    return false;
+#endif
+}
+
+AllocPhase AllocTracker::setPhase(AllocPhase phase) {
+    return AllocPhase(currentPhase.exchange(int(phase), std::memory_order_relaxed));
+}
+
+AllocPhase AllocTracker::phase() {
+    return AllocPhase(currentPhase.load(std::memory_order_relaxed));
+}
+
+AllocTracker::Counts AllocTracker::counts(AllocPhase phase) {
+    int i = int(phase);
+    return Counts{
+            .allocations = allocationCounts[i].load(std::memory_order_relaxed),
+            .bytes = byteCounts[i].load(std::memory_order_relaxed),
+            .frees = freeCounts[i].load(std::memory_order_relaxed),
+            .newAllocations = newCounts[i].load(std::memory_order_relaxed),
+    };
+}
+
+AllocTracker::Snapshot AllocTracker::snapshot() {
+    Snapshot snapshot{};
+    for (int p = 0; p < numPhases; p++) {
+        snapshot[p] = counts(AllocPhase(p));
+    }
+    return snapshot;
+}
+
+AllocTracker::Snapshot AllocTracker::since(const Snapshot &before) {
+    Snapshot after = snapshot();
+    for (int p = 0; p < numPhases; p++) {
+        after[p].allocations -= before[p].allocations;
+        after[p].bytes -= before[p].bytes;
+        after[p].frees -= before[p].frees;
+        after[p].newAllocations -= before[p].newAllocations;
+    }
+    return after;
+}
+
+const char *AllocTracker::phaseName(AllocPhase phase) {
+    switch (phase) {
+        case AllocPhase::None:
+            return "none";
+        case AllocPhase::Simulation:
+            return "simulation";
+        case AllocPhase::Submit:
+            return "submit";
+        case AllocPhase::Flush:
+            return "flush";
+        case AllocPhase::Swap:
+            return "swap";
+    }
+    return "unknown";
+}
+
+const char *AllocTracker::checkName(Check check) {
+    switch (check) {
+        case Check::Off:
+            return "off";
+        case Check::Warn:
+            return "warn";
+        case Check::Fail:
+            return "fail";
+    }
+    return "unknown";
+}
+
+bool AllocTracker::parseCheck(const char *str, Check &check) {
+    if (!str) {
+        return false;
+    }
+    for (Check c: {Check::Off, Check::Warn, Check::Fail}) {
+        if (strcmp(str, checkName(c)) == 0) {
+            check = c;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,70 @@
+#ifndef DIPLOMA_ALLOC_TRACKER_H
+#define DIPLOMA_ALLOC_TRACKER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Phase of the frame loop that heap allocations are counted under
+enum class AllocPhase {
+    None,
+    Simulation,
+    Submit, // renderer begin() and drawing
+    Flush,  // renderer end()
+    Swap,   // buffer swap and event processing
+};
+
+// Counts heap allocations per phase. Only counts when built with DIPLOMA_ALLOC_TRACKING (CMake option),
+// which replaces the global operator new/delete and on glibc also malloc, so C libraries are counted too.
+// Phase is global, allocations on any thread are counted under the phase set by the frame loop.
+class AllocTracker {
+public:
+    constexpr static int numPhases = int(AllocPhase::Swap) + 1;
+
+    // What to do with allocations inside renderer begin() ... end()
+    enum class Check {
+        Off,
+        Warn,
+        Fail,
+    };
+
+    struct Counts {
+        uint64_t allocations; // all heap allocations, including C libraries like the GL driver where hooked
+        uint64_t bytes;
+        uint64_t frees;
+        uint64_t newAllocations; // C++ operator new only, our code and the standard library
+    };
+    using Snapshot = std::array<Counts, numPhases>;
+
+    // Sets phase until destroyed, then restores the previous one
+    class Scope {
+    public:
+        explicit Scope(AllocPhase phase) : previous(AllocTracker::setPhase(phase)) {}
+        Scope(const Scope &other) = delete;
+        ~Scope() {
+            AllocTracker::setPhase(previous);
+        }
+
+    private:
+        AllocPhase previous;
+    };
+
+    // True if allocations are actually counted
+    static bool enabled();
+
+    // Returns the previous phase
+    static AllocPhase setPhase(AllocPhase phase);
+    static AllocPhase phase();
+
+    // Totals since program start
+    static Counts counts(AllocPhase phase);
+    static Snapshot snapshot();
+    // Counts of every phase made after before was taken
+    static Snapshot since(const Snapshot &before);
+
+    static const char *phaseName(AllocPhase phase);
+    static const char *checkName(Check check);
+    static bool parseCheck(const char *str, Check &check);
+};
+
+#endif //DIPLOMA_ALLOC_TRACKER_H
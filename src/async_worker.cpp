@@ -0,0 +1,71 @@
+#include "async_worker.h"
+
+#include <cassert>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+bool pinCurrentThread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void) cpu;
+    return false;
+#endif
+}
+
+AsyncWorker::AsyncWorker() {
+    thread = std::thread(&AsyncWorker::workerLoop, this);
+}
+
+AsyncWorker::~AsyncWorker() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    taskReady.notify_one();
+    thread.join();
+}
+
+void AsyncWorker::start(std::function<void()> task) {
+    {
+        std::lock_guard lock(mutex);
+        assert(!busy);
+        this->task = std::move(task);
+        busy = true;
+    }
+    taskReady.notify_one();
+}
+
+void AsyncWorker::wait() {
+    std::unique_lock lock(mutex);
+    taskDone.wait(lock, [this] { return !busy; });
+}
+
+void AsyncWorker::workerLoop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock lock(mutex);
+            taskReady.wait(lock, [this] { return stopping || (busy && task); });
+            if (stopping) {
+                return;
+            }
+            job = std::move(task);
+            task = nullptr;
+        }
+
+        job();
+
+        {
+            std::lock_guard lock(mutex);
+            busy = false;
+        }
+        taskDone.notify_one();
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef DIPLOMA_ASYNC_WORKER_H
+#define DIPLOMA_ASYNC_WORKER_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Pins the calling thread to a CPU core, returns false if not supported on this platform
+bool pinCurrentThread(int cpu);
+
+// Single background thread running one task at a time, so the calling thread can do other work meanwhile.
+class AsyncWorker {
+public:
+    AsyncWorker();
+    AsyncWorker(const AsyncWorker &other) = delete;
+    ~AsyncWorker();
+
+    // Worker must be idle, call wait before starting the next task
+    void start(std::function<void()> task);
+    // Blocks until the started task is finished
+    void wait();
+
+private:
+    void workerLoop();
+
+    std::thread thread{};
+    std::mutex mutex{};
+    std::condition_variable taskReady{};
+    std::condition_variable taskDone{};
+
+    // Guarded by mutex
+    std::function<void()> task{};
+    bool busy{};
+    bool stopping{};
+};
+
+#endif //DIPLOMA_ASYNC_WORKER_H
@@ -1,8 +1,83 @@
 #ifndef DIPLOMA_BASE_RENDERER_H
 #define DIPLOMA_BASE_RENDERER_H
 
+#include <array>
+#include <cstdint>
 #include "common.h"
 
+// Sprites sharing a texture region, each attribute in its own array
+struct SpriteSpan {
+    const glm::vec2 *positions;
+    const glm::vec2 *sizes;
+    const glm::vec2 *origins;
+    const float *rotations;
+    const Color *colors;
+    size_t count;
+};
+
+// Why a batch was sent to the GPU
+enum class FlushReason {
+    TextureChange,
+    CapacityFull,
+    End,        // end of frame
+    Explicit,   // flush() called by the user
+};
+
+// Counters of one frame, kept by every renderer. Plain increments, cheap enough to leave on in release builds.
+// Renderers without batches draw every sprite on its own and count no flushes.
+struct RendererStats {
+    constexpr static int numFlushReasons = int(FlushReason::Explicit) + 1;
+
+    uint64_t drawCalls;
+    uint64_t sprites;
+    uint64_t vertices;      // sent to the GPU, 4 per quad or 1 per geometry shader point
+    uint64_t instances;     // instanced renderers, the 4 quad vertices are shared
+    uint64_t bytesUploaded; // buffer data, sub data and writes to mapped buffers
+    uint64_t textureBinds;
+    uint64_t stateChanges;  // other GL state: program, VAO, buffer and attribute binds, uniforms, capabilities
+    std::array<uint64_t, numFlushReasons> flushes;
+
+    // Adds counters of another pass of the same frame
+    RendererStats &operator+=(const RendererStats &other) {
+        drawCalls += other.drawCalls;
+        sprites += other.sprites;
+        vertices += other.vertices;
+        instances += other.instances;
+        bytesUploaded += other.bytesUploaded;
+        textureBinds += other.textureBinds;
+        stateChanges += other.stateChanges;
+        for (int r = 0; r < numFlushReasons; r++) {
+            flushes[r] += other.flushes[r];
+        }
+        return *this;
+    }
+
+    [[nodiscard]]
+    uint64_t totalFlushes() const {
+        uint64_t total = 0;
+        for (auto count: flushes) {
+            total += count;
+        }
+        return total;
+    }
+
+    static const char *flushReasonName(FlushReason reason) {
+        switch (reason) {
+            case FlushReason::TextureChange:
+                return "texture_change";
+            case FlushReason::CapacityFull:
+                return "capacity_full";
+            case FlushReason::End:
+                return "end";
+            case FlushReason::Explicit:
+                return "explicit";
+        }
+        return "unknown";
+    }
+};
+
+// Note: Renderers whose program depends on their options (vertex format, instance layout) cache uniform locations
+// per renderer, function local statics would keep the locations of the first program created.
 class IRenderer {
 public:
     virtual ~IRenderer() = default;
@@ -10,7 +85,36 @@ public:
     virtual void begin(const glm::mat4 &projView) = 0;
     virtual void drawSprite(const UVRegion &region, glm::vec2 pos, glm::vec2 size, glm::vec2 origin, float rotation, Color color) = 0;
     virtual void end() = 0;
+    // Called by the frame loop once per frame, after the last end(). A frame can have several begin() ... end()
+    // passes, renderers that adapt to the load of whole frames (eg. batch capacity) update here.
+    virtual void endFrame() {
+    }
+
+    // Bulk path, renderers can override it to avoid per sprite overhead
+    virtual void drawSprites(const UVRegion &region, const SpriteSpan &sprites) {
+        for (size_t i = 0; i < sprites.count; i++) {
+            drawSprite(region, sprites.positions[i], sprites.sizes[i], sprites.origins[i],
+                       sprites.rotations[i], sprites.colors[i]);
+        }
+    }
+
+    // Counters of the last frame finished with end()
+    [[nodiscard]]
+    const RendererStats &frameStats() const {
+        return lastStats;
+    }
+
+protected:
+    // Counters of the frame in progress, renderers must call endFrameStats() at the end of end()
+    RendererStats currentStats{};
+
+    void endFrameStats() {
+        lastStats = currentStats;
+        currentStats = {};
+    }
 
+private:
+    RendererStats lastStats{};
 };
 
 #endif //DIPLOMA_BASE_RENDERER_H
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench_report.h"
+
+// Compares two CSV reports written by Benchmark --report, baseline and candidate. Runs are matched by
+// renderer config, sprite count, thread count, mode and scenario, frames of repeated runs are pooled. For the
+// median and p99 frame time it reports the relative change with a bootstrap confidence interval, and a
+// Mann-Whitney U test of the two frame time distributions. Exits with 2 if a change is a significant
+// regression over the threshold, so it can gate merges, and with 1 if a run configuration is only in one
+// of the reports, has frame times of 0 (eg. GPU times missing) or nothing could be compared.
+
+static int parseInt(const char *str) {
+    if (!str) {
+        return 0;
+    }
+
+    return atoi(str);
+}
+
+enum class Test {
+    Bootstrap,   // change is significant if its confidence interval does not contain 0
+    MannWhitney, // distributions differ with p below 1 - confidence
+};
+
+struct CompareOpts {
+    bool gpu; // compare GPU instead of CPU frame times
+    double threshold; // relative median change counted as a regression
+    double p99Threshold; // relative p99 change counted as a regression, 0 to not gate on p99
+    double confidence;
+    int resamples;
+    Test test;
+    unsigned seed;
+};
+
+struct Samples {
+    std::vector<double> times;
+    int runs;
+};
+
+// Nearest rank, reorders values
+static double quantile(std::vector<double> &values, double q) {
+    auto rank = size_t(std::ceil(q * double(values.size())));
+    auto nth = values.begin() + ptrdiff_t(std::clamp<size_t>(rank, 1, values.size()) - 1);
+    std::nth_element(values.begin(), nth, values.end());
+    return *nth;
+}
+
+struct Change {
+    double baseline{};
+    double candidate{};
+    double change{}; // relative, candidate / baseline - 1
+    double low{};    // confidence interval of change
+    double high{};
+};
+
+// Percentile bootstrap of the relative change of quantile q, both samples are resampled independently
+static Change bootstrapChange(const std::vector<double> &baseline, const std::vector<double> &candidate, double q,
+                              const CompareOpts &opts, std::mt19937 &rng) {
+    std::vector<double> b = baseline;
+    std::vector<double> c = candidate;
+    Change result{
+            .baseline = quantile(b, q),
+            .candidate = quantile(c, q),
+    };
+    result.change = result.candidate / result.baseline - 1.0;
+
+    std::vector<double> changes{};
+    changes.reserve(opts.resamples);
+    std::uniform_int_distribution<size_t> pickBaseline{0, baseline.size() - 1};
+    std::uniform_int_distribution<size_t> pickCandidate{0, candidate.size() - 1};
+    for (int r = 0; r < opts.resamples; r++) {
+        for (auto &v: b) {
+            v = baseline[pickBaseline(rng)];
+        }
+        for (auto &v: c) {
+            v = candidate[pickCandidate(rng)];
+        }
+        changes.push_back(quantile(c, q) / quantile(b, q) - 1.0);
+    }
+    double alpha = 1.0 - opts.confidence;
+    result.low = quantile(changes, alpha / 2.0);
+    result.high = quantile(changes, 1.0 - alpha / 2.0);
+    return result;
+}
+
+// Two-sided p-value of the Mann-Whitney U test, normal approximation with tie correction
+static double mannWhitney(const std::vector<double> &baseline, const std::vector<double> &candidate) {
+    struct Value {
+        double time;
+        bool fromBaseline;
+    };
+    std::vector<Value> values{};
+    values.reserve(baseline.size() + candidate.size());
+    for (auto t: baseline) {
+        values.push_back({t, true});
+    }
+    for (auto t: candidate) {
+        values.push_back({t, false});
+    }
+    std::sort(values.begin(), values.end(), [](const Value &a, const Value &b) {
+        return a.time < b.time;
+    });
+
+    auto n1 = double(baseline.size());
+    auto n2 = double(candidate.size());
+    double n = n1 + n2;
+    double rankSum = 0.0; // of baseline
+    double ties = 0.0;    // sum of t^3 - t over groups of equal times
+    for (size_t i = 0; i < values.size();) {
+        size_t j = i;
+        while (j < values.size() && values[j].time == values[i].time) {
+            j++;
+        }
+        // Equal times share the average of their ranks
+        double rank = double(i + j + 1) / 2.0;
+        for (size_t k = i; k < j; k++) {
+            rankSum += values[k].fromBaseline ? rank : 0.0;
+        }
+        double t = double(j - i);
+        ties += t * t * t - t;
+        i = j;
+    }
+    double u = rankSum - n1 * (n1 + 1.0) / 2.0;
+    double mean = n1 * n2 / 2.0;
+    double sigma = std::sqrt(n1 * n2 / 12.0 * ((n + 1.0) - ties / (n * (n - 1.0))));
+    if (sigma == 0.0) {
+        return 1.0;
+    }
+    double z = (std::abs(u - mean) - 0.5) / sigma;
+    return std::erfc(std::max(z, 0.0) / std::sqrt(2.0));
+}
+
+// Frame times of every run configuration, keyed by renderer config, sprites, threads, mode and scenario
+static std::map<std::string, Samples> groupRuns(const std::vector<RunResult> &runs, bool gpu) {
+    std::map<std::string, Samples> groups{};
+    for (auto &run: runs) {
+        char key[512];
+        snprintf(key, sizeof(key), "renderer_config=\"%s\" num_sprites=%d num_threads=%d mode=%s scenario=%s",
+                 run.rendererConfig.c_str(), run.numSprites, run.numThreads, run.mode.c_str(), run.scenario.c_str());
+        auto &samples = groups[key];
+        for (auto t: gpu ? run.gpuTimes : run.frameTimes) {
+            samples.times.push_back(double(t));
+        }
+        samples.runs++;
+    }
+    return groups;
+}
+
+int main(int argc, const char **argv) {
+    const char *baselinePath = nullptr;
+    const char *candidatePath = nullptr;
+    CompareOpts opts{
+            .gpu = false,
+            .threshold = 0.05,
+            .p99Threshold = 0.0,
+            .confidence = 0.95,
+            .resamples = 2000,
+            .test = Test::Bootstrap,
+            .seed = 1,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *nextArg = nullptr;
+        if (i + 1 < argc) nextArg = argv[i + 1];
+        if (strcmp(arg, "--baseline") == 0) {
+            baselinePath = nextArg;
+        } else if (strcmp(arg, "--candidate") == 0) {
+            candidatePath = nextArg;
+        } else if (strcmp(arg, "--metric") == 0) {
+            if (!nextArg || (strcmp(nextArg, "frame_time") != 0 && strcmp(nextArg, "gpu_time") != 0)) {
+                fprintf(stderr, "Invalid metric: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+            opts.gpu = strcmp(nextArg, "gpu_time") == 0;
+        } else if (strcmp(arg, "--threshold") == 0) {
+            opts.threshold = (nextArg ? strtod(nextArg, nullptr) : 0.0) / 100.0;
+        } else if (strcmp(arg, "--p99_threshold") == 0) {
+            opts.p99Threshold = (nextArg ? strtod(nextArg, nullptr) : 0.0) / 100.0;
+        } else if (strcmp(arg, "--confidence") == 0) {
+            opts.confidence = (nextArg ? strtod(nextArg, nullptr) : 0.0) / 100.0;
+        } else if (strcmp(arg, "--resamples") == 0) {
+            opts.resamples = parseInt(nextArg);
+        } else if (strcmp(arg, "--seed") == 0) {
+            opts.seed = unsigned(strtoul(nextArg ? nextArg : "0", nullptr, 10));
+        } else if (strcmp(arg, "--test") == 0) {
+            if (nextArg && strcmp(nextArg, "bootstrap") == 0) {
+                opts.test = Test::Bootstrap;
+            } else if (nextArg && strcmp(nextArg, "mann_whitney") == 0) {
+                opts.test = Test::MannWhitney;
+            } else {
+                fprintf(stderr, "Invalid test: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        }
+    }
+    if (!baselinePath || !candidatePath) {
+        fprintf(stderr, "Usage: BenchCompare --baseline <report.csv> --candidate <report.csv>\n"
+                        "       [--metric frame_time|gpu_time] [--threshold <percent>] [--p99_threshold <percent>]\n"
+                        "       [--confidence <percent>]\n"
+                        "       [--test bootstrap|mann_whitney] [--resamples <n>] [--seed <n>]\n");
+        return 1;
+    }
+    if (opts.confidence <= 0.0 || opts.confidence >= 1.0 || opts.resamples < 1) {
+        fprintf(stderr, "Confidence must be between 0 and 100, resamples at least 1\n");
+        return 1;
+    }
+
+    MachineInfo baselineMachine{};
+    MachineInfo candidateMachine{};
+    std::vector<RunResult> baselineRuns{};
+    std::vector<RunResult> candidateRuns{};
+    if (!BenchReport::readCsv(baselinePath, baselineMachine, baselineRuns)) {
+        fprintf(stderr, "Could not read report: %s\n", baselinePath);
+        return 1;
+    }
+    if (!BenchReport::readCsv(candidatePath, candidateMachine, candidateRuns)) {
+        fprintf(stderr, "Could not read report: %s\n", candidatePath);
+        return 1;
+    }
+    printf("baseline_commit=%s candidate_commit=%s metric=%s\n", baselineMachine.commit.c_str(),
+           candidateMachine.commit.c_str(), opts.gpu ? "gpu_time" : "frame_time");
+    if (baselineMachine.glRenderer != candidateMachine.glRenderer ||
+        baselineMachine.cpuModel != candidateMachine.cpuModel) {
+        fprintf(stderr, "Warning: reports are from different machines (%s, %s vs %s, %s)\n",
+                baselineMachine.glRenderer.c_str(), baselineMachine.cpuModel.c_str(),
+                candidateMachine.glRenderer.c_str(), candidateMachine.cpuModel.c_str());
+    }
+
+    auto baseline = groupRuns(baselineRuns, opts.gpu);
+    auto candidate = groupRuns(candidateRuns, opts.gpu);
+    std::mt19937 rng{opts.seed};
+    int compared = 0;
+    int regressions = 0;
+    int improvements = 0;
+    int unmatched = 0;
+    int invalid = 0;
+    for (auto &[key, base]: baseline) {
+        auto it = candidate.find(key);
+        if (it == candidate.end() || base.times.empty() || it->second.times.empty()) {
+            fprintf(stderr, "Only in baseline: %s\n", key.c_str());
+            unmatched++;
+            continue;
+        }
+        auto &cand = it->second;
+        // Note: Relative changes divide by baseline quantiles, resamples can pick any baseline frame
+        bool zeroTimes = std::any_of(base.times.begin(), base.times.end(), [](double t) {
+            return t <= 0.0;
+        });
+        if (zeroTimes) {
+            fprintf(stderr, "Baseline has frame times of 0, not compared: %s\n", key.c_str());
+            invalid++;
+            continue;
+        }
+        Change median = bootstrapChange(base.times, cand.times, 0.5, opts, rng);
+        Change p99 = bootstrapChange(base.times, cand.times, 0.99, opts, rng);
+        double p = mannWhitney(base.times, cand.times);
+
+        auto significant = [&](const Change &change) {
+            if (opts.test == Test::MannWhitney) {
+                return p < 1.0 - opts.confidence;
+            }
+            return change.low > 0.0 || change.high < 0.0;
+        };
+        bool regression = significant(median) && median.change > opts.threshold;
+        if (opts.p99Threshold > 0.0) {
+            regression |= significant(p99) && p99.change > opts.p99Threshold;
+        }
+        bool improvement = !regression && significant(median) && median.change < -opts.threshold;
+        compared++;
+        regressions += regression;
+        improvements += improvement;
+
+        printf("%s baseline_runs=%d candidate_runs=%d baseline_median=%.0f candidate_median=%.0f "
+               "median_change=%+.2f%% median_ci=[%+.2f%%,%+.2f%%] baseline_p99=%.0f candidate_p99=%.0f "
+               "p99_change=%+.2f%% p99_ci=[%+.2f%%,%+.2f%%] mann_whitney_p=%.4g verdict=%s\n",
+               key.c_str(), base.runs, cand.runs, median.baseline, median.candidate, median.change * 100.0,
+               median.low * 100.0, median.high * 100.0, p99.baseline, p99.candidate, p99.change * 100.0,
+               p99.low * 100.0, p99.high * 100.0, p,
+               regression ? "regression" : (improvement ? "improvement" : "unchanged"));
+    }
+    for (auto &[key, cand]: candidate) {
+        if (!baseline.contains(key)) {
+            fprintf(stderr, "Only in candidate: %s\n", key.c_str());
+            unmatched++;
+        }
+    }
+    printf("compared=%d regressions=%d improvements=%d unmatched=%d invalid=%d threshold=%.2f%% "
+           "confidence=%.1f%%\n", compared, regressions, improvements, unmatched, invalid, opts.threshold * 100.0,
+           opts.confidence * 100.0);
+    if (regressions > 0) {
+        return 2;
+    }
+    if (compared == 0) {
+        fprintf(stderr, "No run configuration could be compared\n");
+        return 1;
+    }
+    return unmatched > 0 || invalid > 0 ? 1 : 0;
+}
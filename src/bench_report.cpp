@@ -0,0 +1,370 @@
+#include "bench_report.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <utility>
+#include "common.h"
+#include "git_commit.h"
+
+TimeSummary summarizeTimes(const std::vector<uint64_t> &times, uint64_t hitchThreshold) {
+    TimeSummary summary{.count = times.size()};
+    if (times.empty()) {
+        summary.hitchThreshold = hitchThreshold;
+        return summary;
+    }
+    std::vector<uint64_t> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](double p) {
+        auto rank = size_t(std::ceil(p / 100.0 * double(sorted.size())));
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    };
+
+    double sum = 0.0;
+    for (auto t: sorted) {
+        sum += double(t);
+    }
+    summary.mean = sum / double(sorted.size());
+    double squares = 0.0;
+    for (auto t: sorted) {
+        squares += (double(t) - summary.mean) * (double(t) - summary.mean);
+    }
+    summary.stddev = sorted.size() > 1 ? std::sqrt(squares / double(sorted.size() - 1)) : 0.0;
+    summary.min = sorted.front();
+    summary.median = percentile(50.0);
+    summary.p1 = percentile(1.0);
+    summary.p95 = percentile(95.0);
+    summary.p99 = percentile(99.0);
+    summary.max = sorted.back();
+    summary.hitchThreshold = hitchThreshold ? hitchThreshold : summary.median * 2;
+    summary.hitches = size_t(sorted.end() - std::upper_bound(sorted.begin(), sorted.end(), summary.hitchThreshold));
+    return summary;
+}
+
+void printTimeSummary(const char *name, const TimeSummary &s) {
+    printf("%s_mean=%.0f %s_median=%llu %s_stddev=%.0f %s_min=%llu %s_p1=%llu %s_p95=%llu %s_p99=%llu %s_max=%llu "
+           "%s_hitches=%zu %s_hitch_threshold=%llu\n",
+           name, s.mean, name, (unsigned long long) s.median, name, s.stddev, name, (unsigned long long) s.min,
+           name, (unsigned long long) s.p1, name, (unsigned long long) s.p95, name, (unsigned long long) s.p99,
+           name, (unsigned long long) s.max, name, s.hitches, name, (unsigned long long) s.hitchThreshold);
+}
+
+static std::string glString(GLenum name) {
+    auto *str = reinterpret_cast<const char *>(glGetString(name));
+    return str ? str : "";
+}
+
+static std::string cpuModel() {
+#ifdef __linux__
+    std::ifstream cpuinfo{"/proc/cpuinfo"};
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        // Note: x86 has "model name", some ARM kernels only "Hardware" or nothing at all
+        if (line.starts_with("model name") || line.starts_with("Hardware")) {
+            auto colon = line.find(':');
+            if (colon != std::string::npos && colon + 2 <= line.size()) {
+                return line.substr(colon + 2);
+            }
+        }
+    }
+#endif
+    return "unknown";
+}
+
+MachineInfo collectMachineInfo(const char *surface, int width, int height) {
+    return MachineInfo{
+            .glVendor = glString(GL_VENDOR),
+            .glRenderer = glString(GL_RENDERER),
+            .glVersion = glString(GL_VERSION),
+            .cpuModel = cpuModel(),
+            .commit = strlen(DIPLOMA_GIT_COMMIT) > 0 ? DIPLOMA_GIT_COMMIT : "unknown",
+            .surface = surface,
+            .width = width,
+            .height = height,
+    };
+}
+
+BenchReport::BenchReport(MachineInfo machine, uint64_t hitchThreshold)
+        : machine(std::move(machine)), hitchThreshold(hitchThreshold) {}
+
+void BenchReport::addRun(RunResult run) {
+    runResults.push_back(std::move(run));
+}
+
+const std::vector<RunResult> &BenchReport::runs() const {
+    return runResults;
+}
+
+bool BenchReport::write(const char *path, Format format) const {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+    switch (format) {
+        case Format::Csv:
+            writeCsv(file);
+            break;
+        case Format::Json:
+            writeJson(file);
+            break;
+    }
+    return fclose(file) == 0;
+}
+
+// Quoted only when needed, quotes inside are doubled
+static void csvString(FILE *file, const std::string &str) {
+    if (str.find_first_of(",\"\n") == std::string::npos) {
+        fputs(str.c_str(), file);
+        return;
+    }
+    fputc('"', file);
+    for (char c: str) {
+        if (c == '"') {
+            fputc('"', file);
+        }
+        fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+void BenchReport::writeCsv(FILE *file) const {
+    fprintf(file, "run,renderer,renderer_config,batch_size,num_sprites,num_threads,mode,scenario,seed,warmup_frames,"
+                  "width,height,surface,gl_vendor,gl_renderer,gl_version,cpu_model,commit,frame,frame_time,gpu_time,draw_calls,"
+                  "sprites,vertices,instances,bytes_uploaded,texture_binds,state_changes");
+    for (int r = 0; r < RendererStats::numFlushReasons; r++) {
+        fprintf(file, ",flushes_%s", RendererStats::flushReasonName(FlushReason(r)));
+    }
+    fprintf(file, "\n");
+
+    for (size_t run = 0; run < runResults.size(); run++) {
+        auto &result = runResults[run];
+        for (size_t i = 0; i < result.frameTimes.size(); i++) {
+            fprintf(file, "%zu,%s,", run, result.renderer.c_str());
+            csvString(file, result.rendererConfig);
+            fprintf(file, ",%d,%d,%d,%s,%s,%u,%d,%d,%d,%s,", result.batchSize, result.numSprites, result.numThreads,
+                    result.mode.c_str(), result.scenario.c_str(), result.seed, result.warmupFrames, machine.width,
+                    machine.height, machine.surface.c_str());
+            for (auto *str: {&machine.glVendor, &machine.glRenderer, &machine.glVersion, &machine.cpuModel,
+                             &machine.commit}) {
+                csvString(file, *str);
+                fputc(',', file);
+            }
+            RendererStats stats = i < result.rendererStats.size() ? result.rendererStats[i] : RendererStats{};
+            fprintf(file, "%zu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu", i,
+                    (unsigned long long) result.frameTimes[i],
+                    (unsigned long long) (i < result.gpuTimes.size() ? result.gpuTimes[i] : 0),
+                    (unsigned long long) stats.drawCalls, (unsigned long long) stats.sprites,
+                    (unsigned long long) stats.vertices, (unsigned long long) stats.instances,
+                    (unsigned long long) stats.bytesUploaded, (unsigned long long) stats.textureBinds,
+                    (unsigned long long) stats.stateChanges);
+            for (auto flushes: stats.flushes) {
+                fprintf(file, ",%llu", (unsigned long long) flushes);
+            }
+            fprintf(file, "\n");
+        }
+    }
+}
+
+static void jsonString(FILE *file, const std::string &str) {
+    fputc('"', file);
+    for (unsigned char c: str) {
+        if (c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+static void jsonSummary(FILE *file, const TimeSummary &s) {
+    fprintf(file, "{\"count\": %zu, \"mean\": %.1f, \"median\": %llu, \"stddev\": %.1f, \"min\": %llu, "
+                  "\"p1\": %llu, \"p95\": %llu, \"p99\": %llu, \"max\": %llu, \"hitches\": %zu, "
+                  "\"hitch_threshold\": %llu}",
+            s.count, s.mean, (unsigned long long) s.median, s.stddev, (unsigned long long) s.min,
+            (unsigned long long) s.p1, (unsigned long long) s.p95, (unsigned long long) s.p99,
+            (unsigned long long) s.max, s.hitches, (unsigned long long) s.hitchThreshold);
+}
+
+void BenchReport::writeJson(FILE *file) const {
+    fprintf(file, "{\n  \"machine\": {\"gl_vendor\": ");
+    jsonString(file, machine.glVendor);
+    fprintf(file, ", \"gl_renderer\": ");
+    jsonString(file, machine.glRenderer);
+    fprintf(file, ", \"gl_version\": ");
+    jsonString(file, machine.glVersion);
+    fprintf(file, ", \"cpu_model\": ");
+    jsonString(file, machine.cpuModel);
+    fprintf(file, ", \"commit\": ");
+    jsonString(file, machine.commit);
+    fprintf(file, ", \"surface\": ");
+    jsonString(file, machine.surface);
+    fprintf(file, ", \"width\": %d, \"height\": %d},\n", machine.width, machine.height);
+    fprintf(file, "  \"time_unit\": \"ns\",\n  \"runs\": [");
+
+    for (size_t run = 0; run < runResults.size(); run++) {
+        auto &result = runResults[run];
+        fprintf(file, "%s\n    {\"renderer\": ", run > 0 ? "," : "");
+        jsonString(file, result.renderer);
+        fprintf(file, ", \"renderer_config\": ");
+        jsonString(file, result.rendererConfig);
+        fprintf(file, ", \"batch_size\": %d, \"num_sprites\": %d, \"num_threads\": %d, \"mode\": \"%s\", "
+                      "\"scenario\": \"%s\", \"seed\": %u, \"warmup_frames\": %d,\n     \"frame_time\": ",
+                result.batchSize, result.numSprites, result.numThreads, result.mode.c_str(), result.scenario.c_str(),
+                result.seed, result.warmupFrames);
+        jsonSummary(file, summarizeTimes(result.frameTimes, hitchThreshold));
+        fprintf(file, ",\n     \"gpu_time\": ");
+        jsonSummary(file, summarizeTimes(result.gpuTimes, hitchThreshold));
+        fprintf(file, ",\n     \"frames\": [");
+        for (size_t i = 0; i < result.frameTimes.size(); i++) {
+            RendererStats stats = i < result.rendererStats.size() ? result.rendererStats[i] : RendererStats{};
+            fprintf(file, "%s\n      {\"frame_time\": %llu, \"gpu_time\": %llu, \"draw_calls\": %llu, "
+                          "\"sprites\": %llu, \"vertices\": %llu, \"instances\": %llu, \"bytes_uploaded\": %llu, "
+                          "\"texture_binds\": %llu, \"state_changes\": %llu",
+                    i > 0 ? "," : "", (unsigned long long) result.frameTimes[i],
+                    (unsigned long long) (i < result.gpuTimes.size() ? result.gpuTimes[i] : 0),
+                    (unsigned long long) stats.drawCalls, (unsigned long long) stats.sprites,
+                    (unsigned long long) stats.vertices, (unsigned long long) stats.instances,
+                    (unsigned long long) stats.bytesUploaded, (unsigned long long) stats.textureBinds,
+                    (unsigned long long) stats.stateChanges);
+            for (int r = 0; r < RendererStats::numFlushReasons; r++) {
+                fprintf(file, ", \"flushes_%s\": %llu", RendererStats::flushReasonName(FlushReason(r)),
+                        (unsigned long long) stats.flushes[r]);
+            }
+            fprintf(file, "}");
+        }
+        fprintf(file, "\n     ]}");
+    }
+    fprintf(file, "\n  ]\n}\n");
+}
+
+const char *BenchReport::formatName(Format format) {
+    switch (format) {
+        case Format::Csv:
+            return "csv";
+        case Format::Json:
+            return "json";
+    }
+    return "unknown";
+}
+
+bool BenchReport::parseFormat(const char *str, Format &format) {
+    if (!str) {
+        return false;
+    }
+    for (auto f: {Format::Csv, Format::Json}) {
+        if (strcmp(str, formatName(f)) == 0) {
+            format = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Splits one CSV line, quoted fields may contain commas and doubled quotes
+static std::vector<std::string> csvFields(const std::string &line) {
+    std::vector<std::string> fields{};
+    std::string field;
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                field += '"';
+                i++;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                field += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.push_back(std::move(field));
+            field.clear();
+        } else {
+            field += c;
+        }
+    }
+    fields.push_back(std::move(field));
+    return fields;
+}
+
+bool BenchReport::readCsv(const char *path, MachineInfo &machine, std::vector<RunResult> &runs) {
+    std::ifstream file{path};
+    std::string line;
+    if (!file || !std::getline(file, line)) {
+        return false;
+    }
+    std::map<std::string, size_t> columns{};
+    auto header = csvFields(line);
+    for (size_t i = 0; i < header.size(); i++) {
+        columns[header[i]] = i;
+    }
+    for (const char *name: {"run", "renderer", "renderer_config", "num_sprites", "frame_time", "gpu_time"}) {
+        if (!columns.contains(name)) {
+            fprintf(stderr, "%s: missing column %s\n", path, name);
+            return false;
+        }
+    }
+
+    runs.clear();
+    std::map<std::string, size_t> runIndices{}; // run column -> index in runs
+    int lineNumber = 1;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        auto fields = csvFields(line);
+        if (fields.size() != header.size()) {
+            fprintf(stderr, "%s:%d: expected %zu fields, got %zu\n", path, lineNumber, header.size(), fields.size());
+            return false;
+        }
+        auto field = [&](const char *name) -> const std::string & {
+            static const std::string empty{};
+            auto it = columns.find(name);
+            return it != columns.end() ? fields[it->second] : empty;
+        };
+        auto number = [&](const char *name) {
+            return strtoull(field(name).c_str(), nullptr, 10);
+        };
+
+        auto [it, added] = runIndices.emplace(field("run"), runs.size());
+        if (added) {
+            runs.push_back(RunResult{
+                    .renderer = field("renderer"),
+                    .rendererConfig = field("renderer_config"),
+                    .batchSize = int(number("batch_size")),
+                    .numSprites = int(number("num_sprites")),
+                    .numThreads = int(number("num_threads")),
+                    .mode = field("mode"),
+                    // Note: Reports without the column only ran bunnies
+                    .scenario = field("scenario").empty() ? "bunnies" : field("scenario"),
+                    .seed = uint32_t(number("seed")),
+                    .warmupFrames = int(number("warmup_frames")),
+            });
+            machine = MachineInfo{
+                    .glVendor = field("gl_vendor"),
+                    .glRenderer = field("gl_renderer"),
+                    .glVersion = field("gl_version"),
+                    .cpuModel = field("cpu_model"),
+                    .commit = field("commit"),
+                    .surface = field("surface"),
+                    .width = int(number("width")),
+                    .height = int(number("height")),
+            };
+        }
+        auto &run = runs[it->second];
+        run.frameTimes.push_back(number("frame_time"));
+        run.gpuTimes.push_back(number("gpu_time"));
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+#ifndef DIPLOMA_BENCH_REPORT_H
+#define DIPLOMA_BENCH_REPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "base_renderer.h"
+
+// Statistics of a series of frame times, all times in ns
+struct TimeSummary {
+    size_t count{};
+    double mean{};
+    double stddev{}; // sample standard deviation
+    uint64_t min{};
+    uint64_t median{};
+    uint64_t p1{};
+    uint64_t p95{};
+    uint64_t p99{};
+    uint64_t max{};
+    uint64_t hitchThreshold{};
+    size_t hitches{}; // frames slower than hitchThreshold
+};
+
+// Percentiles are nearest rank. A hitch threshold of 0 uses twice the median.
+TimeSummary summarizeTimes(const std::vector<uint64_t> &times, uint64_t hitchThreshold);
+// One key=value line, keys are prefixed with name, eg. frame_time_p99=
+void printTimeSummary(const char *name, const TimeSummary &summary);
+
+// Machine and build the benchmark ran on
+struct MachineInfo {
+    std::string glVendor;
+    std::string glRenderer;
+    std::string glVersion;
+    std::string cpuModel;
+    std::string commit; // git commit the build was configured at
+    std::string surface;
+    int width;
+    int height;
+};
+
+// GL context must be current
+MachineInfo collectMachineInfo(const char *surface, int width, int height);
+
+// Frames of one BunnyMark run, warm-up frames excluded
+struct RunResult {
+    std::string renderer;       // renderer type name
+    std::string rendererConfig; // describeRendererConfig
+    int batchSize{};
+    int numSprites{};
+    int numThreads{};
+    std::string mode; // serial, pipelined, render_thread or parallel_record
+    std::string scenario;
+    uint32_t seed{}; // scenario seed
+    int warmupFrames{};
+    std::vector<uint64_t> frameTimes{}; // ns
+    std::vector<uint64_t> gpuTimes{};   // ns
+    std::vector<RendererStats> rendererStats{};
+};
+
+// Machine-readable results of all runs of a Benchmark invocation.
+// JSON has the machine info, summaries and frames of every run; CSV has one row per frame
+// with the run and machine info repeated in every row, so it can be loaded as a single table.
+class BenchReport {
+public:
+    enum class Format {
+        Csv,
+        Json,
+    };
+
+    BenchReport(MachineInfo machine, uint64_t hitchThreshold);
+
+    void addRun(RunResult run);
+    [[nodiscard]]
+    const std::vector<RunResult> &runs() const;
+
+    // Returns false if the file could not be written
+    bool write(const char *path, Format format) const;
+
+    static const char *formatName(Format format);
+    static bool parseFormat(const char *str, Format &format);
+
+    // Reads runs back from a CSV report. Returns false if the file can not be read or a row is malformed.
+    static bool readCsv(const char *path, MachineInfo &machine, std::vector<RunResult> &runs);
+
+private:
+    MachineInfo machine;
+    uint64_t hitchThreshold;
+    std::vector<RunResult> runResults{};
+
+    void writeCsv(FILE *file) const;
+    void writeJson(FILE *file) const;
+};
+
+#endif //DIPLOMA_BENCH_REPORT_H
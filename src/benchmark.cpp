@@ -1,19 +1,19 @@
 #include <glad/glad.h>
-#include <GLFW/glfw3.h>
 
 #include <glm.hpp>
 #include <ext.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <random>
 #include <iostream>
 
+#include "bench_report.h"
 #include "bunnymark.h"
-#include "renderers/naive_renderer.h"
-#include "renderers/batch_renderer.h"
-#include "renderers/instance_renderer_cpu.h"
-#include "renderers/geometry_renderer.h"
-#include "renderers/geometry_batch_renderer.h"
-#include "renderers/instance_renderer.h"
+#include "frame_capture.h"
+#include "renderer_config.h"
+#include "scenario.h"
+#include "surface.h"
 
 int parseInt(const char *str) {
     if (!str) {
@@ -23,41 +23,865 @@ int parseInt(const char *str) {
     return atoi(str);
 }
 
+static const char *modeName(const BunnyMarkOpts &opts) {
+    if (opts.pipelined) {
+        return "pipelined";
+    } else if (opts.renderThread) {
+        return "render_thread";
+    } else if (opts.parallelRecord) {
+        return "parallel_record";
+    }
+    return "serial";
+}
+
+// nullptr if the renderer can draw the scenario of opts in its mode, otherwise the reason it can not
+static const char *unsupportedReason(RendererType type, const BunnyMarkOpts &opts) {
+    auto traits = opts.scenario->traits();
+    if (type == RendererType::Retained && (opts.renderThread || opts.parallelRecord)) {
+        return "it can not be used with --render_thread or --parallel_record";
+    }
+    // Note: Every run of a blend mode is its own renderer pass, only BunnyMark's serial and pipelined loops split them
+    bool passes = type != RendererType::Retained && type != RendererType::Concurrent && !opts.renderThread &&
+                  !opts.parallelRecord;
+    if (traits.blendModes && !passes) {
+        return "the scenario changes blend modes, which needs an immediate renderer in serial or pipelined mode";
+    }
+    if (type == RendererType::Concurrent && (traits.multiTexture || traits.ordered)) {
+        return "it draws one texture in no particular order";
+    }
+    return nullptr;
+}
+
+// Adds the measured frames of a run to report, if there is one
 template<typename R>
-inline void run(R *renderer, BunnyMarkOpts opts, GLFWwindow *window, glm::mat4 projView) {
-    BunnyMark<R> bunnyMark{renderer, opts};
-    bunnyMark.Run(window, projView);
+static void addRun(BenchReport *report, const RendererConfig &config, const BunnyMarkOpts &opts,
+                   const BunnyMark<R> &bunnyMark) {
+    if (!report) {
+        return;
+    }
+    RunResult result{
+            .renderer = rendererTypeName(config.type),
+            .rendererConfig = describeRendererConfig(config),
+            .batchSize = config.batchSize,
+            .numSprites = opts.numQuads,
+            .numThreads = opts.numThreads,
+            .mode = modeName(opts),
+            .scenario = opts.scenario->name(),
+            .seed = opts.seed,
+    };
+    bunnyMark.collectFrames(result);
+    report->addRun(std::move(result));
+}
+
+// Returns false if the allocation check failed. Captured frames of the last run go into captures, if given.
+template<typename R>
+inline bool run(R *renderer, const RendererConfig &config, BunnyMarkOpts opts, Surface *surface, glm::mat4 projView,
+                bool threadSweep, BenchReport *report, std::vector<FrameImage> *captures) {
+    if (!threadSweep) {
+        BunnyMark<R> bunnyMark{renderer, opts};
+        bunnyMark.Run(surface, projView);
+        addRun(report, config, opts, bunnyMark);
+        if (captures) {
+            *captures = bunnyMark.captures();
+        }
+        return bunnyMark.passedAllocCheck();
+    }
+    // Scaling curve, same benchmark with 1..numThreads job system threads
+    bool passed = true;
+    int maxThreads = std::max(opts.numThreads, 1);
+    for (int threads = 1; threads <= maxThreads; threads++) {
+        opts.numThreads = threads;
+        printf("num_threads=%d\n", threads);
+        BunnyMark<R> bunnyMark{renderer, opts};
+        bunnyMark.Run(surface, projView);
+        addRun(report, config, opts, bunnyMark);
+        if (captures) {
+            *captures = bunnyMark.captures();
+        }
+        passed &= bunnyMark.passedAllocCheck();
+    }
+    return passed;
+}
+
+// Runs the benchmark on the renderer described by config. Returns false if the config is invalid
+// or the allocation check failed.
+inline bool runConfig(const RendererConfig &config, const BunnyMarkOpts &opts, Surface *surface,
+                      const glm::mat4 &projView, bool threadSweep, BenchReport *report,
+                      std::vector<FrameImage> *captures) {
+    bool passed = true;
+    bool valid = visitRenderer(config, [&](auto renderer) {
+        using R = typename decltype(renderer)::element_type;
+        if constexpr (std::is_same_v<R, ConcurrentRenderer>) {
+            printf("persistent_mapping=%d\n", renderer->isPersistent());
+        }
+        passed = run(renderer.get(), config, opts, surface, projView, threadSweep, report, captures);
+        if constexpr (std::is_same_v<R, ConcurrentRenderer>) {
+            if (renderer->droppedCount() > 0) {
+                fprintf(stderr, "Dropped %zu sprites, increase --batch_size\n", renderer->droppedCount());
+            }
+        }
+    });
+    if (!valid) {
+        fprintf(stderr, "Invalid renderer config: %s\n", describeRendererConfig(config).c_str());
+    }
+    return valid && passed;
+}
+
+// Candidates for --auto_tune: every renderer method, batched ones with a set of batch sizes,
+// instance layouts and upload modes. Topology and vertex format are taken from base.
+static std::vector<RendererConfig> tuneCandidates(const RendererConfig &base, const BunnyMarkOpts &opts) {
+    std::vector<RendererConfig> candidates{};
+    auto add = [&](RendererType type, int batchSize, const char *instanceLayout = "full") {
+        RendererConfig config = base;
+        config.type = type;
+        config.batchSize = batchSize;
+        config.maxBatchSize = 0;
+        config.instanceLayout = instanceLayout;
+        candidates.push_back(config);
+    };
+    add(RendererType::Naive, base.batchSize);
+    add(RendererType::Geometry, base.batchSize);
+    // Note: Sizes past the first one that fits all sprites in a single batch would only add memory
+    for (int batchSize = 1024; ; batchSize *= 4) {
+        add(RendererType::Batch, batchSize);
+        add(RendererType::GeometryBatch, batchSize);
+        for (const char *layout: {"full", "affine", "split"}) {
+            add(RendererType::InstanceCPU, batchSize, layout);
+        }
+        for (const char *layout: {"full", "half", "split"}) {
+            add(RendererType::Instance, batchSize, layout);
+        }
+        if (batchSize >= opts.numQuads || batchSize >= 1 << 20) {
+            break;
+        }
+    }
+    // Retained and concurrent renderers need room for all sprites
+    int allSprites = std::max(opts.numQuads, 1);
+    for (auto uploadMode: {RetainedRenderer::UploadMode::SubData, RetainedRenderer::UploadMode::MapFlush}) {
+        add(RendererType::Retained, allSprites);
+        candidates.back().uploadMode = uploadMode;
+    }
+    add(RendererType::Concurrent, allSprites);
+    std::erase_if(candidates, [&](const RendererConfig &config) {
+        return unsupportedReason(config.type, opts) != nullptr;
+    });
+    return candidates;
+}
+
+// Calibrates every candidate with a short run and saves the fastest to configPath.
+// A candidate's cost is the larger of its median CPU and GPU frame time, whichever bounds the frame rate.
+static bool autoTune(const RendererConfig &base, BunnyMarkOpts opts, Surface *surface, const glm::mat4 &projView,
+                     int tuneFrames, int tuneWarmup, const char *configPath) {
+    opts.numRuns = std::max(tuneFrames, 1);
+    opts.warmupFrames = std::max(tuneWarmup, 0);
+    opts.quiet = true;
+    opts.allocCheck = AllocTracker::Check::Off;
+    opts.phaseTiming = false;
+
+    std::string driver = currentDriverName();
+    printf("tune_driver=%s tune_sprites=%d tune_frames=%d tune_warmup=%d\n", driver.c_str(), opts.numQuads,
+           opts.numRuns, opts.warmupFrames);
+
+    RendererConfig best{};
+    uint64_t bestCost = UINT64_MAX;
+    for (auto &candidate: tuneCandidates(base, opts)) {
+        uint64_t frameTime = 0;
+        uint64_t gpuTime = 0;
+        visitRenderer(candidate, [&](auto renderer) {
+            using R = typename decltype(renderer)::element_type;
+            BunnyMark<R> bunnyMark{renderer.get(), opts};
+            bunnyMark.Run(surface, projView);
+            frameTime = bunnyMark.medianFrameTime();
+            gpuTime = bunnyMark.medianGpuTime();
+        });
+        uint64_t cost = std::max(frameTime, gpuTime);
+        printf("tune_config=\"%s\" frame_time=%llu gpu_time=%llu\n", describeRendererConfig(candidate).c_str(),
+               (unsigned long long) frameTime, (unsigned long long) gpuTime);
+        if (cost < bestCost) {
+            bestCost = cost;
+            best = candidate;
+        }
+    }
+
+    best.driver = driver;
+    best.numSprites = opts.numQuads;
+    best.frameTime = double(bestCost) * 1e-6;
+    printf("tune_best=\"%s\" frame_time_ms=%.3f\n", describeRendererConfig(best).c_str(), best.frameTime);
+    if (!saveRendererConfig(configPath, best)) {
+        fprintf(stderr, "Could not write renderer config: %s\n", configPath);
+        return false;
+    }
+    printf("tune_config_path=%s\n", configPath);
+    return true;
+}
+
+// Comma separated values and ranges: "start:end:step" adds start, start + step, ... up to end,
+// "start:end:xfactor" multiplies by factor instead, eg. "1000:100000:x10,200000"
+static bool parseIntList(const char *str, std::vector<int> &values) {
+    if (!str) {
+        return false;
+    }
+    values.clear();
+    for (auto &item: splitList(str)) {
+        int first, last, step, length = 0;
+        if (sscanf(item.c_str(), "%d:%d:x%d%n", &first, &last, &step, &length) == 3 && length == int(item.size())) {
+            if (first <= 0 || step < 2) {
+                return false;
+            }
+            for (long long v = first; v <= last; v *= step) {
+                values.push_back(int(v));
+            }
+        } else if (sscanf(item.c_str(), "%d:%d:%d%n", &first, &last, &step, &length) == 3 &&
+                   length == int(item.size())) {
+            if (step <= 0) {
+                return false;
+            }
+            for (long long v = first; v <= last; v += step) {
+                values.push_back(int(v));
+            }
+        } else if (sscanf(item.c_str(), "%d%n", &first, &length) == 1 && length == int(item.size())) {
+            values.push_back(first);
+        } else {
+            return false;
+        }
+    }
+    return !values.empty();
+}
+
+// Comma separated renderer type names, "all" for every renderer
+static bool parseRendererList(const char *str, std::vector<RendererType> &types) {
+    if (!str) {
+        return false;
+    }
+    types.clear();
+    if (strcmp(str, "all") == 0) {
+        for (int type = 0; type <= int(RendererType::Concurrent); type++) {
+            types.push_back(RendererType(type));
+        }
+        return true;
+    }
+    for (auto &item: splitList(str)) {
+        RendererType type;
+        if (!parseRendererType(item.c_str(), type)) {
+            return false;
+        }
+        types.push_back(type);
+    }
+    return !types.empty();
+}
+
+struct SweepOpts {
+    std::vector<RendererType> renderers;
+    std::vector<int> numSprites;
+    std::vector<int> batchSizes;
+    int repeats; // runs of every combination
+    unsigned seed; // run order
+};
+
+// Runs every renderer x sprite count x batch size combination repeats times in one process. Runs are
+// shuffled, so thermal throttling and clock changes spread over all combinations instead of biasing
+// the ones that ran last. Every run goes into report, the table pools the frames of all repeats.
+static bool sweep(const RendererConfig &base, BunnyMarkOpts opts, const SweepOpts &sweepOpts, Surface *surface,
+                  const glm::mat4 &projView, BenchReport &report) {
+    opts.quiet = true;
+    struct Point {
+        RendererConfig config;
+        int numSprites;
+    };
+    std::vector<Point> points{};
+    for (auto type: sweepOpts.renderers) {
+        if (const char *reason = unsupportedReason(type, opts)) {
+            fprintf(stderr, "Skipping %s renderer, %s\n", rendererTypeName(type), reason);
+            continue;
+        }
+        for (int numSprites: sweepOpts.numSprites) {
+            RendererConfig config = base;
+            config.type = type;
+            switch (type) {
+                case RendererType::Batch:
+                case RendererType::GeometryBatch:
+                case RendererType::InstanceCPU:
+                case RendererType::Instance:
+                    for (int batchSize: sweepOpts.batchSizes) {
+                        config.batchSize = batchSize;
+                        points.push_back({config, numSprites});
+                    }
+                    break;
+                case RendererType::Retained:
+                case RendererType::Concurrent:
+                    // Note: Need room for all sprites, batch size is not swept
+                    config.batchSize = std::max(numSprites, 1);
+                    points.push_back({config, numSprites});
+                    break;
+                default:
+                    // Batch size is not used
+                    points.push_back({config, numSprites});
+                    break;
+            }
+        }
+    }
+
+    std::vector<size_t> order{};
+    for (int r = 0; r < std::max(sweepOpts.repeats, 1); r++) {
+        for (size_t p = 0; p < points.size(); p++) {
+            order.push_back(p);
+        }
+    }
+    std::mt19937 rng{sweepOpts.seed};
+    std::shuffle(order.begin(), order.end(), rng);
+    printf("sweep_points=%zu sweep_runs=%zu sweep_seed=%u\n", points.size(), order.size(), sweepOpts.seed);
+
+    bool passed = true;
+    for (size_t run = 0; run < order.size(); run++) {
+        auto &point = points[order[run]];
+        opts.numQuads = point.numSprites;
+        uint64_t frameTime = 0;
+        uint64_t gpuTime = 0;
+        bool valid = visitRenderer(point.config, [&](auto renderer) {
+            using R = typename decltype(renderer)::element_type;
+            BunnyMark<R> bunnyMark{renderer.get(), opts};
+            bunnyMark.Run(surface, projView);
+            addRun(&report, point.config, opts, bunnyMark);
+            passed &= bunnyMark.passedAllocCheck();
+            frameTime = bunnyMark.medianFrameTime();
+            gpuTime = bunnyMark.medianGpuTime();
+        });
+        if (!valid) {
+            fprintf(stderr, "Invalid renderer config: %s\n", describeRendererConfig(point.config).c_str());
+            return false;
+        }
+        printf("sweep_run=%zu renderer_config=\"%s\" num_sprites=%d frame_time=%llu gpu_time=%llu\n", run,
+               describeRendererConfig(point.config).c_str(), point.numSprites, (unsigned long long) frameTime,
+               (unsigned long long) gpuTime);
+    }
+
+    for (auto &point: points) {
+        std::string description = describeRendererConfig(point.config);
+        std::vector<uint64_t> frameTimes{};
+        std::vector<uint64_t> gpuTimes{};
+        int runs = 0;
+        for (auto &result: report.runs()) {
+            if (result.rendererConfig == description && result.numSprites == point.numSprites) {
+                frameTimes.insert(frameTimes.end(), result.frameTimes.begin(), result.frameTimes.end());
+                gpuTimes.insert(gpuTimes.end(), result.gpuTimes.begin(), result.gpuTimes.end());
+                runs++;
+            }
+        }
+        auto frame = summarizeTimes(frameTimes, opts.hitchThreshold);
+        auto gpu = summarizeTimes(gpuTimes, opts.hitchThreshold);
+        printf("sweep_result=\"%s\" num_sprites=%d runs=%d frame_time_median=%llu frame_time_mean=%.0f "
+               "frame_time_stddev=%.0f frame_time_p99=%llu frame_time_hitches=%zu gpu_time_median=%llu "
+               "gpu_time_p99=%llu\n", description.c_str(), point.numSprites, runs,
+               (unsigned long long) frame.median, frame.mean, frame.stddev, (unsigned long long) frame.p99,
+               frame.hitches, (unsigned long long) gpu.median, (unsigned long long) gpu.p99);
+    }
+    return passed;
+}
+
+struct CapacityOpts {
+    std::vector<RendererType> renderers;
+    uint64_t budget; // ns per frame
+    int startSprites; // first count tried
+    int maxSprites; // search stops here
+    double precision; // bisection stops when the bracket is this fraction of the count
+};
+
+// Config that runs numSprites sprites, retained and concurrent renderers need room for all of them
+static RendererConfig capacityConfig(RendererConfig config, int numSprites) {
+    if (config.type == RendererType::Retained || config.type == RendererType::Concurrent) {
+        config.batchSize = std::max(numSprites, 1);
+    }
+    return config;
+}
+
+// Finds the most sprites each renderer draws within the frame budget. A count fits if the larger of its median
+// CPU and GPU frame time is within the budget. The count is doubled until a count does not fit, then the last
+// two counts are bisected. Every probe is a full benchmark run with new bunnies, so it goes into report.
+static bool capacitySearch(const RendererConfig &base, BunnyMarkOpts opts, const CapacityOpts &capacityOpts,
+                           Surface *surface, const glm::mat4 &projView, BenchReport &report) {
+    opts.quiet = true;
+    printf("capacity_budget_ms=%.3f capacity_frames=%d\n", double(capacityOpts.budget) * 1e-6, opts.numRuns);
+    bool passed = true;
+    for (auto type: capacityOpts.renderers) {
+        if (const char *reason = unsupportedReason(type, opts)) {
+            fprintf(stderr, "Skipping %s renderer, %s\n", rendererTypeName(type), reason);
+            continue;
+        }
+        RendererConfig config = base;
+        config.type = type;
+        bool valid = true;
+        auto fits = [&](int numSprites) {
+            RendererConfig probe = capacityConfig(config, numSprites);
+            opts.numQuads = numSprites;
+            uint64_t frameTime = 0;
+            uint64_t gpuTime = 0;
+            valid &= visitRenderer(probe, [&](auto renderer) {
+                using R = typename decltype(renderer)::element_type;
+                BunnyMark<R> bunnyMark{renderer.get(), opts};
+                bunnyMark.Run(surface, projView);
+                addRun(&report, probe, opts, bunnyMark);
+                passed &= bunnyMark.passedAllocCheck();
+                frameTime = bunnyMark.medianFrameTime();
+                gpuTime = bunnyMark.medianGpuTime();
+            });
+            printf("capacity_probe=\"%s\" num_sprites=%d frame_time=%llu gpu_time=%llu\n",
+                   describeRendererConfig(probe).c_str(), numSprites, (unsigned long long) frameTime,
+                   (unsigned long long) gpuTime);
+            return valid && std::max(frameTime, gpuTime) <= capacityOpts.budget;
+        };
+
+        int good = 0; // most sprites that fit
+        int bad = 0;  // fewest sprites that do not fit, 0 if the search hit maxSprites
+        long long n = std::max(capacityOpts.startSprites, 1);
+        while (valid) {
+            if (!fits(int(n))) {
+                bad = int(n);
+                break;
+            }
+            good = int(n);
+            if (n >= capacityOpts.maxSprites) {
+                break;
+            }
+            n = std::min(n * 2, (long long) capacityOpts.maxSprites);
+        }
+        while (valid && bad > 0 && bad - good > std::max(1, int(double(good) * capacityOpts.precision))) {
+            int middle = good + (bad - good) / 2;
+            if (fits(middle)) {
+                good = middle;
+            } else {
+                bad = middle;
+            }
+        }
+        if (!valid) {
+            fprintf(stderr, "Invalid renderer config: %s\n", describeRendererConfig(config).c_str());
+            return false;
+        }
+        printf("capacity=\"%s\" max_sprites=%d budget_ms=%.3f limit_reached=%d\n",
+               describeRendererConfig(capacityConfig(config, good)).c_str(), good,
+               double(capacityOpts.budget) * 1e-6, int(bad == 0));
+    }
+    return passed;
+}
+
+struct ImageCheckOpts {
+    int tolerance;         // per channel
+    double maxMismatch;    // fraction of pixels over the tolerance that still passes
+    const char *goldenDir; // nullptr for no golden images
+    bool updateGolden;     // overwrite golden images instead of comparing with them
+};
+
+// Prints one verify line, returns false if actual does not match expected
+static bool checkImage(const std::string &name, const FrameImage &expected, const FrameImage &actual,
+                       const ImageCheckOpts &checkOpts, int edgeShift = 0) {
+    ImageDiff diff = compareImages(expected, actual, checkOpts.tolerance, edgeShift);
+    bool passed = !diff.sizeMismatch && double(diff.mismatched) <= checkOpts.maxMismatch * double(diff.total);
+    printf("verify=\"%s\" frame=%d mismatched_pixels=%zu shifted_pixels=%zu edge_shift=%d max_difference=%d "
+           "result=%s\n", name.c_str(), actual.frame, diff.mismatched, diff.shifted, edgeShift, diff.maxDifference,
+           passed ? "pass" : "fail");
+    return passed;
+}
+
+// False if a frame of opts.captureFrames was not captured
+static bool checkCaptured(const std::vector<FrameImage> &captures, const BunnyMarkOpts &opts) {
+    bool passed = true;
+    for (int frame: opts.captureFrames) {
+        bool captured = std::any_of(captures.begin(), captures.end(), [&](const FrameImage &image) {
+            return image.frame == frame;
+        });
+        if (!captured) {
+            fprintf(stderr, "Frame %d was not captured%s\n", frame,
+                    opts.pipelined ? ", pipelined frames are shown one frame late" : "");
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+// Golden image of a frame, named after everything that changes the picture
+static std::string goldenPath(const char *dir, const BunnyMarkOpts &opts, int frame) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s_seed%u_n%d_%dx%d_step%ldus_frame%d.png", dir, opts.scenario->name(),
+             opts.seed, opts.numQuads, opts.windowWidth, opts.windowHeight, std::lround(opts.fixedTimestep * 1e6),
+             frame);
+    return path;
+}
+
+// Compares captures with the golden images in checkOpts.goldenDir. Missing golden images are written,
+// a mismatching frame is written next to its golden image for inspection.
+static bool checkGolden(const std::vector<FrameImage> &captures, const BunnyMarkOpts &opts,
+                        const ImageCheckOpts &checkOpts) {
+    bool passed = true;
+    for (auto &capture: captures) {
+        std::string path = goldenPath(checkOpts.goldenDir, opts, capture.frame);
+        FrameImage golden{.frame = capture.frame};
+        if (checkOpts.updateGolden || !readImagePng(path.c_str(), golden)) {
+            if (!writeImagePng(path.c_str(), capture)) {
+                fprintf(stderr, "Could not write golden image: %s\n", path.c_str());
+                passed = false;
+                continue;
+            }
+            printf("golden_written=%s\n", path.c_str());
+            continue;
+        }
+        if (!checkImage(path, golden, capture, checkOpts)) {
+            std::string actualPath = path.substr(0, path.size() - 4) + "_actual.png";
+            if (writeImagePng(actualPath.c_str(), capture)) {
+                printf("golden_actual=%s\n", actualPath.c_str());
+            }
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+// Draws the same deterministic frames with every renderer and compares them with NaiveRenderer in serial
+// mode, the reference every optimized path must match. Renderers run in the mode of opts, retained and
+// concurrent ones with room for all sprites. The reference frames are checked against golden images if set.
+static bool verify(const RendererConfig &base, BunnyMarkOpts opts, const std::vector<RendererType> &renderers,
+                   const ImageCheckOpts &checkOpts, Surface *surface, const glm::mat4 &projView) {
+    opts.quiet = true;
+    auto capture = [&](const RendererConfig &config, const BunnyMarkOpts &runOpts, std::vector<FrameImage> &images) {
+        return visitRenderer(config, [&](auto renderer) {
+            using R = typename decltype(renderer)::element_type;
+            BunnyMark<R> bunnyMark{renderer.get(), runOpts};
+            bunnyMark.Run(surface, projView);
+            images = bunnyMark.captures();
+        });
+    };
+
+    RendererConfig reference = base;
+    reference.type = RendererType::Naive;
+    BunnyMarkOpts referenceOpts = opts;
+    referenceOpts.pipelined = false;
+    referenceOpts.renderThread = false;
+    referenceOpts.parallelRecord = false;
+    std::vector<FrameImage> expected{};
+    if (!capture(reference, referenceOpts, expected) || !checkCaptured(expected, referenceOpts)) {
+        return false;
+    }
+    bool passed = true;
+    if (checkOpts.goldenDir) {
+        passed &= checkGolden(expected, referenceOpts, checkOpts);
+    }
+
+    int verified = 0;
+    for (auto type: renderers) {
+        if (const char *reason = unsupportedReason(type, opts)) {
+            fprintf(stderr, "Skipping %s renderer, %s\n", rendererTypeName(type), reason);
+            continue;
+        }
+        RendererConfig config = base;
+        config.type = type;
+        config = capacityConfig(config, opts.numQuads);
+        std::vector<FrameImage> actual{};
+        if (!capture(config, opts, actual)) {
+            fprintf(stderr, "Invalid renderer config: %s\n", describeRendererConfig(config).c_str());
+            return false;
+        }
+        passed &= checkCaptured(actual, opts);
+        for (auto &image: actual) {
+            auto it = std::find_if(expected.begin(), expected.end(), [&](const FrameImage &e) {
+                return e.frame == image.frame;
+            });
+            if (it != expected.end()) {
+                passed &= checkImage(describeRendererConfig(config), *it, image, checkOpts, verifyEdgeShift(config));
+            }
+        }
+        verified++;
+    }
+    printf("verify_renderers=%d verify_mode=%s verify_result=%s\n", verified, modeName(opts),
+           passed ? "pass" : "fail");
+    return passed;
 }
 
 int main(int argc, const char **argv) {
     int numFrames = 0;
+    int warmupFrames = 10; // run before the measured frames
+    double hitchMs = 0.0; // 0 for twice the median frame time
     int numBunnies = 0;
-    int batchSize = 0; // only for batched renderers
-    const char *rType = nullptr;
+    // Renderer flags override the config loaded with --config
+    RendererConfig config{};
+    int numThreads = 1; // job system threads, for bunny simulation and CPU vertex generation
+    bool pinWorkers = false;
+    bool threadSweep = false;
+    bool pipelined = false;
+    bool renderThread = false;
+    int queueDepth = 2; // only for render thread
+    int renderCpu = -1; // only for render thread
+    int gameCpu = -1; // only for render thread
+    bool parallelRecord = false;
+    int arenaSize = 4096; // frame arena KB per job system thread
+    AllocTracker::Check allocCheck = AllocTracker::Check::Off;
+    int allocWarmup = 10;
+    int gpuQueryDepth = 4; // frames a GPU timer result is read back late
+    bool phaseTiming = false;
+    int phaseMaxSpans = 1024;
+    const char *autoTunePath = nullptr; // writes the fastest renderer config instead of benchmarking
+    int tuneFrames = 30;
+    int tuneWarmup = 10;
+    Surface::Backend backend = Surface::Backend::Window;
+    const char *reportPath = nullptr; // machine-readable results, besides the text output
+    BenchReport::Format reportFormat = BenchReport::Format::Json;
+    bool reportFormatSet = false;
+    // Sweep mode, any of the lists runs every combination instead of a single benchmark
+    std::vector<RendererType> sweepRenderers{};
+    std::vector<int> sweepSprites{};
+    std::vector<int> sweepBatchSizes{};
+    int sweepRepeats = 3;
+    unsigned sweepSeed = std::random_device{}();
+    // Capacity mode, searches the most sprites per renderer that hold the target frame rate
+    double capacityFps = 0.0;
+    std::vector<RendererType> capacityRenderers{};
+    int capacityStart = 1000;
+    int capacityMax = 1 << 22;
+    double capacityPrecision = 2.0; // percent
+    // Workload flags override the scenario file loaded with --scenario_file
+    ScenarioConfig scenarioConfig{};
+    // Deterministic mode, fixed seed and timestep so every run draws the same frames
+    bool deterministic = false;
+    double timestepMs = 1000.0 / 60.0;
+    std::vector<int> captureFrames{}; // default the middle frame, when frames are verified
+    std::vector<RendererType> verifyRenderers{}; // compared with NaiveRenderer instead of benchmarking
+    const char *goldenDir = nullptr;
+    bool updateGolden = false;
+    int pixelTolerance = 8;
+    double maxMismatch = 0.1; // percent of pixels over the tolerance, edges and filtering differ slightly between paths
 
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--config") == 0 && !loadRendererConfig(argv[i + 1], config)) {
+            fprintf(stderr, "Could not load renderer config: %s\n", argv[i + 1]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--scenario_file") == 0 && !loadScenarioConfig(argv[i + 1], scenarioConfig)) {
+            fprintf(stderr, "Could not load scenario file: %s\n", argv[i + 1]);
+            return 1;
+        }
+    }
+    numBunnies = scenarioConfig.numSprites;
     for (int i = 1; i < argc; i++) {
         const char *arg = argv[i];
         const char *nextArg = nullptr;
         if (i + 1< argc) nextArg = argv[i + 1];
         if (strcmp(arg, "--num_frames") == 0) {
             numFrames = parseInt(nextArg);
+        } else if (strcmp(arg, "--warmup_frames") == 0) {
+            warmupFrames = parseInt(nextArg);
+        } else if (strcmp(arg, "--hitch_ms") == 0) {
+            hitchMs = nextArg ? strtod(nextArg, nullptr) : 0.0;
+        } else if (strcmp(arg, "--report") == 0) {
+            reportPath = nextArg;
+        } else if (strcmp(arg, "--sweep_renderers") == 0) {
+            if (!parseRendererList(nextArg, sweepRenderers)) {
+                fprintf(stderr, "Invalid renderer list: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        } else if (strcmp(arg, "--sweep_sprites") == 0) {
+            if (!parseIntList(nextArg, sweepSprites)) {
+                fprintf(stderr, "Invalid sprite counts: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        } else if (strcmp(arg, "--sweep_batch_sizes") == 0) {
+            if (!parseIntList(nextArg, sweepBatchSizes)) {
+                fprintf(stderr, "Invalid batch sizes: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        } else if (strcmp(arg, "--sweep_repeats") == 0) {
+            sweepRepeats = parseInt(nextArg);
+        } else if (strcmp(arg, "--sweep_seed") == 0) {
+            sweepSeed = unsigned(strtoul(nextArg ? nextArg : "0", nullptr, 10));
+        } else if (strcmp(arg, "--capacity_fps") == 0) {
+            capacityFps = nextArg ? strtod(nextArg, nullptr) : 0.0;
+        } else if (strcmp(arg, "--capacity_renderers") == 0) {
+            if (!parseRendererList(nextArg, capacityRenderers)) {
+                fprintf(stderr, "Invalid renderer list: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        } else if (strcmp(arg, "--capacity_start") == 0) {
+            capacityStart = parseInt(nextArg);
+        } else if (strcmp(arg, "--capacity_max") == 0) {
+            capacityMax = parseInt(nextArg);
+        } else if (strcmp(arg, "--capacity_precision") == 0) {
+            capacityPrecision = nextArg ? strtod(nextArg, nullptr) : 0.0;
+        } else if (strcmp(arg, "--report_format") == 0) {
+            if (!BenchReport::parseFormat(nextArg, reportFormat)) {
+                fprintf(stderr, "Invalid report format: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+            reportFormatSet = true;
         } else if (strcmp(arg, "--num_bunnies") == 0) {
             numBunnies = parseInt(nextArg);
+        } else if (strcmp(arg, "--scenario") == 0) {
+            if (!Scenario::create(nextArg)) {
+                fprintf(stderr, "Invalid scenario: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+            scenarioConfig.scenario = nextArg;
+        } else if (strcmp(arg, "--seed") == 0) {
+            scenarioConfig.seed = strtoll(nextArg ? nextArg : "-1", nullptr, 10);
+        } else if (strcmp(arg, "--width") == 0) {
+            scenarioConfig.width = parseInt(nextArg);
+        } else if (strcmp(arg, "--height") == 0) {
+            scenarioConfig.height = parseInt(nextArg);
+        } else if (strcmp(arg, "--textures") == 0) {
+            scenarioConfig.textures = parseTextureList(nextArg);
+        } else if (strcmp(arg, "--num_textures") == 0) {
+            scenarioConfig.numTextures = parseInt(nextArg);
+        } else if (strcmp(arg, "--deterministic") == 0) {
+            deterministic = true;
+        } else if (strcmp(arg, "--timestep_ms") == 0) {
+            timestepMs = nextArg ? strtod(nextArg, nullptr) : 0.0;
+        } else if (strcmp(arg, "--capture_frames") == 0) {
+            if (!parseIntList(nextArg, captureFrames)) {
+                fprintf(stderr, "Invalid capture frames: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        } else if (strcmp(arg, "--verify_renderers") == 0) {
+            if (!parseRendererList(nextArg, verifyRenderers)) {
+                fprintf(stderr, "Invalid renderer list: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        } else if (strcmp(arg, "--golden_dir") == 0) {
+            goldenDir = nextArg;
+        } else if (strcmp(arg, "--update_golden") == 0) {
+            updateGolden = true;
+        } else if (strcmp(arg, "--pixel_tolerance") == 0) {
+            pixelTolerance = parseInt(nextArg);
+        } else if (strcmp(arg, "--max_mismatch") == 0) {
+            maxMismatch = nextArg ? strtod(nextArg, nullptr) : 0.0;
+        } else if (strcmp(arg, "--moving_fraction") == 0) {
+            scenarioConfig.movingFraction = nextArg ? strtof(nextArg, nullptr) : 0.0f;
         } else if (strcmp(arg, "--batch_size") == 0) {
-            batchSize = parseInt(nextArg);
+            config.batchSize = parseInt(nextArg);
+        } else if (strcmp(arg, "--max_batch_size") == 0) {
+            config.maxBatchSize = parseInt(nextArg);
+        } else if (strcmp(arg, "--batch_shrink_frames") == 0) {
+            config.batchShrinkFrames = parseInt(nextArg);
+        } else if (strcmp(arg, "--log_batch_events") == 0) {
+            config.logBatchEvents = true;
+        } else if (strcmp(arg, "--headless") == 0) {
+            if (!Surface::parseBackend(nextArg, backend) || backend == Surface::Backend::Window) {
+                fprintf(stderr, "Invalid headless backend: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        } else if (strcmp(arg, "--auto_tune") == 0) {
+            autoTunePath = nextArg;
+        } else if (strcmp(arg, "--tune_frames") == 0) {
+            tuneFrames = parseInt(nextArg);
+        } else if (strcmp(arg, "--tune_warmup") == 0) {
+            tuneWarmup = parseInt(nextArg);
+        } else if (strcmp(arg, "--num_threads") == 0) {
+            numThreads = parseInt(nextArg);
+        } else if (strcmp(arg, "--pin_workers") == 0) {
+            pinWorkers = true;
+        } else if (strcmp(arg, "--thread_sweep") == 0) {
+            threadSweep = true;
+        } else if (strcmp(arg, "--pipelined") == 0) {
+            pipelined = true;
+        } else if (strcmp(arg, "--render_thread") == 0) {
+            renderThread = true;
+        } else if (strcmp(arg, "--queue_depth") == 0) {
+            queueDepth = parseInt(nextArg);
+        } else if (strcmp(arg, "--render_cpu") == 0) {
+            renderCpu = parseInt(nextArg);
+        } else if (strcmp(arg, "--game_cpu") == 0) {
+            gameCpu = parseInt(nextArg);
+        } else if (strcmp(arg, "--parallel_record") == 0) {
+            parallelRecord = true;
+        } else if (strcmp(arg, "--alloc_check") == 0) {
+            if (!AllocTracker::parseCheck(nextArg, allocCheck)) {
+                fprintf(stderr, "Invalid allocation check: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        } else if (strcmp(arg, "--phase_timing") == 0) {
+            phaseTiming = true;
+        } else if (strcmp(arg, "--phase_max_spans") == 0) {
+            phaseMaxSpans = parseInt(nextArg);
+        } else if (strcmp(arg, "--gpu_query_depth") == 0) {
+            gpuQueryDepth = parseInt(nextArg);
+        } else if (strcmp(arg, "--alloc_warmup") == 0) {
+            allocWarmup = parseInt(nextArg);
+        } else if (strcmp(arg, "--arena_size") == 0) {
+            arenaSize = parseInt(nextArg);
+        } else if (strcmp(arg, "--chunk_size") == 0) {
+            config.chunkSize = parseInt(nextArg);
+        } else if (strcmp(arg, "--map_per_frame") == 0) {
+            config.persistentMapping = false;
         } else if (strcmp(arg, "--renderer_type") == 0) {
-            rType = nextArg;
+            if (!parseRendererType(nextArg, config.type)) {
+                fprintf(stderr, "Invalid renderer type: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        } else if (strcmp(arg, "--topology") == 0) {
+            if (!BatchRenderer::parseTopology(nextArg, config.topology)) {
+                fprintf(stderr, "Invalid topology: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        } else if (strcmp(arg, "--vertex_format") == 0) {
+            if (!BatchRenderer::parseVertexFormat(nextArg, config.vertexFormat)) {
+                fprintf(stderr, "Invalid vertex format: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+        } else if (strcmp(arg, "--instance_layout") == 0) {
+            config.instanceLayout = nextArg ? nextArg : "";
+        } else if (strcmp(arg, "--upload_mode") == 0) {
+            if (!RetainedRenderer::parseUploadMode(nextArg, config.uploadMode)) {
+                fprintf(stderr, "Invalid upload mode: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
         }
     }
 
-    glfwInit();
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-    GLFWwindow *window = glfwCreateWindow(1280, 720, "Benchmark", nullptr, nullptr);
-    glfwMakeContextCurrent(window);
-    gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
-    gladLoadGL();
-    // Set fps to unlimited
-    glfwSwapInterval(0);
+    if (reportPath && !reportFormatSet) {
+        // Note: Format follows the extension unless given, JSON otherwise
+        size_t length = strlen(reportPath);
+        if (length >= 4 && strcmp(reportPath + length - 4, ".csv") == 0) {
+            reportFormat = BenchReport::Format::Csv;
+        }
+    }
+    if (int(renderThread) + int(pipelined) + int(parallelRecord) > 1) {
+        fprintf(stderr, "Only one of --render_thread, --pipelined and --parallel_record can be used\n");
+        return 1;
+    }
+    bool sweeping = !sweepRenderers.empty() || !sweepSprites.empty() || !sweepBatchSizes.empty();
+    bool capacity = capacityFps > 0.0;
+    bool verifying = !verifyRenderers.empty();
+    if (int(sweeping) + int(capacity) + int(autoTunePath != nullptr) + int(threadSweep) + int(verifying) > 1) {
+        fprintf(stderr, "Only one of sweep, --capacity_fps, --auto_tune, --thread_sweep and --verify_renderers "
+                        "can be used\n");
+        return 1;
+    }
+    // Note: Compared frames must be the same in every run
+    deterministic |= verifying || goldenDir != nullptr;
+    if (deterministic && timestepMs <= 0.0) {
+        fprintf(stderr, "Deterministic mode needs a positive --timestep_ms\n");
+        return 1;
+    }
+    // Note: Frames without sprites are blank with every renderer, comparing them proves nothing
+    if ((verifying || goldenDir != nullptr) && numBunnies <= 0) {
+        fprintf(stderr, "--verify_renderers and --golden_dir need sprites, see --num_bunnies\n");
+        return 1;
+    }
+    if (scenarioConfig.width <= 0 || scenarioConfig.height <= 0 || scenarioConfig.textures.empty() ||
+        scenarioConfig.numTextures <= 0 || scenarioConfig.movingFraction < 0.0f ||
+        scenarioConfig.movingFraction > 1.0f || scenarioConfig.seed < -1 || scenarioConfig.seed > int64_t(UINT32_MAX)) {
+        fprintf(stderr, "Invalid scenario options, see --width, --height, --textures, --num_textures, "
+                        "--moving_fraction and --seed\n");
+        return 1;
+    }
+    auto scenario = Scenario::create(scenarioConfig.scenario.c_str());
+    assert(scenario);
+    // Note: Random unless given or deterministic, printed so a run can be repeated
+    uint32_t seed = deterministic ? 1 : std::random_device{}();
+    if (scenarioConfig.seed >= 0) {
+        seed = uint32_t(scenarioConfig.seed);
+    }
+
+    // Headless surfaces render into an offscreen framebuffer of the same size
+    auto surface = Surface::create(backend, scenarioConfig.width, scenarioConfig.height, "Benchmark");
+    if (!surface) {
+        return 1;
+    }
+    printf("surface=%s\n", Surface::backendName(backend));
 
     // For transparency
     glEnable(GL_BLEND);
@@ -71,47 +895,141 @@ int main(int argc, const char **argv) {
 
     Camera2D camera = {};
 
-    // Load texture
-    Texture texture = loadTexture("res/rabbit.png");
-    assert(texture.id);
-    UVRegion region = getUVRegion(texture, 0, 0, texture.width, texture.height);
+    // Load textures, the texture set repeats until there are numTextures distinct GL textures.
+    // Single texture scenarios only use the first one.
+    std::vector<UVRegion> textures{};
+    int numTextures = scenario->traits().multiTexture ? scenarioConfig.numTextures : 1;
+    for (int t = 0; t < numTextures; t++) {
+        auto &path = scenarioConfig.textures[size_t(t) % scenarioConfig.textures.size()];
+        Texture texture = loadTexture(path.c_str());
+        if (!texture.id || texture.width <= 0) {
+            fprintf(stderr, "Could not load texture: %s\n", path.c_str());
+            return 1;
+        }
+        textures.push_back(getUVRegion(texture, 0, 0, texture.width, texture.height));
+    }
+    printf("scenario=%s seed=%u num_textures=%d\n", scenario->name(), seed, numTextures);
 
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
+    int width = surface->width();
+    int height = surface->height();
     glViewport(0, 0, width, height);
 
     BunnyMarkOpts opts = {
             .numRuns = numFrames,
+            .warmupFrames = std::max(warmupFrames, 0),
             .numQuads = numBunnies,
             .windowWidth = width,
             .windowHeight = height,
-            .bunnyRegion = region,
+            .textures = textures,
+            .scenario = scenario.get(),
+            .seed = seed,
+            .movingFraction = scenarioConfig.movingFraction,
+            .numThreads = numThreads,
+            .pinWorkers = pinWorkers,
+            .pipelined = pipelined,
+            .renderThread = renderThread,
+            .queueDepth = queueDepth,
+            .renderCpu = renderCpu,
+            .gameCpu = gameCpu,
+            .parallelRecord = parallelRecord,
+            .arenaSize = size_t(std::max(arenaSize, 1)) * 1024,
+            .allocCheck = allocCheck,
+            .allocWarmup = allocWarmup,
+            .quiet = false,
+            .gpuQueryDepth = std::max(gpuQueryDepth, 1),
+            .phaseTiming = phaseTiming,
+            .phaseMaxSpans = std::max(phaseMaxSpans, 0),
+            .hitchThreshold = uint64_t(std::max(hitchMs, 0.0) * 1e6),
+            .fixedTimestep = deterministic ? timestepMs * 1e-3 : 0.0,
+            .captureFrames = captureFrames,
     };
+    if (opts.captureFrames.empty() && (verifying || goldenDir)) {
+        opts.captureFrames.push_back((opts.warmupFrames + std::max(opts.numRuns, 0)) / 2);
+    }
+    if (deterministic) {
+        printf("deterministic=1 timestep_ms=%.3f\n", timestepMs);
+    }
+    ImageCheckOpts checkOpts{
+            .tolerance = std::max(pixelTolerance, 0),
+            .maxMismatch = std::max(maxMismatch, 0.0) / 100.0,
+            .goldenDir = goldenDir,
+            .updateGolden = updateGolden,
+    };
+
+    if (!autoTunePath && !sweeping && !capacity && !verifying) {
+        if (const char *reason = unsupportedReason(config.type, opts)) {
+            fprintf(stderr, "Renderer %s can not draw scenario %s: %s\n", rendererTypeName(config.type),
+                    scenario->name(), reason);
+            return 1;
+        }
+    }
 
     glm::mat4 combined = camera.getCombined({width, height});
-    if (strcmp(rType, "naive") == 0) {
-        auto r = NaiveRenderer();
-        run(&r, opts, window, combined);
-    } else if (strcmp(rType, "batch") == 0) {
-        auto r = BatchRenderer(batchSize);
-        run(&r, opts, window, combined);
-    } else if (strcmp(rType, "instance_cpu") == 0) {
-        auto r = InstanceRendererCPU(batchSize);
-        run(&r, opts, window, combined);
-    } else if (strcmp(rType, "instance") == 0) {
-        auto r = InstanceRenderer(batchSize);
-        run(&r, opts, window, combined);
-    }else if (strcmp(rType, "geometry") == 0) {
-        auto r = GeometryRenderer();
-        run(&r, opts, window, combined);
-    } else if (strcmp(rType, "geometry_batch") == 0) {
-        auto r = GeometryBatchRenderer(batchSize);
-        run(&r, opts, window, combined);
+    bool passed = true;
+    if (verifying) {
+        passed = verify(config, opts, verifyRenderers, checkOpts, surface.get(), combined);
+    } else if (autoTunePath) {
+        passed = autoTune(config, opts, surface.get(), combined, tuneFrames, tuneWarmup, autoTunePath);
+    } else if (capacity) {
+        // Note: Frame counts are per probe, a short default keeps the search quick
+        if (opts.numRuns <= 0) {
+            opts.numRuns = 60;
+        }
+        CapacityOpts capacityOpts{
+                .renderers = capacityRenderers.empty() ? std::vector{config.type} : capacityRenderers,
+                .budget = uint64_t(1e9 / capacityFps),
+                .startSprites = std::max(capacityStart, 1),
+                .maxSprites = std::max(capacityMax, 1),
+                .precision = std::max(capacityPrecision, 0.0) / 100.0,
+        };
+        BenchReport report{collectMachineInfo(Surface::backendName(backend), width, height), opts.hitchThreshold};
+        passed = capacitySearch(config, opts, capacityOpts, surface.get(), combined, report);
+        if (reportPath) {
+            if (!report.write(reportPath, reportFormat)) {
+                fprintf(stderr, "Could not write report: %s\n", reportPath);
+                return 1;
+            }
+            printf("report=%s report_format=%s\n", reportPath, BenchReport::formatName(reportFormat));
+        }
+    } else if (sweeping) {
+        // Note: Dimensions not given keep the value of the single benchmark flags
+        SweepOpts sweepOpts{
+                .renderers = sweepRenderers.empty() ? std::vector{config.type} : sweepRenderers,
+                .numSprites = sweepSprites.empty() ? std::vector{numBunnies} : sweepSprites,
+                .batchSizes = sweepBatchSizes.empty() ? std::vector{config.batchSize} : sweepBatchSizes,
+                .repeats = sweepRepeats,
+                .seed = sweepSeed,
+        };
+        BenchReport report{collectMachineInfo(Surface::backendName(backend), width, height), opts.hitchThreshold};
+        passed = sweep(config, opts, sweepOpts, surface.get(), combined, report);
+        if (reportPath) {
+            if (!report.write(reportPath, reportFormat)) {
+                fprintf(stderr, "Could not write report: %s\n", reportPath);
+                return 1;
+            }
+            printf("report=%s report_format=%s\n", reportPath, BenchReport::formatName(reportFormat));
+        }
     } else {
-        assert(false && "Invalid renderer");
+        printf("renderer_config=\"%s\"\n", describeRendererConfig(config).c_str());
+        std::unique_ptr<BenchReport> report{};
+        if (reportPath) {
+            report = std::make_unique<BenchReport>(collectMachineInfo(Surface::backendName(backend), width, height),
+                                                   opts.hitchThreshold);
+        }
+        std::vector<FrameImage> captures{};
+        passed = runConfig(config, opts, surface.get(), combined, threadSweep, report.get(), &captures);
+        if (goldenDir) {
+            passed &= checkCaptured(captures, opts);
+            passed &= checkGolden(captures, opts, checkOpts);
+        }
+        if (report) {
+            if (!report->write(reportPath, reportFormat)) {
+                fprintf(stderr, "Could not write report: %s\n", reportPath);
+                return 1;
+            }
+            printf("report=%s report_format=%s\n", reportPath, BenchReport::formatName(reportFormat));
+        }
     }
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
-    return 0;
+    return passed ? 0 : 2;
 }
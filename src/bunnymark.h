@@ -1,166 +1,851 @@
 #ifndef DIPLOMA_BUNNYMARK_H
 #define DIPLOMA_BUNNYMARK_H
 
+#include <algorithm>
+#include <array>
 #include <vector>
 #include <cstdint>
 #include <cassert>
 #include <random>
 #include <chrono>
+#include <memory>
 #include "vec2.hpp"
+#include "alloc_tracker.h"
+#include "bench_report.h"
 #include "common.h"
-#include "GLFW/glfw3.h"
+#include "renderers/batch_capacity.h"
+#include "renderers/retained_renderer.h"
+#include "parallel_recorder.h"
+#include "render_thread.h"
+#include "scenario.h"
+#include "surface.h"
+#include "frame_arena.h"
+#include "frame_capture.h"
+#include "gpu_timer_ring.h"
+#include "phase_timer.h"
+#include "job_system.h"
+#include "async_worker.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DIPLOMA_SSE2
+#include <emmintrin.h>
+#endif
 
 struct BunnyMarkOpts {
-    int numRuns;
+    int numRuns; // measured frames, warm-up frames are run before them
+    int warmupFrames; // not measured, caches, drivers and adaptive buffers settle during the first frames
     int numQuads;
     int windowWidth;
     int windowHeight;
-    UVRegion bunnyRegion;
+    std::vector<UVRegion> textures; // texture set, sprites of the scenario index into it
+    const Scenario *scenario; // workload, see Scenario
+    uint32_t seed; // scenario seed, the same seed draws the same sprites
+    float movingFraction; // scenarios with static sprites only
+    int numThreads; // job system threads for simulation and CPU vertex generation, 1 runs it on the calling thread
+    bool pinWorkers; // pin job system workers to cpu 1, 2, ...
+    bool pipelined; // simulate frame N + 1 on a worker thread while frame N is submitted
+    bool renderThread; // record command lists, GL calls are made on a dedicated render thread
+    int queueDepth; // render thread only, number of frames the game thread can be ahead
+    int renderCpu; // render thread only, -1 for no affinity
+    int gameCpu; // render thread only, -1 for no affinity
+    bool parallelRecord; // update and record sprites on all simulation threads, sorted before drawing
+    size_t arenaSize; // frame arena bytes per job system thread, for transient render data
+    AllocTracker::Check allocCheck; // allocations inside begin() ... end(), needs DIPLOMA_ALLOC_TRACKING
+    int allocWarmup; // frames before allocations are checked, caches and buffers grow during the first frames
+    bool quiet; // only collect frame times, nothing is printed (auto-tuner calibration)
+    int gpuQueryDepth; // GPU timer queries in flight, results are read this many frames late (1 waits every frame)
+    bool phaseTiming; // CPU and GPU time of clear, texture binds, uploads, draws and swap, see PhaseTimer
+    int phaseMaxSpans; // phase spans timed on the GPU per frame, each one is two timestamp queries
+    uint64_t hitchThreshold; // ns, frames slower than this are counted as hitches, 0 for twice the median
+    double fixedTimestep; // s, every frame simulates this step, 0 steps by the wall clock time between frames
+    std::vector<int> captureFrames; // color buffers read back, frames counted from the first warm-up frame
 };
 
+// Renderers that keep sprites between frames, bunnies are created once and only moved each frame
 template<typename R>
-class BunnyMark {
+concept RetainedSprites = requires(R &r, SpriteHandle handle) {
+    r.updateSpriteTransform(handle, glm::vec2{}, 0.0f);
+};
 
-    struct Bunny {
-        glm::vec2 position;
-        glm::vec2 size;
-        glm::vec2 velocity;
-        float rotation;
-        Color color;
-    };
+// Renderers that can split CPU side vertex or matrix generation over a job system
+template<typename R>
+concept JobSprites = requires(R &r, JobSystem *jobs) {
+    r.setJobSystem(jobs);
+};
+
+// Renderers that keep per-frame data in a frame arena
+template<typename R>
+concept FrameArenaUser = requires(R &r, FrameArena *arena) {
+    r.setFrameArena(arena);
+};
+
+// Renderers with a batch capacity policy, see BatchCapacity
+template<typename R>
+concept BatchCapacityUser = requires(const R &r) {
+    r.capacityStats();
+};
+
+// Renderers that accept sprites from several threads at once, in no particular order
+template<typename R>
+concept ConcurrentSprites = requires(R &r) {
+    r.producer().drawSprite(UVRegion{}, glm::vec2{}, glm::vec2{}, glm::vec2{}, 0.0f, Color{});
+};
+
+template<typename R>
+class BunnyMark {
+    // Bunnies per job, smaller ranges are not worth scheduling
+    constexpr static size_t updateGrain = 4096;
 
     BunnyMarkOpts opts;
     // Note: Could use virtual functions, but they are slower.
     R *renderer;
-    std::vector<Bunny> bunnies{};
+    JobSystem jobs;
+    FrameArena arena;
+
+    // Bunnies are stored as structure of arrays, so update only touches positions and velocities.
+    // Only bunnies [0, numMoving) move, the rest are static scenery.
+    std::vector<glm::vec2> positions{};
+    std::vector<glm::vec2> velocities{};
+    std::vector<glm::vec2> sizes{};
+    std::vector<glm::vec2> origins{};
+    std::vector<float> rotations{};
+    std::vector<Color> colors{};
+    std::vector<uint16_t> textureIndices{}; // into opts.textures
+    std::vector<uint8_t> layers{};
+    std::vector<BlendMode> blendModes{};
+    size_t numMoving{};
+    std::vector<SpriteHandle> handles{}; // only for retained renderers
+
+    // Consecutive bunnies with the same texture and blend mode, drawn with one drawSprites call
+    struct SpriteRun {
+        size_t begin;
+        size_t end;
+        uint16_t texture;
+        BlendMode blendMode;
+    };
+    std::vector<SpriteRun> runs{};
+    BlendMode currentBlendMode = BlendMode::Alpha;
+
+    // Pipelined mode only: state of the next frame, written by simWorker while the current one is submitted
+    std::unique_ptr<AsyncWorker> simWorker{};
+    std::vector<glm::vec2> nextPositions{};
+    std::vector<glm::vec2> nextVelocities{};
+
+    // Parallel record mode only
+    std::unique_ptr<ParallelRecorder> recorder{};
+
+    // Heap allocations after warm-up, per phase
+    AllocTracker::Snapshot allocTotals{};
+    uint64_t maxFrameHotAllocs{}; // most C++ allocations inside begin() ... end() in one frame
+    int hotAllocFrames{};
+    int firstHotAllocFrame = -1;
+
+    // CPU and GPU time and renderer counters of every measured frame in ns, of the last Run
+    std::vector<uint64_t> frameTimes{};
+    std::vector<uint64_t> gpuTimes{};
+    std::vector<RendererStats> rendererStats{};
+    // Phase timing only, of the last Run
+    std::vector<PhaseTimer::Times> phaseTimes{};
+    // Captured frames of the last Run
+    std::vector<FrameImage> frameCaptures{};
 
 public:
 
-    explicit BunnyMark(R *renderer, BunnyMarkOpts opts) : renderer(renderer), opts(opts) {
+    explicit BunnyMark(R *renderer, BunnyMarkOpts opts)
+            : opts(opts), renderer(renderer), jobs(std::max(opts.numThreads, 1), opts.pinWorkers),
+              arena(opts.arenaSize, jobs.threadCount()) {
         int numResults = opts.numRuns;
         assert(numResults >= 0);
-        bunnies.reserve(opts.numQuads);
+        assert(opts.scenario && !opts.textures.empty());
+        assert(!(RetainedSprites<R> && opts.scenario->traits().blendModes) && "Retained sprites have one pass");
         setup();
+        if (opts.pipelined) {
+            simWorker = std::make_unique<AsyncWorker>();
+            // Note: Copies, only moving bunnies are written, static ones must survive the swap
+            nextPositions = positions;
+            nextVelocities = velocities;
+        }
+        if (opts.parallelRecord) {
+            assert(!RetainedSprites<R> && "Retained sprites can not be recorded");
+            recorder = std::make_unique<ParallelRecorder>(renderer, jobs.threadCount(), &jobs, &arena);
+        }
+        if constexpr (JobSprites<R>) {
+            renderer->setJobSystem(&jobs);
+        }
+        if constexpr (FrameArenaUser<R>) {
+            renderer->setFrameArena(&arena);
+        }
+    }
+
+    ~BunnyMark() {
+        // Renderer can outlive the benchmark
+        if constexpr (RetainedSprites<R>) {
+            // Note: Reverse order, so the next benchmark on this renderer gets the slots back in the same order
+            for (auto it = handles.rbegin(); it != handles.rend(); ++it) {
+                renderer->destroySprite(*it);
+            }
+        }
+        if constexpr (JobSprites<R>) {
+            renderer->setJobSystem(nullptr);
+        }
+        if constexpr (FrameArenaUser<R>) {
+            renderer->setFrameArena(nullptr);
+        }
     }
 
-    ~BunnyMark() = default;
+    void Run(Surface *surface, const glm::mat4 &projView) {
+        if (opts.renderThread) {
+            RunRenderThread(surface, projView);
+            return;
+        }
 
-    void Run(GLFWwindow *window, const glm::mat4 &projView) {
         using Nano = std::chrono::nanoseconds;
         using Clock = std::chrono::high_resolution_clock;
         struct FrameResult {
             uint64_t total;
             uint64_t gpu;
+            // Pipelined mode only
+            uint64_t sim;     // simulation of the next frame on the worker
+            uint64_t simWait; // main thread waiting for the worker after submit
+            uint64_t overlap; // simulation time that ran in parallel with submit
+            RendererStats renderer;
         };
 
         std::vector<FrameResult> results{};
-        results.reserve(opts.numRuns);
-
-        GLuint query;
-        glGenQueries(1, &query);
+        results.reserve(totalFrames());
+        frameCaptures.clear();
 
+        GpuTimerRing gpuTimers{std::max(opts.gpuQueryDepth, 1), totalFrames()};
+        auto phaseTimer = startPhaseTimer();
 
-        double lastFrame = 0.0f;
-        glfwSetTime(0);
-        for (int i = 0; i < opts.numRuns; i++) {
-            double currentFrame = glfwGetTime();
-            double dt = currentFrame - lastFrame;
-            lastFrame = currentFrame;
+        // Note: Not glfwGetTime, headless surfaces run without GLFW
+        auto lastFrame = Clock::now();
+        for (int i = 0; i < int(totalFrames()); i++) {
+            double dt = frameDelta(lastFrame);
 
+            // Note: Waiting for a free query when all are in flight is not part of the frame
+            gpuTimers.begin(i);
+            if (phaseTimer) {
+                phaseTimer->beginFrame(i);
+            }
+            AllocTracker::Snapshot allocsBefore = AllocTracker::snapshot();
             auto start = Clock::now();
-            glBeginQuery(GL_TIME_ELAPSED, query);
 
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glClearColor(0.0f, 0.0f, 0.2f, 1.0f);
+            {
+                PhaseTimer::Scope phase{RenderPhase::Clear};
+                // Note: Color is set first, or the first frame is cleared with the default color
+                glClearColor(0.0f, 0.0f, 0.2f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            }
+
+            FrameResult result{};
+            if (opts.pipelined) {
+                // Frame shown is one simulation step behind, next step is computed during submit
+                Clock::time_point simStart, simEnd;
+                simWorker->start([this, dt, &simStart, &simEnd] {
+                    simStart = Clock::now();
+                    simulate(float(dt), positions, velocities, nextPositions, nextVelocities);
+                    simEnd = Clock::now();
+                });
+                auto submitStart = Clock::now();
+                // Note: Phase is global, the worker's simulation is counted under submit and flush
+                result.renderer = drawPasses(projView);
+                auto submitEnd = Clock::now();
+                simWorker->wait();
+                auto waitEnd = Clock::now();
 
-            renderer->begin(projView);
-            for (auto &bunny: bunnies) {
-                RunFrame(dt, bunny);
+                std::swap(positions, nextPositions);
+                std::swap(velocities, nextVelocities);
+
+                auto overlap = std::min(simEnd, submitEnd) - std::max(simStart, submitStart);
+                result.sim = std::chrono::duration_cast<Nano>(simEnd - simStart).count();
+                result.simWait = std::chrono::duration_cast<Nano>(waitEnd - submitEnd).count();
+                result.overlap = std::max<int64_t>(0, std::chrono::duration_cast<Nano>(overlap).count());
+            } else if (opts.parallelRecord) {
+                // Simulation runs inside begin() ... end() in this mode
+                {
+                    AllocTracker::Scope phase{AllocPhase::Submit};
+                    recorder->begin(projView);
+                    simulateAndRecord(float(dt));
+                }
+                {
+                    AllocTracker::Scope phase{AllocPhase::Flush};
+                    recorder->end();
+                }
+                result.renderer = renderer->frameStats();
+            } else if constexpr (ConcurrentSprites<R>) {
+                {
+                    AllocTracker::Scope phase{AllocPhase::Submit};
+                    renderer->begin(projView);
+                    simulateAndAppend(float(dt));
+                }
+                {
+                    AllocTracker::Scope phase{AllocPhase::Flush};
+                    renderer->end();
+                }
+                result.renderer = renderer->frameStats();
+            } else {
+                {
+                    AllocTracker::Scope phase{AllocPhase::Simulation};
+                    simulate(float(dt), positions, velocities, positions, velocities);
+                }
+                result.renderer = drawPasses(projView);
+            }
+            renderer->endFrame();
+            gpuTimers.end();
+            // Note: Pipelined frames show the simulation step of the previous frame, captures are labelled with it
+            int shownFrame = opts.pipelined ? i - 1 : i;
+            if (capturesFrame(shownFrame)) {
+                frameCaptures.push_back(captureFrame(shownFrame, opts.windowWidth, opts.windowHeight));
+            }
+            arena.endFrame();
+            {
+                AllocTracker::Scope phase{AllocPhase::Swap};
+                {
+                    PhaseTimer::Scope swapPhase{RenderPhase::Swap};
+                    surface->swapBuffers();
+                }
+                surface->pollEvents();
             }
-            renderer->end();
-            glEndQuery(GL_TIME_ELAPSED);
-            glfwSwapBuffers(window);
-            glfwPollEvents();
 
             auto end = Clock::now();
             auto elapsed = std::chrono::duration_cast<Nano>(end - start).count();
+            gpuTimers.poll();
+            if (phaseTimer) {
+                phaseTimer->endFrame();
+                phaseTimer->poll();
+            }
+
+            result.total = elapsed;
+            results.push_back(result);
+            if (i >= opts.allocWarmup) {
+                countAllocs(i, AllocTracker::since(allocsBefore));
+            }
 
-            GLint done = false;
-            while (!done) {
-                glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &done);
+        }
+        gpuTimers.finish();
+        stopPhaseTimer(phaseTimer.get());
+        auto &gpuResults = gpuTimers.results();
+        for (size_t i = 0; i < results.size(); i++) {
+            results[i].gpu = gpuResults[i];
+        }
+        results.erase(results.begin(), results.begin() + ptrdiff_t(warmupFrames()));
+        frameTimes.clear();
+        gpuTimes.clear();
+        rendererStats.clear();
+        for (auto &res: results) {
+            frameTimes.push_back(res.total);
+            gpuTimes.push_back(res.gpu);
+            rendererStats.push_back(res.renderer);
+        }
+        if (opts.quiet) {
+            return;
+        }
+        printf("gpu_query_depth=%d gpu_query_stalls=%zu gpu_query_latency=%zu\n", gpuTimers.depth(),
+               gpuTimers.stalls(), gpuTimers.maxLatency());
+        if (!opts.pipelined) {
+            for (auto &res: results) {
+                printf("frame_time=%llu gpu_time=%llu\n", (unsigned long long) res.total,
+                       (unsigned long long) res.gpu);
+                printRendererStats(res.renderer);
             }
-            GLuint64 elapsedGpu = 0;
-            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedGpu);
+        } else {
+            uint64_t totalSim = 0;
+            uint64_t totalOverlap = 0;
+            for (auto &res: results) {
+                printf("frame_time=%llu gpu_time=%llu sim_time=%llu sim_wait=%llu overlap=%llu\n",
+                       (unsigned long long) res.total, (unsigned long long) res.gpu, (unsigned long long) res.sim,
+                       (unsigned long long) res.simWait, (unsigned long long) res.overlap);
+                printRendererStats(res.renderer);
+                totalSim += res.sim;
+                totalOverlap += res.overlap;
+            }
+            // Share of simulation time hidden behind submission
+            printf("pipeline_overlap=%.1f%%\n", totalSim ? 100.0 * double(totalOverlap) / double(totalSim) : 0.0);
+        }
+        printSummary();
+        printPhaseStats();
+        printArenaStats();
+        printAllocStats();
+        if constexpr (BatchCapacityUser<R>) {
+            printCapacityStats();
+        }
+    }
+
+    // Median CPU and GPU frame time of the last Run in ns
+    [[nodiscard]]
+    uint64_t medianFrameTime() const {
+        return summarizeTimes(frameTimes, opts.hitchThreshold).median;
+    }
+    [[nodiscard]]
+    uint64_t medianGpuTime() const {
+        return summarizeTimes(gpuTimes, opts.hitchThreshold).median;
+    }
+
+    // Copies measured frames of the last Run into result
+    void collectFrames(RunResult &result) const {
+        result.warmupFrames = int(warmupFrames());
+        result.frameTimes = frameTimes;
+        result.gpuTimes = gpuTimes;
+        result.rendererStats = rendererStats;
+    }
+
+    // Color buffers of opts.captureFrames in the last Run, in frame order. Frames that were not shown are missing.
+    [[nodiscard]]
+    const std::vector<FrameImage> &captures() const {
+        return frameCaptures;
+    }
+
+    // False if allocations were made inside begin() ... end() after warm-up and the check is set to fail
+    [[nodiscard]]
+    bool passedAllocCheck() const {
+        return opts.allocCheck != AllocTracker::Check::Fail || hotAllocFrames == 0;
+    }
+
+    // Game thread simulates and records command lists, render thread plays them into the renderer
+    void RunRenderThread(Surface *surface, const glm::mat4 &projView) {
+        using Nano = std::chrono::nanoseconds;
+        using Clock = std::chrono::high_resolution_clock;
+        struct FrameResult {
+            uint64_t total;
+            uint64_t acquireWait; // game thread blocked on a free command list
+        };
+        if constexpr (RetainedSprites<R>) {
+            fprintf(stderr, "Retained sprites can not be recorded into command lists\n");
+            return;
+        }
 
+        if (opts.gameCpu >= 0 && !pinCurrentThread(opts.gameCpu)) {
+            fprintf(stderr, "Could not pin game thread to cpu %d\n", opts.gameCpu);
+        }
+
+        std::vector<FrameResult> results{};
+        results.reserve(totalFrames());
+
+        // Note: Created while the context is current here, timed on the render thread
+        auto phaseTimer = startPhaseTimer();
+        RenderThread renderThread{surface, renderer, RenderThread::Options{
+                .queueDepth = std::max(opts.queueDepth, 1),
+                .cpu = opts.renderCpu,
+                .gpuQueryDepth = std::max(opts.gpuQueryDepth, 1),
+        }};
+
+        auto lastFrame = Clock::now();
+        for (int i = 0; i < int(totalFrames()); i++) {
+            double dt = frameDelta(lastFrame);
+
+            auto start = Clock::now();
+            simulate(float(dt), positions, velocities, positions, velocities);
+
+            auto acquireStart = Clock::now();
+            CommandList *list = renderThread.acquire();
+            auto acquireEnd = Clock::now();
+
+            list->projView = projView;
+            list->clearColor = {0.0f, 0.0f, 0.2f, 1.0f};
+            list->captureFrame = capturesFrame(i) ? i : -1;
+            for (size_t b = 0; b < positions.size(); b++) {
+                list->drawSprite(region(b), positions[b], sizes[b], origins[b], rotations[b], colors[b]);
+            }
+            renderThread.submit(list);
+            // Note: Events must be processed on the main thread
+            surface->pollEvents();
+
+            auto end = Clock::now();
             results.push_back(FrameResult{
-                    .total = elapsed,
-                    .gpu = elapsedGpu
+                    .total = uint64_t(std::chrono::duration_cast<Nano>(end - start).count()),
+                    .acquireWait = uint64_t(std::chrono::duration_cast<Nano>(acquireEnd - acquireStart).count()),
             });
+        }
+        renderThread.finish();
+        stopPhaseTimer(phaseTimer.get());
+        frameCaptures = renderThread.captures();
 
+        auto &stats = renderThread.stats();
+        assert(stats.size() == results.size());
+        frameTimes.clear();
+        gpuTimes.clear();
+        rendererStats.clear();
+        for (size_t i = warmupFrames(); i < results.size(); i++) {
+            frameTimes.push_back(results[i].total);
+            gpuTimes.push_back(stats[i].gpu);
+            rendererStats.push_back(stats[i].renderer);
         }
-        for (auto res: results) {
-            printf("frame_time=%lld gpu_time=%lld\n", res.total, res.gpu);
+        for (size_t i = size_t(std::max(opts.allocWarmup, 0)); i < stats.size(); i++) {
+            countAllocs(int(i), stats[i].allocs);
         }
-
+        if (opts.quiet) {
+            return;
+        }
+        for (size_t i = warmupFrames(); i < results.size(); i++) {
+            printf("frame_time=%llu gpu_time=%llu render_time=%llu acquire_wait=%llu\n",
+                   (unsigned long long) results[i].total, (unsigned long long) stats[i].gpu,
+                   (unsigned long long) stats[i].render, (unsigned long long) results[i].acquireWait);
+            printRendererStats(stats[i].renderer);
+        }
+        printSummary();
+        printPhaseStats();
+        printAllocStats();
     }
 
 private:
 
-    int randRange(std::mt19937 &rng, int min, int max) {
-        int x = rng() % (max - min);
-        return min + x;
+    [[nodiscard]]
+    size_t warmupFrames() const {
+        return size_t(std::max(opts.warmupFrames, 0));
+    }
+
+    // Warm-up and measured frames
+    [[nodiscard]]
+    size_t totalFrames() const {
+        return warmupFrames() + size_t(std::max(opts.numRuns, 0));
+    }
+
+    // Seconds to simulate in this frame, lastFrame is the start of the previous one
+    double frameDelta(std::chrono::high_resolution_clock::time_point &lastFrame) const {
+        auto currentFrame = std::chrono::high_resolution_clock::now();
+        double dt = std::chrono::duration<double>(currentFrame - lastFrame).count();
+        lastFrame = currentFrame;
+        return opts.fixedTimestep > 0.0 ? opts.fixedTimestep : dt;
+    }
+
+    [[nodiscard]]
+    bool capturesFrame(int frame) const {
+        return frame >= 0 && std::find(opts.captureFrames.begin(), opts.captureFrames.end(), frame) !=
+                              opts.captureFrames.end();
+    }
+
+    void printSummary() {
+        printf("warmup_frames=%zu measured_frames=%zu\n", warmupFrames(), frameTimes.size());
+        printTimeSummary("frame_time", summarizeTimes(frameTimes, opts.hitchThreshold));
+        printTimeSummary("gpu_time", summarizeTimes(gpuTimes, opts.hitchThreshold));
+    }
+
+    // nullptr unless phase timing is enabled
+    std::unique_ptr<PhaseTimer> startPhaseTimer() {
+        phaseTimes.clear();
+        if (!opts.phaseTiming) {
+            return nullptr;
+        }
+        auto timer = std::make_unique<PhaseTimer>(std::max(opts.gpuQueryDepth, 1), opts.phaseMaxSpans,
+                                                  totalFrames());
+        PhaseTimer::setActive(timer.get());
+        return timer;
+    }
+
+    void stopPhaseTimer(PhaseTimer *timer) {
+        if (!timer) {
+            return;
+        }
+        timer->finish();
+        PhaseTimer::setActive(nullptr);
+        phaseTimes = timer->results();
+        size_t warmup = std::min(warmupFrames(), phaseTimes.size());
+        phaseTimes.erase(phaseTimes.begin(), phaseTimes.begin() + ptrdiff_t(warmup));
+    }
+
+    // Mean time per frame of each phase
+    void printPhaseStats() {
+        if (phaseTimes.empty()) {
+            return;
+        }
+        auto numFrames = double(phaseTimes.size());
+        uint64_t untimed = 0;
+        for (int p = 0; p < PhaseTimer::numPhases; p++) {
+            uint64_t cpu = 0;
+            uint64_t gpu = 0;
+            uint64_t spans = 0;
+            for (auto &times: phaseTimes) {
+                cpu += times.cpu[p];
+                gpu += times.gpu[p];
+                spans += times.spans[p];
+            }
+            printf("phase=%s cpu_time=%.0f gpu_time=%.0f spans=%.1f\n", PhaseTimer::phaseName(RenderPhase(p)),
+                   double(cpu) / numFrames, double(gpu) / numFrames, double(spans) / numFrames);
+        }
+        for (auto &times: phaseTimes) {
+            untimed += times.untimedSpans;
+        }
+        if (untimed > 0) {
+            fprintf(stderr, "%llu phase spans were not timed on the GPU, increase --phase_max_spans\n",
+                    (unsigned long long) untimed);
+        }
+    }
+
+    // Counters of one frame, printed after its frame time
+    static void printRendererStats(const RendererStats &stats) {
+        printf("draw_calls=%llu sprites=%llu vertices=%llu instances=%llu bytes_uploaded=%llu texture_binds=%llu "
+               "state_changes=%llu", (unsigned long long) stats.drawCalls, (unsigned long long) stats.sprites,
+               (unsigned long long) stats.vertices, (unsigned long long) stats.instances,
+               (unsigned long long) stats.bytesUploaded, (unsigned long long) stats.textureBinds,
+               (unsigned long long) stats.stateChanges);
+        for (int r = 0; r < RendererStats::numFlushReasons; r++) {
+            printf(" flushes_%s=%llu", RendererStats::flushReasonName(FlushReason(r)),
+                   (unsigned long long) stats.flushes[r]);
+        }
+        printf("\n");
+    }
+
+    void printArenaStats() {
+        auto stats = arena.stats();
+        printf("arena_high_water=%zu arena_thread_high_water=%zu arena_capacity=%zu arena_allocations=%llu "
+               "arena_bytes=%llu arena_overflows=%llu\n",
+               stats.highWater, stats.threadHighWater, stats.capacity, (unsigned long long) stats.allocations,
+               (unsigned long long) stats.bytes, (unsigned long long) stats.overflows);
+        if (stats.overflows > 0) {
+            fprintf(stderr, "Frame arena overflowed %llu times (%llu bytes), increase --arena_size\n",
+                    (unsigned long long) stats.overflows, (unsigned long long) stats.overflowBytes);
+        }
+    }
+
+    void printCapacityStats() {
+        auto stats = renderer->capacityStats();
+        printf("batch_capacity=%zu batch_peak_capacity=%zu largest_batch=%zu batch_grows=%llu batch_shrinks=%llu "
+               "batch_gpu_reallocs=%llu batch_full_flushes=%llu\n",
+               stats.capacity, stats.peakCapacity, stats.largestBatch, (unsigned long long) stats.grows,
+               (unsigned long long) stats.shrinks, (unsigned long long) stats.gpuReallocations,
+               (unsigned long long) stats.fullFlushes);
     }
 
-    int randVelocity(std::mt19937 &rng, int min, int max) {
-        int x = randRange(rng, min, max);
-        int rev = rng() % 2;
-        if (rev) {
-            return -x;
+    // Adds the allocations made during one frame after warm-up
+    void countAllocs(int frame, const AllocTracker::Snapshot &frameAllocs) {
+        for (int p = 0; p < AllocTracker::numPhases; p++) {
+            allocTotals[p].allocations += frameAllocs[p].allocations;
+            allocTotals[p].bytes += frameAllocs[p].bytes;
+            allocTotals[p].frees += frameAllocs[p].frees;
+            allocTotals[p].newAllocations += frameAllocs[p].newAllocations;
+        }
+        // Note: Only C++ allocations are checked, GL drivers may allocate in draw calls (llvmpipe does per instance)
+        uint64_t hot = 0;
+        for (AllocPhase p: {AllocPhase::Submit, AllocPhase::Flush}) {
+            hot += frameAllocs[int(p)].newAllocations;
+        }
+        maxFrameHotAllocs = std::max(maxFrameHotAllocs, hot);
+        if (hot > 0) {
+            hotAllocFrames++;
+            if (firstHotAllocFrame < 0) {
+                firstHotAllocFrame = frame;
+            }
         }
-        return x;
+    }
+
+    void printAllocStats() {
+        if (!AllocTracker::enabled()) {
+            if (opts.allocCheck != AllocTracker::Check::Off) {
+                fprintf(stderr, "Allocation check needs a build with DIPLOMA_ALLOC_TRACKING\n");
+            }
+            return;
+        }
+        for (int p = 0; p < AllocTracker::numPhases; p++) {
+            auto &counts = allocTotals[p];
+            printf("alloc_phase=%s allocs=%llu bytes=%llu frees=%llu new_allocs=%llu\n",
+                   AllocTracker::phaseName(AllocPhase(p)), (unsigned long long) counts.allocations,
+                   (unsigned long long) counts.bytes, (unsigned long long) counts.frees,
+                   (unsigned long long) counts.newAllocations);
+        }
+        printf("hot_alloc_frames=%d max_frame_hot_allocs=%llu\n", hotAllocFrames, (unsigned long long) maxFrameHotAllocs);
+        if (opts.allocCheck != AllocTracker::Check::Off && hotAllocFrames > 0) {
+            fprintf(stderr, "%s: heap allocations inside begin() ... end() in %d frames after warm-up, first in frame %d\n",
+                    opts.allocCheck == AllocTracker::Check::Fail ? "Error" : "Warning", hotAllocFrames,
+                    firstHotAllocFrame);
+        }
+    }
+
+    [[nodiscard]]
+    const UVRegion &region(size_t bunny) const {
+        return opts.textures[textureIndices[bunny]];
     }
 
     void setup() {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        for (int i = 0; i < opts.numQuads; i++) {
-            bunnies.push_back(Bunny{
-                    .position = {
-                            randRange(gen, 0, opts.windowWidth),
-                            randRange(gen, 0, opts.windowHeight)
-                    },
-                    .size = {
-                            randRange(gen, 20, 60),
-                            randRange(gen, 20, 60)
-                    },
-                    .velocity = {
-                            randVelocity(gen, 120, 140),
-                            randVelocity(gen, 120, 140)
-                    },
-                    .rotation = randRange(gen, 0, 360) / 360.0f,
-                    .color = Color{
-                            randRange(gen, 10, 255),
-                            randRange(gen, 10, 255),
-                            randRange(gen, 10, 255),
-                            randRange(gen, 80, 250)
-                    }
-            });
+        SpriteSet set{};
+        opts.scenario->populate(ScenarioOpts{
+                .numSprites = opts.numQuads,
+                .width = opts.windowWidth,
+                .height = opts.windowHeight,
+                .numTextures = int(opts.textures.size()),
+                .seed = opts.seed,
+                .movingFraction = opts.movingFraction,
+        }, set);
+        positions = std::move(set.positions);
+        velocities = std::move(set.velocities);
+        sizes = std::move(set.sizes);
+        origins = std::move(set.origins);
+        rotations = std::move(set.rotations);
+        colors = std::move(set.colors);
+        textureIndices = std::move(set.textures);
+        layers = std::move(set.layers);
+        blendModes = std::move(set.blendModes);
+        numMoving = std::min(set.numMoving, positions.size());
+        assert(std::ranges::all_of(textureIndices, [&](uint16_t index) {
+            return index < opts.textures.size();
+        }));
+
+        for (size_t i = 0; i < positions.size();) {
+            size_t end = i + 1;
+            while (end < positions.size() && textureIndices[end] == textureIndices[i] &&
+                   blendModes[end] == blendModes[i]) {
+                end++;
+            }
+            runs.push_back({i, end, textureIndices[i], blendModes[i]});
+            i = end;
+        }
+
+        if constexpr (RetainedSprites<R>) {
+            handles.reserve(positions.size());
+            for (size_t i = 0; i < positions.size(); i++) {
+                handles.push_back(renderer->createSprite(region(i), positions[i], sizes[i], origins[i], rotations[i],
+                                                         colors[i]));
+            }
+        }
+    }
+
+    // Source and destination can be the same for in place update
+    void simulate(float dt, const std::vector<glm::vec2> &srcPositions, const std::vector<glm::vec2> &srcVelocities,
+                  std::vector<glm::vec2> &dstPositions, std::vector<glm::vec2> &dstVelocities) {
+        if (numMoving == 0) {
+            return;
         }
+        const float *srcPos = &srcPositions[0].x;
+        const float *srcVel = &srcVelocities[0].x;
+        float *dstPos = &dstPositions[0].x;
+        float *dstVel = &dstVelocities[0].x;
+        jobs.parallelFor(numMoving, updateGrain, [=, this](size_t begin, size_t end) {
+            update(dt, begin, end, srcPos, srcVel, dstPos, dstVel);
+        });
     }
 
-    inline void RunFrame(float dt, Bunny &bunny) {
-        bunny.position += bunny.velocity * dt;
-        auto posX = bunny.position.x;
-        if (posX < 0 || posX > opts.windowWidth) {
-            bunny.velocity.x *= -1;
+    // Moves bunnies in [begin, end) and bounces them off the window edges.
+    // Positions and velocities are processed as flat float arrays (x0, y0, x1, y1, ...),
+    // bounce flips velocity sign with a mask instead of branching.
+    void update(float dt, size_t begin, size_t end, const float *srcPos, const float *srcVel, float *pos, float *vel) {
+        static_assert(sizeof(glm::vec2) == 2 * sizeof(float));
+        float width = float(opts.windowWidth);
+        float height = float(opts.windowHeight);
+
+        size_t i = begin * 2;
+        size_t last = end * 2;
+#ifdef DIPLOMA_SSE2
+        const __m128 vdt = _mm_set1_ps(dt);
+        const __m128 bounds = _mm_setr_ps(width, height, width, height);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        // 2 bunnies per iteration
+        for (; i + 4 <= last; i += 4) {
+            __m128 p = _mm_loadu_ps(srcPos + i);
+            __m128 v = _mm_loadu_ps(srcVel + i);
+            p = _mm_add_ps(p, _mm_mul_ps(v, vdt));
+            __m128 outside = _mm_or_ps(_mm_cmplt_ps(p, zero), _mm_cmpgt_ps(p, bounds));
+            v = _mm_xor_ps(v, _mm_and_ps(outside, signBit));
+            _mm_storeu_ps(pos + i, p);
+            _mm_storeu_ps(vel + i, v);
         }
-        auto posY = bunny.position.y;
-        if (posY < 0 || posY > opts.windowHeight) {
-            bunny.velocity.y *= -1;
+#endif
+        for (; i < last; i++) {
+            float bound = (i & 1) ? height : width;
+            pos[i] = srcPos[i] + srcVel[i] * dt;
+            bool outside = (pos[i] < 0.0f) | (pos[i] > bound);
+            vel[i] = srcVel[i] * (1.0f - 2.0f * float(outside));
         }
+    }
 
-        renderer->drawSprite(opts.bunnyRegion, bunny.position, bunny.size,
-                             bunny.size * 0.5f, bunny.rotation, bunny.color);
+    // Each job updates its range and records it into the buffer of the thread running it
+    void simulateAndRecord(float dt) {
+        if (positions.empty()) {
+            return;
+        }
+        float *pos = &positions[0].x;
+        float *vel = &velocities[0].x;
+        jobs.parallelFor(positions.size(), updateGrain, [=, this](size_t begin, size_t end) {
+            updateMoving(dt, begin, end, pos, vel);
+            auto &buffer = recorder->buffer(JobSystem::threadIndex());
+            for (size_t i = begin; i < end; i++) {
+                const UVRegion &bunnyRegion = region(i);
+                uint64_t key = ParallelRecorder::sortKey(layers[i], bunnyRegion.texture, uint32_t(i));
+                buffer.drawSprite(key, bunnyRegion, positions[i], sizes[i], origins[i], rotations[i], colors[i]);
+            }
+        });
+    }
+
+    // Each job updates its range and appends it directly into the renderer's buffer
+    void simulateAndAppend(float dt) {
+        if (positions.empty()) {
+            return;
+        }
+        float *pos = &positions[0].x;
+        float *vel = &velocities[0].x;
+        jobs.parallelFor(positions.size(), updateGrain, [=, this](size_t begin, size_t end) {
+            updateMoving(dt, begin, end, pos, vel);
+            auto producer = renderer->producer();
+            for (size_t i = begin; i < end; i++) {
+                producer.drawSprite(region(i), positions[i], sizes[i], origins[i], rotations[i], colors[i]);
+            }
+        });
+    }
+
+    // In place update of the moving bunnies in [begin, end)
+    void updateMoving(float dt, size_t begin, size_t end, float *pos, float *vel) {
+        end = std::min(end, numMoving);
+        if (begin < end) {
+            update(dt, begin, end, pos, vel, pos, vel);
+        }
+    }
+
+    // Draws the frame in one renderer pass per run of a blend mode, sprites before a blend change must be
+    // drawn before it. Returns the counters of all passes.
+    RendererStats drawPasses(const glm::mat4 &projView) {
+        RendererStats stats{};
+        size_t first = 0;
+        do {
+            BlendMode blendMode = first < runs.size() ? runs[first].blendMode : BlendMode::Alpha;
+            size_t last = first;
+            while (last < runs.size() && runs[last].blendMode == blendMode) {
+                last++;
+            }
+            setBlendMode(blendMode);
+            {
+                AllocTracker::Scope phase{AllocPhase::Submit};
+                renderer->begin(projView);
+                submit(first, last);
+            }
+            {
+                AllocTracker::Scope phase{AllocPhase::Flush};
+                renderer->end();
+            }
+            stats += renderer->frameStats();
+            first = last;
+        } while (first < runs.size());
+        setBlendMode(BlendMode::Alpha);
+        return stats;
+    }
+
+    void setBlendMode(BlendMode blendMode) {
+        if (blendMode == currentBlendMode) {
+            return;
+        }
+        glBlendFunc(GL_SRC_ALPHA, blendMode == BlendMode::Additive ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+        currentBlendMode = blendMode;
+    }
+
+    // Sprite runs [firstRun, lastRun)
+    void submit(size_t firstRun, size_t lastRun) {
+        if constexpr (RetainedSprites<R>) {
+            // Note: Static bunnies keep the transform they were created with
+            for (size_t i = 0; i < numMoving; i++) {
+                renderer->updateSpriteTransform(handles[i], positions[i], rotations[i]);
+            }
+        } else {
+            for (size_t r = firstRun; r < lastRun; r++) {
+                auto &run = runs[r];
+                renderer->drawSprites(opts.textures[run.texture], SpriteSpan{
+                        .positions = positions.data() + run.begin,
+                        .sizes = sizes.data() + run.begin,
+                        .origins = origins.data() + run.begin,
+                        .rotations = rotations.data() + run.begin,
+                        .colors = colors.data() + run.begin,
+                        .count = run.end - run.begin,
+                });
+            }
+        }
     }
 
 };
@@ -1,5 +1,7 @@
 #include "common.h"
 
+#include <algorithm>
+#include <cstring>
 #include <stb_image.h>
 
 void glDebugLog(GLenum source,
@@ -206,3 +208,48 @@ UVRegion getUVRegion(const Texture &texture, int x, int y, int width, int height
             uint16_t(x + width), uint16_t(y + height)};
 
 }
+
+std::vector<std::string> splitList(const char *str) {
+    std::vector<std::string> items{};
+    if (!str) {
+        return items;
+    }
+    std::string list = str;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = std::min(list.find(',', start), list.size());
+        items.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+    return items;
+}
+
+bool readKeyValueFile(const char *path, const std::function<bool(const char *key, const char *value)> &parse) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    bool valid = true;
+    char line[512];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+        char *separator = strchr(line, '=');
+        if (!separator) {
+            fprintf(stderr, "%s:%d: expected key=value\n", path, lineNumber);
+            valid = false;
+            continue;
+        }
+        *separator = '\0';
+        if (!parse(line, separator + 1)) {
+            fprintf(stderr, "%s:%d: invalid value for %s: %s\n", path, lineNumber, line, separator + 1);
+            valid = false;
+        }
+    }
+    fclose(file);
+    return valid;
+}
@@ -5,6 +5,9 @@
 #include <ext.hpp>
 
 #include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
 
 #define GLFW_INCLUDE_NONE
 
@@ -99,6 +102,19 @@ Texture loadTexture(const char *path);
 Texture loadDummyTexture();
 UVRegion getUVRegion(const Texture &texture, int x, int y, int width, int height);
 
+// Splits a comma separated list, empty items are kept so callers can reject them
+std::vector<std::string> splitList(const char *str);
+
+// Reads a file of key=value lines, empty lines and lines starting with # are skipped. Reports lines without a
+// separator or rejected by parse to stderr. Returns false if the file can not be read or a line is invalid.
+bool readKeyValueFile(const char *path, const std::function<bool(const char *key, const char *value)> &parse);
+
+// Byte offset of firstInstance in an instance buffer.
+// Note: No base instance in OpenGL 3.3, instanced batches offset attribute pointers instead
+static inline size_t instanceOffset(size_t firstInstance, size_t stride) {
+    return firstInstance * stride;
+}
+
 static inline glm::mat3 buildTransformationMatrix(const glm::vec2 pos, const glm::vec2 size,
                                         const glm::vec2 origin, const float rotation) {
 
@@ -0,0 +1,114 @@
+#include "frame_arena.h"
+
+#include "job_system.h"
+
+static size_t alignUp(size_t size) {
+    return (size + FrameArena::alignment - 1) & ~(FrameArena::alignment - 1);
+}
+
+FrameArena::FrameArena(size_t bytesPerThread, int numThreads, int numFrames)
+        : bytesPerThread(alignUp(bytesPerThread)), numThreads(numThreads), numFrames(numFrames) {
+    assert(numThreads >= 1 && numFrames >= 1);
+    size_t numSubArenas = size_t(numThreads) * numFrames;
+    // Note: Pages are only touched when used, so unused sub-arenas cost no physical memory
+    memory = static_cast<char *>(::operator new(this->bytesPerThread * numSubArenas, std::align_val_t(alignment)));
+    subArenas = std::make_unique<SubArena[]>(numSubArenas);
+    for (size_t i = 0; i < numSubArenas; i++) {
+        subArenas[i].base = memory + i * this->bytesPerThread;
+    }
+}
+
+FrameArena::~FrameArena() {
+    for (int i = 0; i < numThreads * numFrames; i++) {
+        reset(subArenas[i]);
+    }
+    ::operator delete(memory, std::align_val_t(alignment));
+}
+
+FrameArena::SubArena &FrameArena::subArena(int thread) {
+    if (thread < 0) {
+        thread = JobSystem::threadIndex();
+    }
+    assert(thread < numThreads);
+    return subArenas[frame * numThreads + thread];
+}
+
+void *FrameArena::allocate(size_t size, int thread) {
+    auto &arena = subArena(thread);
+    size = alignUp(std::max(size, size_t(1)));
+    if (arena.offset + size > bytesPerThread) {
+        void *block = ::operator new(size, std::align_val_t(alignment));
+        arena.overflowBlocks.push_back(block);
+        arena.overflows++;
+        arena.overflowBytes += size;
+        return block;
+    }
+    void *ptr = arena.base + arena.offset;
+    arena.lastOffset = arena.offset;
+    arena.offset += size;
+    arena.highWater = std::max(arena.highWater, arena.offset);
+    arena.allocations++;
+    arena.bytes += size;
+    return ptr;
+}
+
+bool FrameArena::tryExtend(void *ptr, size_t oldSize, size_t newSize, int thread) {
+    auto &arena = subArena(thread);
+    if (ptr != arena.base + arena.lastOffset || arena.lastOffset + alignUp(oldSize) != arena.offset) {
+        return false;
+    }
+    size_t end = arena.lastOffset + alignUp(newSize);
+    if (end > bytesPerThread) {
+        return false;
+    }
+    arena.bytes += end - arena.offset;
+    arena.offset = end;
+    arena.highWater = std::max(arena.highWater, arena.offset);
+    return true;
+}
+
+void FrameArena::endFrame() {
+    size_t used = 0;
+    for (int t = 0; t < numThreads; t++) {
+        used += subArenas[frame * numThreads + t].offset;
+    }
+    highWater = std::max(highWater, used);
+
+    // Next slot was last used numFrames - 1 frames ago, its memory is no longer referenced
+    frame = (frame + 1) % numFrames;
+    for (int t = 0; t < numThreads; t++) {
+        reset(subArenas[frame * numThreads + t]);
+    }
+}
+
+void FrameArena::reset(SubArena &arena) {
+    arena.offset = 0;
+    arena.lastOffset = 0;
+    for (void *block: arena.overflowBlocks) {
+        ::operator delete(block, std::align_val_t(alignment));
+    }
+    arena.overflowBlocks.clear();
+}
+
+int FrameArena::threadCount() const {
+    return numThreads;
+}
+
+FrameArena::Stats FrameArena::stats() const {
+    Stats stats{.capacity = bytesPerThread};
+    size_t current = 0;
+    for (int i = 0; i < numThreads * numFrames; i++) {
+        auto &arena = subArenas[i];
+        stats.threadHighWater = std::max(stats.threadHighWater, arena.highWater);
+        stats.allocations += arena.allocations;
+        stats.bytes += arena.bytes;
+        stats.overflows += arena.overflows;
+        stats.overflowBytes += arena.overflowBytes;
+        if (i / numThreads == frame) {
+            current += arena.offset;
+        }
+    }
+    // Current frame is not finished yet
+    stats.highWater = std::max(highWater, current);
+    return stats;
+}
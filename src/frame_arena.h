@@ -0,0 +1,202 @@
+#ifndef DIPLOMA_FRAME_ARENA_H
+#define DIPLOMA_FRAME_ARENA_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for transient per-frame data. Memory is split into a ring of frames, each frame into
+// one sub-arena per thread, so threads allocate without locking. Allocations are 64 B aligned and are
+// released all at once when their frame slot is reused, numFrames frames after they were made.
+// When a sub-arena is full, allocations fall back to the heap until its frame slot is reused.
+class FrameArena {
+public:
+    constexpr static size_t alignment = 64;
+
+    struct Stats {
+        size_t capacity{};        // bytes per sub-arena
+        size_t highWater{};       // most bytes used by all threads in one frame
+        size_t threadHighWater{}; // most bytes used by a single sub-arena
+        uint64_t allocations{};   // served from the arena
+        uint64_t bytes{};
+        uint64_t overflows{};     // sub-arena was full, served from the heap
+        uint64_t overflowBytes{};
+    };
+
+    explicit FrameArena(size_t bytesPerThread, int numThreads = 1, int numFrames = 2);
+    FrameArena(const FrameArena &other) = delete;
+    ~FrameArena();
+
+    // Thread -1 uses the sub-arena of JobSystem::threadIndex().
+    // Each sub-arena must only be used by one thread at a time.
+    void *allocate(size_t size, int thread = -1);
+    // Grows the last allocation of the sub-arena in place, returns false if ptr is not the last one or there is no space
+    bool tryExtend(void *ptr, size_t oldSize, size_t newSize, int thread = -1);
+
+    template<typename T>
+    T *allocateArray(size_t count, int thread = -1) {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= alignment);
+        return static_cast<T *>(allocate(count * sizeof(T), thread));
+    }
+
+    // Moves to the next frame slot, memory allocated numFrames frames ago is released.
+    // No allocations may be in progress.
+    void endFrame();
+
+    [[nodiscard]]
+    int threadCount() const;
+    [[nodiscard]]
+    Stats stats() const;
+
+private:
+    struct alignas(64) SubArena {
+        char *base{};
+        size_t offset{};
+        size_t lastOffset{}; // start of the last allocation, for tryExtend
+        uint64_t allocations{};
+        uint64_t bytes{};
+        uint64_t overflows{};
+        uint64_t overflowBytes{};
+        size_t highWater{};
+        std::vector<void *> overflowBlocks{};
+    };
+
+    SubArena &subArena(int thread);
+    static void reset(SubArena &arena);
+
+    size_t bytesPerThread{};
+    int numThreads{};
+    int numFrames{};
+    int frame{};
+    char *memory{};
+    std::unique_ptr<SubArena[]> subArenas{}; // [frame][thread]
+    size_t highWater{};
+};
+
+// Growable array of trivially copyable items for per-frame data. Storage comes from a frame arena when one
+// is set, otherwise from the heap. Arena storage is only valid for the frame, so clear() must be called
+// every frame before the array is used again. The first growth after clear() allocates room for as many items
+// as the array last held, so a steady load takes one arena allocation per frame instead of regrowing from 16.
+template<typename T>
+class ArenaArray {
+    static_assert(std::is_trivially_copyable_v<T>);
+public:
+    ArenaArray() = default;
+    ArenaArray(ArenaArray &&other) noexcept
+            : arena(other.arena), thread(other.thread), items(other.items), count(other.count), capacity(other.capacity),
+              lastCount(other.lastCount) {
+        other.items = nullptr;
+        other.count = 0;
+        other.capacity = 0;
+    }
+    ArenaArray(const ArenaArray &other) = delete;
+    ~ArenaArray() {
+        releaseHeap();
+    }
+
+    // Thread selects the sub-arena, -1 for the thread that grows the array
+    void setArena(FrameArena *arena, int thread = -1) {
+        clear();
+        releaseHeap();
+        this->arena = arena;
+        this->thread = thread;
+    }
+
+    void clear() {
+        // Note: Clearing an unused array keeps the size hint, some arrays are cleared more than once per frame
+        if (count > 0) {
+            lastCount = count;
+        }
+        count = 0;
+        if (arena) {
+            // Note: Arena memory of the previous frame may already be reused
+            items = nullptr;
+            capacity = 0;
+        }
+    }
+
+    void push_back(const T &item) {
+        if (count == capacity) {
+            grow(count + 1);
+        }
+        items[count++] = item;
+    }
+
+    void swap(ArenaArray &other) noexcept {
+        std::swap(arena, other.arena);
+        std::swap(thread, other.thread);
+        std::swap(items, other.items);
+        std::swap(count, other.count);
+        std::swap(capacity, other.capacity);
+        std::swap(lastCount, other.lastCount);
+    }
+
+    // New items are left uninitialized
+    void resize(size_t size) {
+        if (size > capacity) {
+            grow(size);
+        }
+        count = size;
+    }
+
+    [[nodiscard]] size_t size() const { return count; }
+    [[nodiscard]] bool empty() const { return count == 0; }
+    T *data() { return items; }
+    const T *data() const { return items; }
+    T &operator[](size_t i) { return items[i]; }
+    const T &operator[](size_t i) const { return items[i]; }
+    T &front() { return items[0]; }
+    T &back() { return items[count - 1]; }
+    T *begin() { return items; }
+    T *end() { return items + count; }
+    const T *begin() const { return items; }
+    const T *end() const { return items + count; }
+
+private:
+    void grow(size_t minCapacity) {
+        size_t newCapacity = std::max(minCapacity, std::max(capacity * 2, std::max(lastCount, size_t(16))));
+        if (arena) {
+            if (items && arena->tryExtend(items, capacity * sizeof(T), newCapacity * sizeof(T), thread)) {
+                capacity = newCapacity;
+                return;
+            }
+            T *newItems = arena->allocateArray<T>(newCapacity, thread);
+            if (count > 0) {
+                memcpy(newItems, items, count * sizeof(T));
+            }
+            items = newItems;
+            capacity = newCapacity;
+            return;
+        }
+        T *newItems = static_cast<T *>(::operator new(newCapacity * sizeof(T), std::align_val_t(alignof(T))));
+        if (count > 0) {
+            memcpy(newItems, items, count * sizeof(T));
+        }
+        releaseHeap();
+        items = newItems;
+        capacity = newCapacity;
+    }
+
+    void releaseHeap() {
+        if (!arena && items) {
+            ::operator delete(items, std::align_val_t(alignof(T)));
+            items = nullptr;
+            capacity = 0;
+        }
+    }
+
+    FrameArena *arena{};
+    int thread{-1};
+    T *items{};
+    size_t count{};
+    size_t capacity{};
+    size_t lastCount{}; // items held when last cleared
+};
+
+#endif //DIPLOMA_FRAME_ARENA_H
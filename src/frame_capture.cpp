@@ -0,0 +1,76 @@
+#include "frame_capture.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+FrameImage captureFrame(int frame, int width, int height) {
+    FrameImage image{
+            .frame = frame,
+            .width = width,
+            .height = height,
+    };
+    image.pixels.resize(size_t(width) * size_t(height) * 4);
+    // Note: Rows are tightly packed, the default alignment of 4 already holds for RGBA8
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+    return image;
+}
+
+static int pixelDifference(const uint8_t *expected, const uint8_t *actual) {
+    int difference = 0;
+    for (size_t c = 0; c < 4; c++) {
+        difference = std::max(difference, std::abs(int(expected[c]) - int(actual[c])));
+    }
+    return difference;
+}
+
+ImageDiff compareImages(const FrameImage &expected, const FrameImage &actual, int tolerance, int shift) {
+    ImageDiff diff{
+            .total = size_t(expected.width) * size_t(expected.height),
+    };
+    if (expected.width != actual.width || expected.height != actual.height ||
+        expected.pixels.size() != actual.pixels.size()) {
+        diff.mismatched = diff.total;
+        diff.sizeMismatch = true;
+        return diff;
+    }
+    auto at = [&](const FrameImage &image, int x, int y) {
+        return image.pixels.data() + (size_t(y) * size_t(image.width) + size_t(x)) * 4;
+    };
+    for (int y = 0; y < expected.height; y++) {
+        for (int x = 0; x < expected.width; x++) {
+            const uint8_t *pixel = at(actual, x, y);
+            int difference = pixelDifference(at(expected, x, y), pixel);
+            if (difference > tolerance && shift > 0) {
+                for (int ny = std::max(y - shift, 0); ny <= std::min(y + shift, expected.height - 1); ny++) {
+                    for (int nx = std::max(x - shift, 0); nx <= std::min(x + shift, expected.width - 1); nx++) {
+                        difference = std::min(difference, pixelDifference(at(expected, nx, ny), pixel));
+                    }
+                }
+                diff.shifted += difference <= tolerance;
+            }
+            diff.maxDifference = std::max(diff.maxDifference, difference);
+            diff.mismatched += difference > tolerance;
+        }
+    }
+    return diff;
+}
+
+bool writeImagePng(const char *path, const FrameImage &image) {
+    stbi_flip_vertically_on_write(1);
+    return stbi_write_png(path, image.width, image.height, 4, image.pixels.data(), image.width * 4) != 0;
+}
+
+bool readImagePng(const char *path, FrameImage &image) {
+    stbi_set_flip_vertically_on_load(true);
+    int channels = 0;
+    stbi_uc *data = stbi_load(path, &image.width, &image.height, &channels, 4);
+    if (!data) {
+        return false;
+    }
+    image.pixels.assign(data, data + size_t(image.width) * size_t(image.height) * 4);
+    stbi_image_free(data);
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef DIPLOMA_FRAME_CAPTURE_H
+#define DIPLOMA_FRAME_CAPTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "common.h"
+
+// RGBA8 color buffer of one frame, rows bottom to top as glReadPixels returns them
+struct FrameImage {
+    int frame{};
+    int width{};
+    int height{};
+    std::vector<uint8_t> pixels{};
+};
+
+// Reads the color buffer of the bound framebuffer, must be called after drawing and before swapping.
+// Waits for the GPU to finish the frame, so captured frames are slower.
+FrameImage captureFrame(int frame, int width, int height);
+
+struct ImageDiff {
+    size_t mismatched{};   // pixels with a channel differing by more than the tolerance
+    size_t shifted{};      // pixels only matching a neighbour of the expected pixel, within the allowed shift
+    size_t total{};
+    int maxDifference{};   // largest channel difference, to the closest allowed expected pixel
+    bool sizeMismatch{};   // images can not be compared, every pixel counts as mismatched
+};
+
+// Tolerance is per channel, rasterization of the same sprites may differ in the last bit between paths.
+// With shift > 0 an actual pixel also matches expected pixels up to shift pixels away, for paths that
+// may move sprite or texel edges by a pixel but must not change what is drawn.
+ImageDiff compareImages(const FrameImage &expected, const FrameImage &actual, int tolerance, int shift = 0);
+
+// PNG files are stored top to bottom, rows are flipped on the way in and out.
+// Return false if the file can not be written or read.
+bool writeImagePng(const char *path, const FrameImage &image);
+bool readImagePng(const char *path, FrameImage &image);
+
+#endif //DIPLOMA_FRAME_CAPTURE_H
@@ -0,0 +1,92 @@
+#include "gpu_timer_ring.h"
+
+#include <algorithm>
+#include <cassert>
+
+GpuTimerRing::GpuTimerRing(int depth, size_t expectedFrames) {
+    assert(depth >= 1);
+    slots.resize(std::max(depth, 1));
+    for (auto &slot: slots) {
+        glGenQueries(1, &slot.query);
+    }
+    frameResults.reserve(expectedFrames);
+}
+
+GpuTimerRing::~GpuTimerRing() {
+    for (auto &slot: slots) {
+        glDeleteQueries(1, &slot.query);
+    }
+}
+
+void GpuTimerRing::begin(size_t frame) {
+    assert(!active);
+    assert(inFlight == 0 || frame > lastFrame);
+    if (inFlight == slots.size()) {
+        numStalls++;
+        read(slots[oldest]);
+    }
+    Slot &slot = slots[(oldest + inFlight) % slots.size()];
+    slot.frame = frame;
+    lastFrame = frame;
+    active = true;
+    glBeginQuery(GL_TIME_ELAPSED, slot.query);
+}
+
+void GpuTimerRing::end() {
+    assert(active);
+    glEndQuery(GL_TIME_ELAPSED);
+    active = false;
+    inFlight++;
+}
+
+void GpuTimerRing::poll() {
+    // Note: Queries finish in submission order, so the first unfinished one ends the poll
+    while (inFlight > 0) {
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(slots[oldest].query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        read(slots[oldest]);
+    }
+}
+
+void GpuTimerRing::finish() {
+    assert(!active);
+    while (inFlight > 0) {
+        read(slots[oldest]);
+    }
+}
+
+void GpuTimerRing::read(Slot &slot) {
+    GLuint64 elapsed = 0;
+    // Blocks if the result is not available yet
+    glGetQueryObjectui64v(slot.query, GL_QUERY_RESULT, &elapsed);
+    if (frameResults.size() <= slot.frame) {
+        frameResults.resize(slot.frame + 1);
+    }
+    frameResults[slot.frame] = elapsed;
+    latency = std::max(latency, lastFrame - slot.frame);
+    oldest = (oldest + 1) % slots.size();
+    inFlight--;
+}
+
+int GpuTimerRing::depth() const {
+    return int(slots.size());
+}
+
+bool GpuTimerRing::pending() const {
+    return inFlight > 0;
+}
+
+const std::vector<uint64_t> &GpuTimerRing::results() const {
+    return frameResults;
+}
+
+size_t GpuTimerRing::stalls() const {
+    return numStalls;
+}
+
+size_t GpuTimerRing::maxLatency() const {
+    return latency;
+}
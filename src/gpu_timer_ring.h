@@ -0,0 +1,61 @@
+#ifndef DIPLOMA_GPU_TIMER_RING_H
+#define DIPLOMA_GPU_TIMER_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "common.h"
+
+// Ring of GL_TIME_ELAPSED queries, one per frame. Results are read back a few frames later, so the
+// driver can keep frames in flight instead of draining the pipeline after every frame to read the timer.
+// Only waits for a result when all depth queries are still in flight.
+class GpuTimerRing {
+public:
+    // Context must be current, expectedFrames only reserves space for the results
+    explicit GpuTimerRing(int depth, size_t expectedFrames = 0);
+    GpuTimerRing(const GpuTimerRing &other) = delete;
+    ~GpuTimerRing();
+
+    // Frames must be timed in increasing order, begin() ... end() can not be nested
+    void begin(size_t frame);
+    void end();
+    // Reads finished queries without blocking
+    void poll();
+    // Blocks until every query has been read
+    void finish();
+
+    [[nodiscard]]
+    int depth() const;
+    // Queries not read yet
+    [[nodiscard]]
+    bool pending() const;
+    // GPU time in ns by frame index, frames not read yet (or not timed) are 0
+    [[nodiscard]]
+    const std::vector<uint64_t> &results() const;
+    // Times begin() had to wait for the oldest query
+    [[nodiscard]]
+    size_t stalls() const;
+    // Most frames begun between a frame and reading its result
+    [[nodiscard]]
+    size_t maxLatency() const;
+
+private:
+    struct Slot {
+        GLuint query;
+        size_t frame;
+    };
+
+    void read(Slot &slot);
+
+    std::vector<Slot> slots{};
+    size_t oldest = 0;   // slot of the oldest query in flight
+    size_t inFlight = 0;
+    size_t lastFrame = 0;
+    bool active = false;
+
+    std::vector<uint64_t> frameResults{};
+    size_t numStalls = 0;
+    size_t latency = 0;
+};
+
+#endif //DIPLOMA_GPU_TIMER_RING_H
@@ -0,0 +1,234 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include "async_worker.h"
+
+static thread_local const JobSystem *currentSystem = nullptr;
+static thread_local int currentThreadIndex = 0;
+
+bool JobCounter::done() const {
+    return pending.load(std::memory_order_acquire) == 0;
+}
+
+JobSystem::JobSystem(int numThreads, bool pinWorkers) {
+    assert(numThreads >= 1);
+    queues = std::make_unique<WorkQueue[]>(numThreads);
+    // Note: Calling thread is thread 0
+    for (int i = 1; i < numThreads; i++) {
+        workers.emplace_back(&JobSystem::workerLoop, this, i, pinWorkers);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+int JobSystem::threadCount() const {
+    return int(workers.size()) + 1;
+}
+
+int JobSystem::threadIndex() {
+    return currentThreadIndex;
+}
+
+int JobSystem::queueIndex() const {
+    // Threads of other job systems push into the calling thread's queue
+    return currentSystem == this ? currentThreadIndex : 0;
+}
+
+void JobSystem::schedule(const Job &job, JobCounter *after) {
+    job.counter->pending.fetch_add(1, std::memory_order_relaxed);
+    if (after) {
+        std::lock_guard lock(after->mutex);
+        if (after->pending.load(std::memory_order_acquire) > 0) {
+            after->continuations.push_back(job);
+            return;
+        }
+    }
+    push(&job, 1);
+}
+
+void JobSystem::scheduleRanges(void (*func)(const void *, size_t, size_t), const void *data,
+                               size_t count, size_t grain, JobCounter &counter, JobCounter *after) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max(grain, size_t(1));
+    size_t numRanges = (count + grain - 1) / grain;
+    counter.pending.fetch_add(int(numRanges), std::memory_order_relaxed);
+
+    auto makeJob = [&](size_t range) {
+        size_t begin = range * grain;
+        return Job{
+                .func = func,
+                .data = data,
+                .begin = begin,
+                .end = std::min(begin + grain, count),
+                .counter = &counter,
+        };
+    };
+    if (after) {
+        std::lock_guard lock(after->mutex);
+        if (after->pending.load(std::memory_order_acquire) > 0) {
+            for (size_t r = 0; r < numRanges; r++) {
+                after->continuations.push_back(makeJob(r));
+            }
+            return;
+        }
+    }
+
+    // Note: Counted before the jobs are visible, so the count never drops below zero
+    queuedJobs.fetch_add(numRanges, std::memory_order_release);
+    auto &queue = queues[queueIndex()];
+    {
+        std::lock_guard lock(queue.mutex);
+        for (size_t r = 0; r < numRanges; r++) {
+            queue.pushBack(makeJob(r));
+        }
+    }
+    {
+        // Note: Lock pairs with the sleep check, so a worker can not miss the wake up
+        std::lock_guard lock(sleepMutex);
+    }
+    wakeUp.notify_all();
+}
+
+void JobSystem::push(const Job *jobs, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    queuedJobs.fetch_add(count, std::memory_order_release);
+    auto &queue = queues[queueIndex()];
+    {
+        std::lock_guard lock(queue.mutex);
+        for (size_t i = 0; i < count; i++) {
+            queue.pushBack(jobs[i]);
+        }
+    }
+    {
+        std::lock_guard lock(sleepMutex);
+    }
+    if (count == 1) {
+        wakeUp.notify_one();
+    } else {
+        wakeUp.notify_all();
+    }
+}
+
+bool JobSystem::findJob(Job &job) {
+    if (queuedJobs.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    int self = queueIndex();
+    int numQueues = threadCount();
+    // Own queue first (newest job, likely still in cache), then steal the oldest job of the others
+    for (int i = 0; i < numQueues; i++) {
+        auto &queue = queues[(self + i) % numQueues];
+        std::lock_guard lock(queue.mutex);
+        if (queue.count == 0) {
+            continue;
+        }
+        job = i == 0 ? queue.popBack() : queue.popFront();
+        queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::execute(const Job &job) {
+    job.func(job.data, job.begin, job.end);
+
+    JobCounter &counter = *job.counter;
+    std::vector<Job> ready{};
+    {
+        // Note: Last decrement is done under the lock, so wait() can not return (and the counter
+        // can not be destroyed) before the continuations are taken out.
+        std::lock_guard lock(counter.mutex);
+        if (counter.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::swap(ready, counter.continuations);
+            counter.pending.notify_all();
+        }
+    }
+    push(ready.data(), ready.size());
+}
+
+void JobSystem::wait(JobCounter &counter) {
+    while (true) {
+        int pending = counter.pending.load(std::memory_order_acquire);
+        if (pending == 0) {
+            break;
+        }
+        Job job;
+        if (findJob(job)) {
+            execute(job);
+            continue;
+        }
+        // Nothing to help with, remaining jobs are running on other threads
+        counter.pending.wait(pending, std::memory_order_acquire);
+    }
+    // Wait for the thread that finished the last job to release the counter
+    std::lock_guard lock(counter.mutex);
+}
+
+void JobSystem::WorkQueue::pushBack(const Job &job) {
+    if (count == jobs.size()) {
+        // Unwrap into a larger ring
+        std::vector<Job> grown(std::max(jobs.size() * 2, size_t(64)));
+        for (size_t i = 0; i < count; i++) {
+            grown[i] = jobs[(head + i) % jobs.size()];
+        }
+        jobs = std::move(grown);
+        head = 0;
+    }
+    jobs[(head + count) % jobs.size()] = job;
+    count++;
+}
+
+Job JobSystem::WorkQueue::popBack() {
+    assert(count > 0);
+    count--;
+    return jobs[(head + count) % jobs.size()];
+}
+
+Job JobSystem::WorkQueue::popFront() {
+    assert(count > 0);
+    Job job = jobs[head];
+    head = (head + 1) % jobs.size();
+    count--;
+    return job;
+}
+
+void JobSystem::workerLoop(int worker, bool pin) {
+    currentSystem = this;
+    currentThreadIndex = worker;
+    if (pin) {
+        int cpu = worker % int(std::max(std::thread::hardware_concurrency(), 1u));
+        if (!pinCurrentThread(cpu)) {
+            fprintf(stderr, "Could not pin job worker %d to cpu %d\n", worker, cpu);
+        }
+    }
+
+    while (true) {
+        Job job;
+        if (findJob(job)) {
+            execute(job);
+            continue;
+        }
+        std::unique_lock lock(sleepMutex);
+        wakeUp.wait(lock, [this] {
+            return stopping || queuedJobs.load(std::memory_order_acquire) > 0;
+        });
+        if (stopping) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef DIPLOMA_JOB_SYSTEM_H
+#define DIPLOMA_JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+// Unit of work, func is called with data and the range [begin, end)
+struct Job {
+    void (*func)(const void *data, size_t begin, size_t end);
+    const void *data;
+    size_t begin;
+    size_t end;
+    JobCounter *counter; // decremented when the job is done
+};
+
+// Counts unfinished jobs, jobs scheduled after a counter only start once it reaches zero.
+// Jobs of a counter must be scheduled before jobs that run after it, otherwise they start right away.
+// Must outlive all jobs that use it and must not be reused before it reaches zero.
+class JobCounter {
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter &other) = delete;
+
+    [[nodiscard]]
+    bool done() const;
+
+private:
+    friend class JobSystem;
+    std::atomic<int> pending{};
+    std::mutex mutex{};
+    std::vector<Job> continuations{}; // guarded by mutex, scheduled when pending reaches zero
+};
+
+// Work stealing job system. Every thread has its own deque, it pushes and pops its jobs at the back,
+// idle threads steal from the front of other deques. Threads waiting on a counter run jobs meanwhile,
+// so the calling thread is thread 0 and a system with 1 thread spawns no workers.
+class JobSystem {
+public:
+    // Workers are pinned to cpu 1, 2, ... when pinWorkers is set, calling thread is left alone
+    explicit JobSystem(int numThreads = 1, bool pinWorkers = false);
+    JobSystem(const JobSystem &other) = delete;
+    ~JobSystem();
+
+    [[nodiscard]]
+    int threadCount() const;
+
+    // Index of the calling thread in its job system, in [0, threadCount). 0 for threads outside of job systems.
+    static int threadIndex();
+
+    // Runs func() on any thread, after 'after' reaches zero if given.
+    // func must stay alive until counter reaches zero.
+    template<typename F>
+    void run(const F &func, JobCounter &counter, JobCounter *after = nullptr) {
+        schedule(Job{
+                .func = [](const void *data, size_t, size_t) { (*static_cast<const F *>(data))(); },
+                .data = &func,
+                .counter = &counter,
+        }, after);
+    }
+
+    // Splits [0, count) into ranges of grain items and calls func(begin, end) for each one,
+    // after 'after' reaches zero if given. func must stay alive until counter reaches zero.
+    template<typename F>
+    void parallelFor(size_t count, size_t grain, const F &func, JobCounter &counter, JobCounter *after = nullptr) {
+        scheduleRanges([](const void *data, size_t begin, size_t end) {
+            (*static_cast<const F *>(data))(begin, end);
+        }, &func, count, grain, counter, after);
+    }
+
+    // Blocking version, small loops are run directly on the calling thread
+    template<typename F>
+    void parallelFor(size_t count, size_t grain, const F &func) {
+        if (count == 0) {
+            return;
+        }
+        if (workers.empty() || count <= grain) {
+            func(size_t(0), count);
+            return;
+        }
+        JobCounter counter;
+        parallelFor(count, grain, func, counter);
+        wait(counter);
+    }
+
+    // Blocks until counter reaches zero, runs other jobs meanwhile
+    void wait(JobCounter &counter);
+
+private:
+    // Ring buffer of jobs, grows but never shrinks, so pushing does not allocate once it is large enough
+    struct alignas(64) WorkQueue {
+        std::mutex mutex{};
+        std::vector<Job> jobs{};
+        size_t head{};
+        size_t count{};
+
+        void pushBack(const Job &job);
+        Job popBack();
+        Job popFront();
+    };
+
+    void schedule(const Job &job, JobCounter *after);
+    void scheduleRanges(void (*func)(const void *, size_t, size_t), const void *data,
+                        size_t count, size_t grain, JobCounter &counter, JobCounter *after);
+    void push(const Job *jobs, size_t count);
+    bool findJob(Job &job);
+    void execute(const Job &job);
+    int queueIndex() const;
+    void workerLoop(int worker, bool pin);
+
+    std::vector<std::thread> workers{};
+    std::unique_ptr<WorkQueue[]> queues{};
+
+    // Idle workers sleep until jobs are pushed
+    std::atomic<size_t> queuedJobs{};
+    std::mutex sleepMutex{};
+    std::condition_variable wakeUp{};
+    bool stopping{}; // guarded by sleepMutex
+};
+
+#endif //DIPLOMA_JOB_SYSTEM_H
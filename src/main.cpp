@@ -7,16 +7,12 @@
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
+#include <cstring>
 #include <memory>
 
 #include "common.h"
 #include "base_renderer.h"
-#include "renderers/batch_renderer.h"
-#include "renderers/naive_renderer.h"
-#include "renderers/instance_renderer_cpu.h"
-#include "renderers/instance_renderer.h"
-#include "renderers/geometry_renderer.h"
-#include "renderers/geometry_batch_renderer.h"
+#include "renderer_config.h"
 
 int main(int argc, const char **argv) {
     glfwInit();
@@ -43,8 +39,30 @@ int main(int argc, const char **argv) {
     Texture texture = loadTexture("res/rabbit.png");
     UVRegion region = getUVRegion(texture, 0, 0, texture.width, texture.height);
 
+    // Renderer picked for this machine by Benchmark --auto_tune, if there is one
+    const char *configPath = "renderer.cfg";
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--config") == 0) {
+            configPath = argv[i + 1];
+        }
+    }
+
     {
-        std::unique_ptr<IRenderer> batch = std::make_unique<GeometryBatchRenderer>();
+        std::unique_ptr<IRenderer> batch{};
+        RendererConfig config{};
+        if (loadRendererConfig(configPath, config)) {
+            if (!config.driver.empty() && config.driver != currentDriverName()) {
+                fprintf(stderr, "Renderer config %s was tuned on %s, run Benchmark --auto_tune again\n", configPath,
+                        config.driver.c_str());
+            }
+            batch = createRenderer(config);
+            if (batch) {
+                printf("Renderer from %s: %s\n", configPath, describeRendererConfig(config).c_str());
+            }
+        }
+        if (!batch) {
+            batch = std::make_unique<GeometryBatchRenderer>();
+        }
 
         while (!glfwWindowShouldClose(window)) {
             glfwPollEvents();
@@ -74,6 +92,7 @@ int main(int argc, const char **argv) {
             batch->begin(combined);
             batch->drawSprite(region, pos, size, origin, rotation, color);
             batch->end();
+            batch->endFrame();
 
 
 
@@ -103,6 +122,21 @@ int main(int argc, const char **argv) {
             region.u1 = u1;
             region.v1 = v1;
 
+            if (ImGui::CollapsingHeader("Renderer Stats", ImGuiTreeNodeFlags_DefaultOpen)) {
+                const RendererStats &stats = batch->frameStats();
+                ImGui::Text("Draw calls: %llu", (unsigned long long) stats.drawCalls);
+                ImGui::Text("Sprites: %llu", (unsigned long long) stats.sprites);
+                ImGui::Text("Vertices: %llu", (unsigned long long) stats.vertices);
+                ImGui::Text("Instances: %llu", (unsigned long long) stats.instances);
+                ImGui::Text("Bytes uploaded: %llu", (unsigned long long) stats.bytesUploaded);
+                ImGui::Text("Texture binds: %llu", (unsigned long long) stats.textureBinds);
+                ImGui::Text("State changes: %llu", (unsigned long long) stats.stateChanges);
+                for (int r = 0; r < RendererStats::numFlushReasons; r++) {
+                    ImGui::Text("Flushes (%s): %llu", RendererStats::flushReasonName(FlushReason(r)),
+                                (unsigned long long) stats.flushes[r]);
+                }
+            }
+
             ImGui::End();
             ImGui::Render();
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -0,0 +1,136 @@
+#include "parallel_recorder.h"
+
+#include <algorithm>
+
+ParallelRecorder::ParallelRecorder(IRenderer *backend, int numBuffers, JobSystem *jobs, FrameArena *arena)
+        : backend(backend), jobs(jobs) {
+    assert(numBuffers >= 1);
+    assert(!arena || arena->threadCount() >= numBuffers);
+    buffers.resize(numBuffers);
+    if (arena) {
+        for (int i = 0; i < numBuffers; i++) {
+            buffers[i].records.setArena(arena, i);
+        }
+        // Merge and sort run on the thread calling end()
+        entries.setArena(arena);
+        scratch.setArena(arena);
+        blockOffsets.setArena(arena);
+    }
+}
+
+void ParallelRecorder::begin(const glm::mat4 &projView) {
+    assert(!inUse);
+    inUse = true;
+    this->projView = projView;
+    for (auto &buffer: buffers) {
+        buffer.records.clear();
+    }
+    entries.clear();
+    scratch.clear();
+    blockOffsets.clear();
+}
+
+ParallelRecorder::Buffer &ParallelRecorder::buffer(int index) {
+    assert(inUse);
+    return buffers[index];
+}
+
+void ParallelRecorder::end() {
+    assert(inUse);
+    // Merge, buffers are concatenated in index order so ties are resolved the same every frame
+    size_t count = 0;
+    for (auto &buffer: buffers) {
+        count += buffer.records.size();
+    }
+    entries.resize(count);
+    size_t next = 0;
+    for (uint32_t b = 0; b < buffers.size(); b++) {
+        auto &records = buffers[b].records;
+        for (uint32_t i = 0; i < records.size(); i++) {
+            entries[next++] = {records[i].key, b, i};
+        }
+    }
+    sortEntries();
+
+    backend->begin(projView);
+    for (auto &entry: entries) {
+        auto &cmd = buffers[entry.buffer].records[entry.index].command;
+        backend->drawSprite(cmd.region, cmd.pos, cmd.size, cmd.origin, cmd.rotation, cmd.color);
+    }
+    backend->end();
+    inUse = false;
+}
+
+void ParallelRecorder::sortEntries() {
+    // LSD radix sort, 8 bits per pass. Stable, so equal keys keep merge order.
+    // Entries are split into contiguous blocks, each block is counted and scattered by its own job.
+    // Block b writes each digit after the same digit of blocks before it, so the result does not depend on the split.
+    constexpr int bits = 8;
+    constexpr size_t buckets = 1 << bits;
+    size_t count = entries.size();
+    scratch.resize(count);
+
+    size_t numBlocks = 1;
+    if (jobs) {
+        numBlocks = std::clamp((count + sortGrain - 1) / sortGrain, size_t(1), size_t(jobs->threadCount()));
+    }
+    size_t blockSize = (count + numBlocks - 1) / numBlocks;
+    blockOffsets.resize(numBlocks * buckets);
+    auto forBlocks = [&](auto &&func) {
+        auto run = [&](size_t begin, size_t end) {
+            for (size_t block = begin; block < end; block++) {
+                func(block, block * blockSize, std::min((block + 1) * blockSize, count));
+            }
+        };
+        if (numBlocks > 1) {
+            jobs->parallelFor(numBlocks, 1, run);
+        } else {
+            run(0, numBlocks);
+        }
+    };
+
+    for (int shift = 0; shift < 64; shift += bits) {
+        forBlocks([&](size_t block, size_t begin, size_t end) {
+            size_t *offsets = &blockOffsets[block * buckets];
+            std::fill(offsets, offsets + buckets, 0);
+            for (size_t i = begin; i < end; i++) {
+                offsets[(entries[i].key >> shift) & (buckets - 1)]++;
+            }
+        });
+
+        // Skip digits that are the same for every key, typically layer and high order bits
+        bool allSame = false;
+        for (size_t digit = 0; digit < buckets && !allSame; digit++) {
+            size_t total = 0;
+            for (size_t block = 0; block < numBlocks; block++) {
+                total += blockOffsets[block * buckets + digit];
+            }
+            allSame = total == count;
+        }
+        if (allSame) {
+            continue;
+        }
+
+        size_t sum = 0;
+        for (size_t digit = 0; digit < buckets; digit++) {
+            for (size_t block = 0; block < numBlocks; block++) {
+                size_t &offset = blockOffsets[block * buckets + digit];
+                size_t blockCount = offset;
+                offset = sum;
+                sum += blockCount;
+            }
+        }
+        forBlocks([&](size_t block, size_t begin, size_t end) {
+            size_t *offsets = &blockOffsets[block * buckets];
+            for (size_t i = begin; i < end; i++) {
+                scratch[offsets[(entries[i].key >> shift) & (buckets - 1)]++] = entries[i];
+            }
+        });
+        entries.swap(scratch);
+    }
+}
+
+uint64_t ParallelRecorder::sortKey(uint8_t layer, GLuint texture, uint32_t order) {
+    assert(texture < (1u << 24));
+    return (uint64_t(layer) << 56) | (uint64_t(texture & 0xFFFFFF) << 32) | order;
+}
@@ -0,0 +1,67 @@
+#ifndef DIPLOMA_PARALLEL_RECORDER_H
+#define DIPLOMA_PARALLEL_RECORDER_H
+
+#include <vector>
+#include "base_renderer.h"
+#include "frame_arena.h"
+#include "job_system.h"
+#include "render_thread.h"
+
+// Sprites are recorded from several threads at once, each thread into its own buffer.
+// At end() buffers are merged and sorted by key, then drawn with the backend renderer.
+// Order only depends on keys (ties keep buffer order), so it is the same however the work was split.
+// Recorded sprites and sort arrays are transient, with a frame arena buffer i allocates from sub-arena i.
+class ParallelRecorder {
+public:
+    class Buffer {
+    public:
+        void drawSprite(uint64_t key, const UVRegion &region, glm::vec2 pos, glm::vec2 size, glm::vec2 origin, float rotation, Color color) {
+            records.push_back({key, {region, pos, size, origin, rotation, color}});
+        }
+
+    private:
+        friend class ParallelRecorder;
+        struct Record {
+            uint64_t key;
+            SpriteCommand command;
+        };
+        // Note: Keys are kept with commands, so the buffer is a single growing arena allocation
+        ArenaArray<Record> records{};
+    };
+
+    // Sort is split over the job system if one is given, without a frame arena transient data is on the heap.
+    // Arena needs a sub-arena per buffer and its frame must not end between begin() and end().
+    ParallelRecorder(IRenderer *backend, int numBuffers, JobSystem *jobs = nullptr, FrameArena *arena = nullptr);
+
+    void begin(const glm::mat4 &projView);
+    // Buffer must only be used by one thread at a time
+    Buffer &buffer(int index);
+    void end();
+
+    // layer [63:56], texture [55:32], order [31:0]
+    // Sprites are sorted by layer first, then grouped by texture to reduce flushes.
+    static uint64_t sortKey(uint8_t layer, GLuint texture, uint32_t order);
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint32_t buffer;
+        uint32_t index;
+    };
+
+    // Entries per sort block, smaller blocks are not worth scheduling
+    constexpr static size_t sortGrain = 16384;
+
+    void sortEntries();
+
+    IRenderer *backend;
+    JobSystem *jobs;
+    glm::mat4 projView{};
+    std::vector<Buffer> buffers{};
+    ArenaArray<Entry> entries{};
+    ArenaArray<Entry> scratch{};
+    ArenaArray<size_t> blockOffsets{}; // per block digit histogram, then scatter offsets
+    bool inUse{};
+};
+
+#endif //DIPLOMA_PARALLEL_RECORDER_H
@@ -0,0 +1,149 @@
+#include "phase_timer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+static PhaseTimer *activeTimer = nullptr;
+
+static uint64_t cpuNow() {
+    using Clock = std::chrono::high_resolution_clock;
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
+
+PhaseTimer::PhaseTimer(int depth, int maxSpans, size_t expectedFrames) : maxSpans(size_t(std::max(maxSpans, 0))) {
+    assert(depth >= 1);
+    slots.resize(std::max(depth, 1));
+    for (auto &slot: slots) {
+        slot.queries.resize(this->maxSpans * 2);
+        glGenQueries(GLsizei(slot.queries.size()), slot.queries.data());
+        slot.phases.reserve(this->maxSpans);
+    }
+    frameTimes.reserve(expectedFrames);
+}
+
+PhaseTimer::~PhaseTimer() {
+    if (activeTimer == this) {
+        activeTimer = nullptr;
+    }
+    for (auto &slot: slots) {
+        glDeleteQueries(GLsizei(slot.queries.size()), slot.queries.data());
+    }
+}
+
+void PhaseTimer::setActive(PhaseTimer *timer) {
+    activeTimer = timer;
+}
+
+PhaseTimer *PhaseTimer::active() {
+    return activeTimer;
+}
+
+void PhaseTimer::beginFrame(size_t frame) {
+    assert(!current);
+    if (inFlight == slots.size()) {
+        read(slots[oldest]);
+    }
+    current = &slots[(oldest + inFlight) % slots.size()];
+    current->frame = frame;
+    current->phases.clear();
+    if (frameTimes.size() <= frame) {
+        frameTimes.resize(frame + 1);
+    }
+    frameTimes[frame] = {};
+}
+
+void PhaseTimer::endFrame() {
+    assert(current);
+    current = nullptr;
+    inFlight++;
+}
+
+int PhaseTimer::beginSpan(RenderPhase phase, uint64_t &cpuStart) {
+    if (!current) {
+        return -1;
+    }
+    int span = -1;
+    if (current->phases.size() < maxSpans) {
+        span = int(current->phases.size());
+        current->phases.push_back(phase);
+        glQueryCounter(current->queries[span * 2], GL_TIMESTAMP);
+    }
+    cpuStart = cpuNow();
+    return span;
+}
+
+void PhaseTimer::endSpan(RenderPhase phase, int span, uint64_t cpuStart) {
+    if (!current) {
+        return;
+    }
+    uint64_t cpuEnd = cpuNow();
+    if (span >= 0) {
+        glQueryCounter(current->queries[span * 2 + 1], GL_TIMESTAMP);
+    }
+    Times &times = frameTimes[current->frame];
+    times.cpu[int(phase)] += cpuEnd - cpuStart;
+    times.spans[int(phase)]++;
+    if (span < 0) {
+        times.untimedSpans++;
+    }
+}
+
+void PhaseTimer::poll() {
+    while (inFlight > 0) {
+        FrameSlot &slot = slots[oldest];
+        if (!slot.phases.empty()) {
+            // Note: Markers finish in submission order, the last one being available means all are
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(slot.queries[slot.phases.size() * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+        }
+        read(slot);
+    }
+}
+
+void PhaseTimer::finish() {
+    assert(!current);
+    while (inFlight > 0) {
+        read(slots[oldest]);
+    }
+}
+
+void PhaseTimer::read(FrameSlot &slot) {
+    Times &times = frameTimes[slot.frame];
+    for (size_t i = 0; i < slot.phases.size(); i++) {
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(slot.queries[i * 2], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(slot.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+        times.gpu[int(slot.phases[i])] += end - start;
+    }
+    oldest = (oldest + 1) % slots.size();
+    inFlight--;
+}
+
+bool PhaseTimer::pending() const {
+    return inFlight > 0;
+}
+
+const std::vector<PhaseTimer::Times> &PhaseTimer::results() const {
+    return frameTimes;
+}
+
+const char *PhaseTimer::phaseName(RenderPhase phase) {
+    switch (phase) {
+        case RenderPhase::Clear:
+            return "clear";
+        case RenderPhase::Bind:
+            return "bind";
+        case RenderPhase::Upload:
+            return "upload";
+        case RenderPhase::Draw:
+            return "draw";
+        case RenderPhase::Swap:
+            return "swap";
+    }
+    return "unknown";
+}
@@ -0,0 +1,105 @@
+#ifndef DIPLOMA_PHASE_TIMER_H
+#define DIPLOMA_PHASE_TIMER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "common.h"
+
+// Part of a frame's GL work, renderers mark their own phases with PhaseTimer::Scope
+enum class RenderPhase {
+    Clear,
+    Bind,   // texture binds
+    Upload, // buffer uploads and reallocations in flush
+    Draw,   // draw calls
+    Swap,   // buffer swap, flush for headless surfaces
+};
+
+// CPU and GPU duration of each render phase per frame. Spans are timed on the GPU with a pair of
+// glQueryCounter(GL_TIMESTAMP) markers, read back depth frames later like GpuTimerRing.
+// Comparing the two shows whether a renderer is bound by transfer, vertex work or fill, and an upload
+// with a much larger CPU than GPU time is an implicit sync stall in the driver.
+// Timer is global like the AllocTracker phase and must only be used on the thread owning the GL context.
+class PhaseTimer {
+public:
+    constexpr static int numPhases = int(RenderPhase::Swap) + 1;
+
+    struct Times {
+        std::array<uint64_t, numPhases> cpu; // ns
+        std::array<uint64_t, numPhases> gpu; // ns, only of timed spans
+        std::array<uint32_t, numPhases> spans;
+        uint32_t untimedSpans; // over maxSpans, only their CPU time is counted
+    };
+
+    // Times phase until destroyed if a timer is active and a frame has begun, otherwise does nothing.
+    // Scopes can be nested, the outer one includes the inner one.
+    class Scope {
+    public:
+        explicit Scope(RenderPhase phase) : timer(PhaseTimer::active()), phase(phase) {
+            if (timer) {
+                span = timer->beginSpan(phase, start);
+            }
+        }
+        Scope(const Scope &other) = delete;
+        ~Scope() {
+            if (timer) {
+                timer->endSpan(phase, span, start);
+            }
+        }
+
+    private:
+        PhaseTimer *timer;
+        RenderPhase phase;
+        int span{};
+        uint64_t start{};
+    };
+
+    // Context must be current. Each frame times at most maxSpans spans on the GPU.
+    PhaseTimer(int depth, int maxSpans, size_t expectedFrames = 0);
+    PhaseTimer(const PhaseTimer &other) = delete;
+    ~PhaseTimer();
+
+    // Scopes of all renderers are timed by timer, nullptr stops timing
+    static void setActive(PhaseTimer *timer);
+    static PhaseTimer *active();
+
+    // Frames must be timed in increasing order
+    void beginFrame(size_t frame);
+    void endFrame();
+    // Reads finished frames without blocking
+    void poll();
+    // Blocks until every frame has been read
+    void finish();
+    // Frames not read yet
+    [[nodiscard]]
+    bool pending() const;
+
+    // Times by frame index, GPU times of frames not read yet are 0
+    [[nodiscard]]
+    const std::vector<Times> &results() const;
+
+    static const char *phaseName(RenderPhase phase);
+
+private:
+    struct FrameSlot {
+        size_t frame;
+        std::vector<GLuint> queries;     // start and end marker of each span
+        std::vector<RenderPhase> phases; // of each span timed on the GPU
+    };
+
+    // Returns the span index, -1 if it is not timed on the GPU
+    int beginSpan(RenderPhase phase, uint64_t &cpuStart);
+    void endSpan(RenderPhase phase, int span, uint64_t cpuStart);
+    void read(FrameSlot &slot);
+
+    std::vector<FrameSlot> slots{};
+    size_t oldest = 0;
+    size_t inFlight = 0;
+    FrameSlot *current = nullptr; // frame being recorded
+    size_t maxSpans;
+
+    std::vector<Times> frameTimes{};
+};
+
+#endif //DIPLOMA_PHASE_TIMER_H
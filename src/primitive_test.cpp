@@ -1,29 +1,128 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 #include "common.h"
+#include "renderers/batch_renderer.h"
+
+// Measures vertex/index throughput of the quad topologies supported by BatchRenderer.
+// All topologies draw the same static vertex buffer, only the index buffer differs,
+// so the difference in GPU time comes from index fetch and post-transform cache behaviour.
+
+using Topology = BatchRenderer::Topology;
 
-#define TRIANGLE_STRIP
+static int parseInt(const char *str) {
+    if (!str) {
+        return 0;
+    }
+
+    return atoi(str);
+}
 
+struct TopologyResult {
+    Topology topology;
+    int numIndices;
+    uint64_t gpuMedian;
+    uint64_t gpuMin;
+};
+
+static TopologyResult runTopology(GLFWwindow *window, Topology topology, int numQuads, int numFrames, int numWarmup) {
+    GLuint ibo;
+    glGenBuffers(1, &ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+
+    int numIndices = int(BatchRenderer::indexCount(topology, size_t(numQuads)));
+    std::vector<GLuint> indices(numIndices);
+    BatchRenderer::generateIndices(topology, size_t(numQuads), indices.data());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr) (numIndices * sizeof(GLuint)), indices.data(), GL_STATIC_DRAW);
+
+    if (topology == Topology::StripRestart) {
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(BatchRenderer::restartIndex);
+    } else {
+        glDisable(GL_PRIMITIVE_RESTART);
+    }
+
+    GLuint query;
+    glGenQueries(1, &query);
+
+    std::vector<uint64_t> results{};
+    results.reserve(numFrames);
+    for (int i = 0; i < numWarmup + numFrames; i++) {
+        glfwPollEvents();
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        glDrawElements(BatchRenderer::primitiveMode(topology), numIndices, GL_UNSIGNED_INT, (void *) 0);
+        glEndQuery(GL_TIME_ELAPSED);
+
+        glfwSwapBuffers(window);
+
+        GLuint64 elapsedGpu = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedGpu);
+        if (i >= numWarmup) {
+            results.push_back(elapsedGpu);
+        }
+    }
+
+    glDeleteQueries(1, &query);
+    glDeleteBuffers(1, &ibo);
+
+    std::sort(results.begin(), results.end());
+    return TopologyResult{
+            .topology = topology,
+            .numIndices = numIndices,
+            .gpuMedian = results.empty() ? 0 : results[results.size() / 2],
+            .gpuMin = results.empty() ? 0 : results.front(),
+    };
+}
 
 int main(int argc, const char **argv) {
+    int numQuads = 100000;
+    int numFrames = 200;
+    int numWarmup = 20;
+    int quadSize = 2; // in pixels, small so we are not fill rate bound
+    bool wireframe = false;
+    std::vector<Topology> topologies = {Topology::Triangles, Topology::StripRestart, Topology::StripDegenerate};
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *nextArg = nullptr;
+        if (i + 1 < argc) nextArg = argv[i + 1];
+        if (strcmp(arg, "--num_quads") == 0) {
+            numQuads = parseInt(nextArg);
+        } else if (strcmp(arg, "--num_frames") == 0) {
+            numFrames = parseInt(nextArg);
+        } else if (strcmp(arg, "--num_warmup") == 0) {
+            numWarmup = parseInt(nextArg);
+        } else if (strcmp(arg, "--quad_size") == 0) {
+            quadSize = parseInt(nextArg);
+        } else if (strcmp(arg, "--wireframe") == 0) {
+            wireframe = true;
+        } else if (strcmp(arg, "--topology") == 0) {
+            Topology topology;
+            if (!BatchRenderer::parseTopology(nextArg, topology)) {
+                fprintf(stderr, "Invalid topology: %s\n", nextArg ? nextArg : "");
+                return 1;
+            }
+            topologies = {topology};
+        }
+    }
+    assert(numQuads > 0 && numFrames > 0 && quadSize > 0);
+
     glfwInit();
-    GLFWwindow *window = glfwCreateWindow(640, 640, "", nullptr, nullptr);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(640, 640, "PrimitiveTest", nullptr, nullptr);
     glfwMakeContextCurrent(window);
     gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
     gladLoadGL();
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-
-    glCullFace(GL_NONE);
-
-#if defined(TRIANGLE)
-    glfwSetWindowTitle(window, "GL_TRIANGLES");
-#elif defined(TRIANGLE_STRIP)
-    glfwSetWindowTitle(window, "GL_TRIANGLE_STRIP");
-#elif defined(TRIANGLE_FAN)
-    glfwSetWindowTitle(window, "GL_TRIANGLE_FAN");
-#endif
+    // Set fps to unlimited
+    glfwSwapInterval(0);
 
+    printf("GL_RENDERER: %s\n", glGetString(GL_RENDERER));
 
     GLuint shader = compileShaderProgram({.vertex=R"(
         #version 330 core
@@ -39,97 +138,68 @@ int main(int argc, const char **argv) {
             FragColor = vec4(1.0, 1.0, 1.0, 1.0);
         }
     )"});
+    assert(shader);
+
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    glViewport(0, 0, width, height);
+
+    // Lay quads out in a grid, wrapping around (and overlapping) once the window is full.
+    // Vertices are in the same order as BatchRenderer: bottom left, bottom right, top right, top left.
+    int columns = std::max(1, width / (quadSize * 2));
+    int rows = std::max(1, height / (quadSize * 2));
+    float quadW = 2.0f * float(quadSize) / float(width);
+    float quadH = 2.0f * float(quadSize) / float(height);
+    std::vector<glm::vec2> vertices(numQuads * 4);
+    for (int q = 0; q < numQuads; q++) {
+        int cell = q % (columns * rows);
+        float x = -1.0f + 2.0f * quadW * float(cell % columns);
+        float y = -1.0f + 2.0f * quadH * float(cell / columns);
+        vertices[q * 4 + 0] = {x, y};
+        vertices[q * 4 + 1] = {x + quadW, y};
+        vertices[q * 4 + 2] = {x + quadW, y + quadH};
+        vertices[q * 4 + 3] = {x, y + quadH};
+    }
 
-    Texture texture = loadDummyTexture();
     GLuint vao, vbo;
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (vertices.size() * sizeof(glm::vec2)), vertices.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void *) 0);
-    glPolygonMode( GL_FRONT_AND_BACK, GL_LINE);
-    glLineWidth(4.0f);
-    // quad
-#if defined(TRIANGLE)
-    float vertices[] = {
-            // bottom left quad
-            -0.8f, -0.8f, // bottom left
-            -0.8f, -0.1f, // top left
-            -0.1f, -0.1f, // top right
-            -0.1f, -0.1f, // top right
-            -0.1f, -0.8f, // bottom right
-            -0.8f, -0.8f, // bottom left
-
-            // top right quad
-            0.1f, 0.1f, // bottom left
-            0.1f, 0.8f, // top left
-            0.8f, 0.8f, // top right
-            0.8f, 0.8f, // top right
-            0.8f, 0.1f, // bottom right
-            0.1f, 0.1f, // bottom left
-    };
-#elif defined(TRIANGLE_STRIP)
-    float vertices[] = {
-            // bottom left quad
-            -0.8f, -0.8f, // bottom left
-            -0.8f, -0.1f, // top left
-            -0.1f, -0.8f, // bottom right
-            -0.1f, -0.1f, // top right
-
-            // Degenerate triangle
-            -0.1f, -0.1f, // top right
-            0.1f, 0.1f, // bottom left
-
-            // top right quad
-            0.1f, 0.1f, // bottom left
-            0.1f, 0.8f, // top left
-            0.8f, 0.1f, // bottom right
-            0.8f, 0.8f, // top right
-    };
-#elif defined(TRIANGLE_FAN)
-    float vertices[] = {
-            // bottom left quad
-            -0.8f, -0.1f, // top left
-            -0.8f, -0.8f, // bottom left
-            -0.1f, -0.8f, // bottom right
-            -0.1f, -0.1f, // top right
-
-            // top right quad
-            0.1f, 0.8f, // top left
-            0.1f, 0.1f, // bottom left
-            0.8f, 0.1f, // bottom right
-            0.8f, 0.8f, // top right
-    };
-#endif
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
+    if (wireframe) {
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    }
+    glDisable(GL_CULL_FACE);
+    glClearColor(0.0f, 0.0f, 0.2f, 1.0f);
     glUseProgram(shader);
 
-    while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
-
-        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-            glfwSetWindowShouldClose(window, GLFW_TRUE);
-        }
-
-        int width, height;
-        glfwGetWindowSize(window, &width, &height);
-        glViewport(0, 0, width, height);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-#ifdef TRIANGLE
-        glDrawArrays(GL_TRIANGLES, 0, 12);
-#elifdef TRIANGLE_STRIP
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 10);
-        //glDrawArrays(GL_TRIANGLE_STRIP, 0, 8);
-#elifdef TRIANGLE_FAN
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 8);
-#endif
+    std::vector<TopologyResult> results{};
+    for (auto topology: topologies) {
+        results.push_back(runTopology(window, topology, numQuads, numFrames, numWarmup));
+    }
 
-        glfwSwapBuffers(window);
+    printf("num_quads=%d num_vertices=%d num_triangles=%d\n", numQuads, numQuads * 4, numQuads * 2);
+    for (auto &res: results) {
+        double seconds = double(res.gpuMedian) * 1e-9;
+        printf("topology=%s indices=%d index_bytes=%zu gpu_time=%llu gpu_time_min=%llu "
+               "mvertices_per_sec=%.2f mindices_per_sec=%.2f mtriangles_per_sec=%.2f\n",
+               BatchRenderer::topologyName(res.topology),
+               res.numIndices,
+               res.numIndices * sizeof(GLuint),
+               (unsigned long long) res.gpuMedian,
+               (unsigned long long) res.gpuMin,
+               seconds > 0.0 ? double(numQuads) * 4.0 / seconds * 1e-6 : 0.0,
+               seconds > 0.0 ? double(res.numIndices) / seconds * 1e-6 : 0.0,
+               seconds > 0.0 ? double(numQuads) * 2.0 / seconds * 1e-6 : 0.0);
     }
 
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteProgram(shader);
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -0,0 +1,193 @@
+#include "render_thread.h"
+
+#include <chrono>
+#include <thread>
+#include "async_worker.h"
+#include "phase_timer.h"
+
+RenderThread::RenderThread(Surface *surface, IRenderer *renderer, Options options)
+        : surface(surface), renderer(renderer), options(options),
+          submittedLists(std::max(options.queueDepth, 1)), freeLists(std::max(options.queueDepth, 1)) {
+    assert(options.queueDepth >= 1);
+    for (int i = 0; i < options.queueDepth; i++) {
+        lists.push_back(std::make_unique<CommandList>());
+        [[maybe_unused]] bool pushed = freeLists.push(lists.back().get());
+        assert(pushed);
+    }
+    gpuTimers = std::make_unique<GpuTimerRing>(std::max(options.gpuQueryDepth, 1), 1024);
+    frameStats.reserve(1024);
+
+    surface->releaseCurrent();
+    thread = std::thread(&RenderThread::threadLoop, this);
+}
+
+RenderThread::~RenderThread() {
+    finish();
+    stopping.store(true, std::memory_order_release);
+    // Wake render thread waiting for a submission
+    numSubmitted.fetch_add(1, std::memory_order_release);
+    numSubmitted.notify_one();
+    thread.join();
+
+    surface->makeCurrent();
+    gpuTimers.reset();
+}
+
+CommandList *RenderThread::acquire() {
+    CommandList *list;
+    while (true) {
+        // Note: Counter is read before trying the ring, so a list returned in between wakes the wait
+        size_t played = numPlayed.load(std::memory_order_acquire);
+        if (freeLists.pop(list)) {
+            break;
+        }
+        numPlayed.wait(played, std::memory_order_acquire);
+    }
+    list->sprites.clear();
+    list->captureFrame = -1;
+    return list;
+}
+
+void RenderThread::submit(CommandList *list) {
+    // Note: Ring holds every list, so it is never full
+    [[maybe_unused]] bool pushed = submittedLists.push(list);
+    assert(pushed);
+    numSubmitted.fetch_add(1, std::memory_order_release);
+    numSubmitted.notify_one();
+}
+
+void RenderThread::finish() {
+    size_t submitted = numSubmitted.load(std::memory_order_relaxed);
+    size_t played;
+    while ((played = numPlayed.load(std::memory_order_acquire)) != submitted) {
+        numPlayed.wait(played, std::memory_order_acquire);
+    }
+    size_t timed;
+    while ((timed = numTimed.load(std::memory_order_acquire)) != submitted) {
+        numTimed.wait(timed, std::memory_order_acquire);
+    }
+}
+
+const std::vector<RenderThread::FrameStats> &RenderThread::stats() const {
+    return frameStats;
+}
+
+const std::vector<FrameImage> &RenderThread::captures() const {
+    return frameCaptures;
+}
+
+void RenderThread::threadLoop() {
+    if (options.cpu >= 0 && !pinCurrentThread(options.cpu)) {
+        fprintf(stderr, "Could not pin render thread to cpu %d\n", options.cpu);
+    }
+    surface->makeCurrent();
+
+    while (true) {
+        size_t submitted = numSubmitted.load(std::memory_order_acquire);
+        CommandList *list;
+        if (!submittedLists.pop(list)) {
+            PhaseTimer *phases = PhaseTimer::active();
+            if (gpuTimers->pending() || (phases && phases->pending())) {
+                // Note: Results are polled while idle instead of waited for, the GPU may still be behind
+                gpuTimers->poll();
+                if (phases) {
+                    phases->poll();
+                }
+                collectGpuTimes();
+                if (gpuTimers->pending() || (phases && phases->pending())) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    continue;
+                }
+            }
+            if (stopping.load(std::memory_order_acquire)) {
+                break;
+            }
+            // Sleep until the game thread submits, the ring itself is never locked
+            numSubmitted.wait(submitted, std::memory_order_acquire);
+            continue;
+        }
+        play(list);
+        [[maybe_unused]] bool pushed = freeLists.push(list);
+        assert(pushed);
+        numPlayed.fetch_add(1, std::memory_order_release);
+        numPlayed.notify_one();
+    }
+
+    gpuTimers->finish();
+    if (PhaseTimer::active()) {
+        PhaseTimer::active()->finish();
+    }
+    collectGpuTimes();
+    surface->releaseCurrent();
+}
+
+void RenderThread::play(CommandList *list) {
+    using Nano = std::chrono::nanoseconds;
+    using Clock = std::chrono::high_resolution_clock;
+
+    PhaseTimer *phases = PhaseTimer::active();
+    gpuTimers->begin(frameStats.size());
+    if (phases) {
+        phases->beginFrame(frameStats.size());
+    }
+    // Note: Phase is global, allocations of the game thread while a list is played count under its phase
+    AllocTracker::Snapshot allocsBefore = AllocTracker::snapshot();
+    auto start = Clock::now();
+
+    {
+        PhaseTimer::Scope phase{RenderPhase::Clear};
+        glClearColor(list->clearColor.r, list->clearColor.g, list->clearColor.b, list->clearColor.a);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    {
+        AllocTracker::Scope phase{AllocPhase::Submit};
+        renderer->begin(list->projView);
+        for (auto &cmd: list->sprites) {
+            renderer->drawSprite(cmd.region, cmd.pos, cmd.size, cmd.origin, cmd.rotation, cmd.color);
+        }
+    }
+    {
+        AllocTracker::Scope phase{AllocPhase::Flush};
+        renderer->end();
+    }
+    renderer->endFrame();
+    gpuTimers->end();
+    if (list->captureFrame >= 0) {
+        frameCaptures.push_back(captureFrame(list->captureFrame, surface->width(), surface->height()));
+    }
+    {
+        AllocTracker::Scope allocPhase{AllocPhase::Swap};
+        PhaseTimer::Scope phase{RenderPhase::Swap};
+        surface->swapBuffers();
+    }
+
+    auto end = Clock::now();
+    AllocTracker::Snapshot allocs = AllocTracker::since(allocsBefore);
+    if (phases) {
+        phases->endFrame();
+        phases->poll();
+    }
+
+    frameStats.push_back(FrameStats{
+            .render = uint64_t(std::chrono::duration_cast<Nano>(end - start).count()),
+            .renderer = renderer->frameStats(),
+            .allocs = allocs,
+    });
+    gpuTimers->poll();
+    collectGpuTimes();
+}
+
+void RenderThread::collectGpuTimes() {
+    auto &results = gpuTimers->results();
+    for (; numCollected < results.size(); numCollected++) {
+        frameStats[numCollected].gpu = results[numCollected];
+    }
+    // Note: Phase times are read by the game thread after finish, so frames count as timed once both are read
+    PhaseTimer *phases = PhaseTimer::active();
+    if (numTimed.load(std::memory_order_relaxed) == numCollected || (phases && phases->pending())) {
+        return;
+    }
+    numTimed.store(numCollected, std::memory_order_release);
+    numTimed.notify_one();
+}
@@ -0,0 +1,99 @@
+#ifndef DIPLOMA_RENDER_THREAD_H
+#define DIPLOMA_RENDER_THREAD_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "alloc_tracker.h"
+#include "base_renderer.h"
+#include "frame_capture.h"
+#include "gpu_timer_ring.h"
+#include "spsc_ring.h"
+#include "surface.h"
+
+struct SpriteCommand {
+    UVRegion region;
+    glm::vec2 pos;
+    glm::vec2 size;
+    glm::vec2 origin;
+    float rotation;
+    Color color;
+};
+
+// Sprites of one frame, recorded by the game thread and played by the render thread
+struct CommandList {
+    glm::mat4 projView;
+    glm::vec4 clearColor;
+    int captureFrame = -1; // >= 0 reads the color buffer back under this frame number, see RenderThread::captures
+    std::vector<SpriteCommand> sprites;
+
+    void drawSprite(const UVRegion &region, glm::vec2 pos, glm::vec2 size, glm::vec2 origin, float rotation, Color color) {
+        sprites.push_back({region, pos, size, origin, rotation, color});
+    }
+};
+
+// Owns the GL context of a surface on its own thread, and plays command lists into a renderer.
+// Command lists are reused, the game thread can be at most queueDepth frames ahead.
+class RenderThread {
+public:
+    struct Options {
+        int queueDepth = 2;
+        int cpu = -1; // render thread affinity, -1 for none
+        int gpuQueryDepth = 4; // see GpuTimerRing
+    };
+
+    struct FrameStats {
+        uint64_t render{}; // CPU time of playing the list, swap included
+        uint64_t gpu{};
+        RendererStats renderer{};
+        AllocTracker::Snapshot allocs{}; // made while playing the list, see AllocTracker
+    };
+
+    // GL context of surface must be current on the calling thread, it is moved to the render thread.
+    // Renderer must have been created with that context.
+    RenderThread(Surface *surface, IRenderer *renderer, Options options);
+    RenderThread(const RenderThread &other) = delete;
+    // Waits for submitted lists, context is made current on the calling thread again
+    ~RenderThread();
+
+    // Blocks while all lists are in flight. Returned list is empty.
+    CommandList *acquire();
+    void submit(CommandList *list);
+    // Blocks until all submitted lists have been played and their GPU times read
+    void finish();
+
+    // Only valid after finish
+    [[nodiscard]]
+    const std::vector<FrameStats> &stats() const;
+    // Color buffers of lists with a capture frame, only valid after finish
+    [[nodiscard]]
+    const std::vector<FrameImage> &captures() const;
+
+private:
+    void threadLoop();
+    void play(CommandList *list);
+    // Copies GPU times read since the last call into frameStats. With an active PhaseTimer the frames
+    // are only published to finish() once all its phase times are read too.
+    void collectGpuTimes();
+
+    Surface *surface;
+    IRenderer *renderer;
+    Options options;
+
+    std::vector<std::unique_ptr<CommandList>> lists{};
+    SpscRing<CommandList *> submittedLists; // game -> render
+    SpscRing<CommandList *> freeLists;      // render -> game
+    std::atomic<size_t> numSubmitted{};
+    std::atomic<size_t> numPlayed{};
+    std::atomic<size_t> numTimed{}; // played lists with their GPU time read
+    std::atomic<bool> stopping{};
+
+    std::unique_ptr<GpuTimerRing> gpuTimers{};
+    size_t numCollected = 0;
+    std::vector<FrameStats> frameStats{};
+    std::vector<FrameImage> frameCaptures{};
+    std::thread thread{};
+};
+
+#endif //DIPLOMA_RENDER_THREAD_H
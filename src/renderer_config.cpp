@@ -0,0 +1,179 @@
+#include "renderer_config.h"
+
+#include <cstdlib>
+#include <cstring>
+
+const char *rendererTypeName(RendererType type) {
+    switch (type) {
+        case RendererType::Naive:
+            return "naive";
+        case RendererType::Batch:
+            return "batch";
+        case RendererType::InstanceCPU:
+            return "instance_cpu";
+        case RendererType::Instance:
+            return "instance";
+        case RendererType::Geometry:
+            return "geometry";
+        case RendererType::GeometryBatch:
+            return "geometry_batch";
+        case RendererType::Retained:
+            return "retained";
+        case RendererType::Concurrent:
+            return "concurrent";
+    }
+    return "unknown";
+}
+
+bool parseRendererType(const char *str, RendererType &type) {
+    if (!str) {
+        return false;
+    }
+    for (auto t: {RendererType::Naive, RendererType::Batch, RendererType::InstanceCPU, RendererType::Instance,
+                  RendererType::Geometry, RendererType::GeometryBatch, RendererType::Retained,
+                  RendererType::Concurrent}) {
+        if (strcmp(str, rendererTypeName(t)) == 0) {
+            type = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseBool(const char *str, bool &value) {
+    if (strcmp(str, "1") == 0 || strcmp(str, "true") == 0) {
+        value = true;
+        return true;
+    }
+    if (strcmp(str, "0") == 0 || strcmp(str, "false") == 0) {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+static bool parseKey(RendererConfig &config, const char *key, const char *value) {
+    if (strcmp(key, "renderer_type") == 0) {
+        return parseRendererType(value, config.type);
+    } else if (strcmp(key, "batch_size") == 0) {
+        config.batchSize = atoi(value);
+        return config.batchSize > 0;
+    } else if (strcmp(key, "max_batch_size") == 0) {
+        config.maxBatchSize = atoi(value);
+        return config.maxBatchSize >= 0;
+    } else if (strcmp(key, "batch_shrink_frames") == 0) {
+        config.batchShrinkFrames = atoi(value);
+        return true;
+    } else if (strcmp(key, "topology") == 0) {
+        return BatchRenderer::parseTopology(value, config.topology);
+    } else if (strcmp(key, "vertex_format") == 0) {
+        return BatchRenderer::parseVertexFormat(value, config.vertexFormat);
+    } else if (strcmp(key, "instance_layout") == 0) {
+        config.instanceLayout = value;
+        return true;
+    } else if (strcmp(key, "upload_mode") == 0) {
+        return RetainedRenderer::parseUploadMode(value, config.uploadMode);
+    } else if (strcmp(key, "chunk_size") == 0) {
+        config.chunkSize = atoi(value);
+        return config.chunkSize > 0;
+    } else if (strcmp(key, "persistent_mapping") == 0) {
+        return parseBool(value, config.persistentMapping);
+    } else if (strcmp(key, "driver") == 0) {
+        config.driver = value;
+        return true;
+    } else if (strcmp(key, "num_sprites") == 0) {
+        config.numSprites = atoi(value);
+        return true;
+    } else if (strcmp(key, "frame_time_ms") == 0) {
+        config.frameTime = strtod(value, nullptr);
+        return true;
+    }
+    // Note: Unknown keys are skipped, so older builds can read newer configs
+    return true;
+}
+
+bool loadRendererConfig(const char *path, RendererConfig &config) {
+    return readKeyValueFile(path, [&](const char *key, const char *value) {
+        return parseKey(config, key, value);
+    });
+}
+
+bool saveRendererConfig(const char *path, const RendererConfig &config) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "# Renderer picked by Benchmark --auto_tune\n");
+    fprintf(file, "renderer_type=%s\n", rendererTypeName(config.type));
+    fprintf(file, "batch_size=%d\n", config.batchSize);
+    fprintf(file, "max_batch_size=%d\n", config.maxBatchSize);
+    fprintf(file, "batch_shrink_frames=%d\n", config.batchShrinkFrames);
+    fprintf(file, "topology=%s\n", BatchRenderer::topologyName(config.topology));
+    fprintf(file, "vertex_format=%s\n", BatchRenderer::vertexFormatName(config.vertexFormat));
+    fprintf(file, "instance_layout=%s\n", config.instanceLayout.c_str());
+    fprintf(file, "upload_mode=%s\n", RetainedRenderer::uploadModeName(config.uploadMode));
+    fprintf(file, "chunk_size=%d\n", config.chunkSize);
+    fprintf(file, "persistent_mapping=%d\n", config.persistentMapping);
+    fprintf(file, "# Calibration\n");
+    fprintf(file, "driver=%s\n", config.driver.c_str());
+    fprintf(file, "num_sprites=%d\n", config.numSprites);
+    fprintf(file, "frame_time_ms=%.3f\n", config.frameTime);
+    return fclose(file) == 0;
+}
+
+std::string describeRendererConfig(const RendererConfig &config) {
+    char buffer[256];
+    const char *type = rendererTypeName(config.type);
+    switch (config.type) {
+        case RendererType::Batch:
+            snprintf(buffer, sizeof(buffer), "%s batch_size=%d topology=%s vertex_format=%s", type, config.batchSize,
+                     BatchRenderer::topologyName(config.topology),
+                     BatchRenderer::vertexFormatName(config.vertexFormat));
+            break;
+        case RendererType::InstanceCPU:
+        case RendererType::Instance:
+            snprintf(buffer, sizeof(buffer), "%s batch_size=%d instance_layout=%s", type, config.batchSize,
+                     config.instanceLayout.c_str());
+            break;
+        case RendererType::GeometryBatch:
+            snprintf(buffer, sizeof(buffer), "%s batch_size=%d", type, config.batchSize);
+            break;
+        case RendererType::Retained:
+            snprintf(buffer, sizeof(buffer), "%s upload_mode=%s", type,
+                     RetainedRenderer::uploadModeName(config.uploadMode));
+            break;
+        case RendererType::Concurrent:
+            snprintf(buffer, sizeof(buffer), "%s batch_size=%d chunk_size=%d persistent_mapping=%d", type,
+                     config.batchSize, config.chunkSize, config.persistentMapping);
+            break;
+        default:
+            snprintf(buffer, sizeof(buffer), "%s", type);
+            break;
+    }
+    return buffer;
+}
+
+int verifyEdgeShift(const RendererConfig &config) {
+    switch (config.type) {
+        case RendererType::Geometry:
+        case RendererType::GeometryBatch:
+            // Note: Texel edges of unrotated, magnified sprites can fall exactly on pixel centers, the rasterizer
+            // may break those ties differently for geometry shader output
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+std::string currentDriverName() {
+    auto *name = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+    return name ? name : "";
+}
+
+std::unique_ptr<IRenderer> createRenderer(const RendererConfig &config) {
+    std::unique_ptr<IRenderer> renderer{};
+    visitRenderer(config, [&](auto r) {
+        renderer = std::move(r);
+    });
+    return renderer;
+}
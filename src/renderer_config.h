@@ -0,0 +1,131 @@
+#ifndef DIPLOMA_RENDERER_CONFIG_H
+#define DIPLOMA_RENDERER_CONFIG_H
+
+#include <memory>
+#include <string>
+#include "base_renderer.h"
+#include "renderers/batch_renderer.h"
+#include "renderers/concurrent_renderer.h"
+#include "renderers/geometry_batch_renderer.h"
+#include "renderers/geometry_renderer.h"
+#include "renderers/instance_renderer.h"
+#include "renderers/instance_renderer_cpu.h"
+#include "renderers/naive_renderer.h"
+#include "renderers/retained_renderer.h"
+
+enum class RendererType {
+    Naive,
+    Batch,
+    InstanceCPU,
+    Instance,
+    Geometry,
+    GeometryBatch,
+    Retained,
+    Concurrent,
+};
+
+// Renderer method and its parameters. Benchmark --auto_tune writes the fastest one for the machine it ran on,
+// applications load it at startup. Stored as one key=value per line, lines starting with # are comments.
+struct RendererConfig {
+    RendererType type = RendererType::Batch;
+    int batchSize = 4000;  // batched renderers, initial capacity for retained and adaptive ones
+    int maxBatchSize = 0;  // adaptive batch capacity ceiling, 0 for a fixed batch size
+    int batchShrinkFrames = 120;
+    bool logBatchEvents = false; // not stored
+    BatchRenderer::Topology topology = BatchRenderer::Topology::StripRestart;
+    BatchRenderer::VertexFormat vertexFormat = BatchRenderer::VertexFormat::Standard;
+    std::string instanceLayout = "full"; // layout name of InstanceRenderer or InstanceRendererCPU
+    RetainedRenderer::UploadMode uploadMode = RetainedRenderer::UploadMode::SubData;
+    int chunkSize = 256;
+    bool persistentMapping = true;
+
+    // Calibration the config was picked with, only informational
+    std::string driver{}; // GL_RENDERER the config was tuned on
+    int numSprites = 0;
+    double frameTime = 0.0; // ms
+};
+
+const char *rendererTypeName(RendererType type);
+bool parseRendererType(const char *str, RendererType &type);
+
+// Returns false if the file can not be read or has invalid values, config keeps defaults for missing keys
+bool loadRendererConfig(const char *path, RendererConfig &config);
+bool saveRendererConfig(const char *path, const RendererConfig &config);
+// Short description for output, eg. "batch batch_size=4000"
+std::string describeRendererConfig(const RendererConfig &config);
+
+// Pixels sprite and texel edges drawn with config may be moved by compared to NaiveRenderer, 0 for paths
+// that must match it exactly
+int verifyEdgeShift(const RendererConfig &config);
+
+// GL_RENDERER of the current context, to tell if a config was tuned on another GPU
+std::string currentDriverName();
+
+// Creates the renderer described by config and passes it to f as std::unique_ptr of its concrete type,
+// so callers can specialise on it. Returns false if config is invalid (eg. unknown instance layout).
+template<typename F>
+bool visitRenderer(const RendererConfig &config, F &&f) {
+    auto setCapacity = [&](auto &renderer) {
+        if (config.maxBatchSize > 0) {
+            renderer.setCapacity({
+                    .initial = size_t(std::max(config.batchSize, 1)),
+                    .max = size_t(config.maxBatchSize),
+                    .shrinkFrames = config.batchShrinkFrames,
+                    .logEvents = config.logBatchEvents,
+            });
+        }
+    };
+    switch (config.type) {
+        case RendererType::Naive:
+            f(std::make_unique<NaiveRenderer>());
+            return true;
+        case RendererType::Batch: {
+            auto r = std::make_unique<BatchRenderer>(config.batchSize, config.topology, config.vertexFormat);
+            setCapacity(*r);
+            f(std::move(r));
+            return true;
+        }
+        case RendererType::InstanceCPU: {
+            InstanceRendererCPU::Layout layout;
+            if (!InstanceRendererCPU::parseLayout(config.instanceLayout.c_str(), layout)) {
+                return false;
+            }
+            auto r = std::make_unique<InstanceRendererCPU>(config.batchSize, layout);
+            setCapacity(*r);
+            f(std::move(r));
+            return true;
+        }
+        case RendererType::Instance: {
+            InstanceRenderer::Layout layout;
+            if (!InstanceRenderer::parseLayout(config.instanceLayout.c_str(), layout)) {
+                return false;
+            }
+            auto r = std::make_unique<InstanceRenderer>(config.batchSize, layout);
+            setCapacity(*r);
+            f(std::move(r));
+            return true;
+        }
+        case RendererType::Geometry:
+            f(std::make_unique<GeometryRenderer>());
+            return true;
+        case RendererType::GeometryBatch: {
+            auto r = std::make_unique<GeometryBatchRenderer>(config.batchSize);
+            setCapacity(*r);
+            f(std::move(r));
+            return true;
+        }
+        case RendererType::Retained:
+            // Note: batch size is only the initial capacity, buffers grow with the number of sprites
+            f(std::make_unique<RetainedRenderer>(std::max(config.batchSize, 1), config.uploadMode));
+            return true;
+        case RendererType::Concurrent:
+            f(std::make_unique<ConcurrentRenderer>(config.batchSize, config.chunkSize, config.persistentMapping));
+            return true;
+    }
+    return false;
+}
+
+// nullptr if config is invalid
+std::unique_ptr<IRenderer> createRenderer(const RendererConfig &config);
+
+#endif //DIPLOMA_RENDERER_CONFIG_H
@@ -0,0 +1,76 @@
+#include "batch_capacity.h"
+
+#include <cassert>
+#include <cstdio>
+
+BatchCapacity::BatchCapacity(const Options &options) : options(options), current(options.initial) {
+    assert(options.initial > 0);
+    counters.peakCapacity = current;
+}
+
+size_t BatchCapacity::capacity() const {
+    return current;
+}
+
+bool BatchCapacity::adaptive() const {
+    return options.max > options.initial;
+}
+
+bool BatchCapacity::grow(size_t needed) {
+    if (needed <= current) {
+        return false;
+    }
+    if (!adaptive() || current >= options.max) {
+        counters.fullFlushes++;
+        return false;
+    }
+    size_t previous = current;
+    current = std::min(std::max(current * 2, needed), options.max);
+    counters.grows++;
+    counters.peakCapacity = std::max(counters.peakCapacity, current);
+    if (options.logEvents) {
+        fprintf(stderr, "Batch capacity grown from %zu to %zu in frame %llu\n", previous, current,
+                (unsigned long long) frames);
+    }
+    return true;
+}
+
+void BatchCapacity::batchFlushed(size_t size) {
+    windowLargest = std::max(windowLargest, size);
+    counters.largestBatch = std::max(counters.largestBatch, size);
+}
+
+bool BatchCapacity::endFrame() {
+    frames++;
+    if (!adaptive() || ++windowFrames < options.shrinkFrames) {
+        return false;
+    }
+    size_t largest = windowLargest;
+    windowLargest = 0;
+    windowFrames = 0;
+
+    size_t previous = current;
+    // Note: Halved at most while the load fits in a quarter, so the next frame does not grow right back
+    while (current / 2 >= options.initial && largest * 4 <= current) {
+        current /= 2;
+    }
+    if (current == previous) {
+        return false;
+    }
+    counters.shrinks++;
+    if (options.logEvents) {
+        fprintf(stderr, "Batch capacity shrunk from %zu to %zu in frame %llu\n", previous, current,
+                (unsigned long long) frames);
+    }
+    return true;
+}
+
+void BatchCapacity::countGpuReallocation() {
+    counters.gpuReallocations++;
+}
+
+BatchCapacity::Stats BatchCapacity::stats() const {
+    Stats stats = counters;
+    stats.capacity = current;
+    return stats;
+}
@@ -0,0 +1,74 @@
+#ifndef DIPLOMA_BATCH_CAPACITY_H
+#define DIPLOMA_BATCH_CAPACITY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// Capacity of the staging and GPU buffers of a batched renderer, in sprites.
+// A fixed capacity (max <= initial) flushes when a batch is full. An adaptive one grows the batch instead,
+// doubling up to max, and halves it once the largest batch of a whole window of frames used at most a
+// quarter of it. Grow and shrink thresholds are far apart, so a steady load does not reallocate.
+class BatchCapacity {
+public:
+    struct Options {
+        size_t initial = 4000; // also the minimum an adaptive capacity shrinks to
+        size_t max = 0;        // ceiling for growth, 0 or <= initial for a fixed capacity
+        int shrinkFrames = 120; // frames the load must stay low before shrinking
+        bool logEvents = false; // print every resize to stderr
+    };
+
+    struct Stats {
+        size_t capacity;
+        size_t peakCapacity;
+        size_t largestBatch;       // most sprites in one batch
+        uint64_t grows;
+        uint64_t shrinks;
+        uint64_t gpuReallocations; // grows within one batch share a single reallocation
+        uint64_t fullFlushes;      // batches flushed because the capacity was at its maximum
+    };
+
+    BatchCapacity() = default;
+    explicit BatchCapacity(const Options &options);
+
+    [[nodiscard]]
+    size_t capacity() const;
+    [[nodiscard]]
+    bool adaptive() const;
+
+    // Called when a batch needs room for `needed` sprites in total. Returns true if capacity was raised
+    // and the caller must reallocate its staging data, false if it must flush instead.
+    bool grow(size_t needed);
+    // Called with the size of every flushed batch
+    void batchFlushed(size_t size);
+    // Called once per frame after the last flush. Returns true if capacity was lowered
+    // and the caller must reallocate its staging data.
+    bool endFrame();
+    // Called when the GPU buffer was reallocated to match capacity
+    void countGpuReallocation();
+
+    [[nodiscard]]
+    Stats stats() const;
+
+private:
+    Options options{};
+    size_t current{};
+    size_t windowLargest{}; // largest batch of the current shrink window
+    int windowFrames{};
+    uint64_t frames{};
+    Stats counters{};
+};
+
+// Reallocates staging data to capacity items, keeping the first used ones
+template<typename T>
+void resizeStaging(std::unique_ptr<T[]> &data, size_t used, size_t capacity) {
+    auto resized = std::make_unique_for_overwrite<T[]>(capacity);
+    if (used > 0) {
+        memcpy(resized.get(), data.get(), std::min(used, capacity) * sizeof(T));
+    }
+    data = std::move(resized);
+}
+
+#endif //DIPLOMA_BATCH_CAPACITY_H
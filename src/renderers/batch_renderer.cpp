@@ -1,35 +1,98 @@
 #include "batch_renderer.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "../phase_timer.h"
 
-BatchRenderer::BatchRenderer(int numQuads) {
-    shader = compileShaderProgram({.vertex = R"(
-        #version 330 core
-        layout (location = 0) in vec2 aPos;
-        layout (location = 1) in vec2 aUV;
-        layout (location = 2) in vec4 aColor;
-
-        out vec2 UV;
-        out vec4 color;
-        uniform mat4 uProjView;
-        uniform sampler2D uTex;
-        void main() {
-            vec2 texSize = textureSize(uTex, 0);
-            UV = aUV / texSize;
-            color = aColor;
-            gl_Position = uProjView * vec4(aPos, 0.0, 1.0);
-        }
-    )", .fragment = R"(
-        #version 330 core
-        out vec4 FragColor;
-        in vec2 UV;
-        in vec4 color;
-        uniform sampler2D uTex;
-        void main() {
-            FragColor = texture(uTex, UV) * color;
-        }
-    )"});
+
+BatchRenderer::BatchRenderer(int numQuads, Topology topology, VertexFormat vertexFormat)
+        : topology(topology), vertexFormat(vertexFormat) {
+    if (vertexFormat == VertexFormat::Standard) {
+        shader = compileShaderProgram({.vertex = R"(
+            #version 330 core
+            layout (location = 0) in vec2 aPos;
+            layout (location = 1) in vec2 aUV;
+            layout (location = 2) in vec4 aColor;
+
+            out vec2 UV;
+            out vec4 color;
+            uniform mat4 uProjView;
+            uniform sampler2D uTex;
+            void main() {
+                vec2 texSize = textureSize(uTex, 0);
+                UV = aUV / texSize;
+                color = aColor;
+                gl_Position = uProjView * vec4(aPos, 0.0, 1.0);
+            }
+        )", .fragment = R"(
+            #version 330 core
+            out vec4 FragColor;
+            in vec2 UV;
+            in vec4 color;
+            uniform sampler2D uTex;
+            void main() {
+                FragColor = texture(uTex, UV) * color;
+            }
+        )"});
+    } else {
+        shader = compileShaderProgram({.vertex = R"(
+            #version 330 core
+            layout (location = 0) in vec2 aOffset; // fixed point, relative to the quad center
+
+            out vec2 UV;
+            flat out vec4 color;
+            flat out int slot;
+            uniform mat4 uProjView;
+            uniform usamplerBuffer uQuads; // CompactQuad, 3 texels per quad
+            void main() {
+                int texel = gl_VertexID / 4 * 3;
+                vec2 center = uintBitsToFloat(texelFetch(uQuads, texel).xy);
+                uvec2 uv = texelFetch(uQuads, texel + 1).xy;   // u0 | v0 << 16, u1 | v1 << 16
+                uvec2 rest = texelFetch(uQuads, texel + 2).xy; // color, slot | shift << 8
+
+                // Corners are in order bottom left, bottom right, top right, top left
+                int corner = gl_VertexID % 4;
+                uint u = corner == 1 || corner == 2 ? uv.y & 0xFFFFu : uv.x & 0xFFFFu;
+                uint v = corner >= 2 ? uv.x >> 16 : uv.y >> 16;
+                UV = vec2(u, v) / 65535.0;
+                color = vec4(uvec4(rest.x, rest.x >> 8, rest.x >> 16, rest.x >> 24) & 0xFFu) / 255.0;
+                slot = int(rest.y & 0xFFu);
+                float scale = exp2(-float(rest.y >> 8 & 0xFFu));
+                gl_Position = uProjView * vec4(center + aOffset * scale, 0.0, 1.0);
+            }
+        )", .fragment = R"(
+            #version 330 core
+            out vec4 FragColor;
+            in vec2 UV;
+            flat in vec4 color;
+            flat in int slot;
+            uniform sampler2D uTex[8];
+            void main() {
+                // Note: Samplers can only be indexed by constants, and derivatives are undefined
+                // in branches that differ between neighbouring pixels, so take them first
+                vec2 dx = dFdx(UV);
+                vec2 dy = dFdy(UV);
+                vec4 texel;
+                switch (slot) {
+                    case 0: texel = textureGrad(uTex[0], UV, dx, dy); break;
+                    case 1: texel = textureGrad(uTex[1], UV, dx, dy); break;
+                    case 2: texel = textureGrad(uTex[2], UV, dx, dy); break;
+                    case 3: texel = textureGrad(uTex[3], UV, dx, dy); break;
+                    case 4: texel = textureGrad(uTex[4], UV, dx, dy); break;
+                    case 5: texel = textureGrad(uTex[5], UV, dx, dy); break;
+                    case 6: texel = textureGrad(uTex[6], UV, dx, dy); break;
+                    default: texel = textureGrad(uTex[7], UV, dx, dy); break;
+                }
+                FragColor = texel * color;
+            }
+        )"});
+    }
     assert(shader);
 
+    uProjViewLoc = glGetUniformLocation(shader, "uProjView");
+    uTexLoc = glGetUniformLocation(shader, "uTex");
+
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
     glGenBuffers(1, &ibo);
@@ -40,33 +103,49 @@ BatchRenderer::BatchRenderer(int numQuads) {
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
 
-    // Populate index buffer
-    size_t numIndices = numQuads * 5; // 5 indices per quad (4 + 1 for primitive restart)
-    auto *indices = new GLuint[numIndices];
-    for (size_t i = 0, offset = 0; i < numIndices; i += 5, offset += 4) {
-        indices[i + 0] = offset + 0; // bottom left
-        indices[i + 1] = offset + 3; // top left
-        indices[i + 2] = offset + 1; // bottom right
-        indices[i + 3] = offset + 2; // top right
-        indices[i + 4] = UINT16_MAX;
-    }
-    // Send indices to GPU
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr) (numIndices * sizeof(*indices)), indices, GL_STATIC_DRAW);
-    delete[] indices;
-
-    // Reserve space for vertex data
-    numVertices = numQuads * 4; // 4 vertices per quad
-    vertices = std::make_unique<Vertex[]>(numVertices);
-    // Allocate buffer on GPU
-    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (numVertices * sizeof(Vertex)), nullptr, GL_DYNAMIC_DRAW);
-
-    glEnableVertexAttribArray(aPosLoc); // aPos
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, position));
-    glEnableVertexAttribArray(aUVLoc); // aUV
-    glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, uv));
-    glEnableVertexAttribArray(aColorLoc); // aColor
-    // Normalize color
-    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void *) offsetof(Vertex, color));
+    if (vertexFormat == VertexFormat::Compact) {
+        glGenBuffers(1, &quadBuffer);
+        glGenTextures(1, &quadTexture);
+        assert(quadBuffer && quadTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, quadBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, quadTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, quadBuffer);
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        maxQuads = size_t(maxTexels) / quadTexels;
+
+        // Slot i samples texture unit i, the quad buffer texture comes after them
+        GLint units[textureSlots];
+        for (int i = 0; i < textureSlots; i++) {
+            units[i] = i;
+        }
+        glUseProgram(shader);
+        glUniform1iv(uTexLoc, textureSlots, units);
+        glUniform1i(glGetUniformLocation(shader, "uQuads"), textureSlots);
+    }
+
+    // Reserve space for vertex and index data
+    capacity = BatchCapacity(limitCapacity({.initial = size_t(numQuads)}));
+    numVertices = capacity.capacity() * 4; // 4 vertices per quad
+    allocateGpuBuffers();
+
+    if (vertexFormat == VertexFormat::Standard) {
+        vertices = std::make_unique<Vertex[]>(numVertices);
+
+        glEnableVertexAttribArray(aPosLoc); // aPos
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, position));
+        glEnableVertexAttribArray(aUVLoc); // aUV
+        glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, uv));
+        glEnableVertexAttribArray(aColorLoc); // aColor
+        // Normalize color
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void *) offsetof(Vertex, color));
+    } else {
+        compactVertices = std::make_unique<CompactVertex[]>(numVertices);
+        compactQuads = std::make_unique<CompactQuad[]>(capacity.capacity());
+
+        glEnableVertexAttribArray(aPosLoc); // aOffset
+        glVertexAttribPointer(aPosLoc, 2, GL_SHORT, GL_FALSE, sizeof(CompactVertex), (void *) offsetof(CompactVertex, offset));
+    }
 }
 
 BatchRenderer::BatchRenderer(BatchRenderer &&other) noexcept {
@@ -74,19 +153,38 @@ BatchRenderer::BatchRenderer(BatchRenderer &&other) noexcept {
     vbo = other.vbo;
     ibo = other.ibo;
     shader = other.shader;
+    quadBuffer = other.quadBuffer;
+    quadTexture = other.quadTexture;
+    topology = other.topology;
+    vertexFormat = other.vertexFormat;
+    uProjViewLoc = other.uProjViewLoc;
+    uTexLoc = other.uTexLoc;
+    std::copy(std::begin(other.slotTextures), std::end(other.slotTextures), slotTextures);
+    std::copy(std::begin(other.slotUVScales), std::end(other.slotUVScales), slotUVScales);
+    usedSlots = other.usedSlots;
+    currentSlot = other.currentSlot;
+    maxQuads = other.maxQuads;
     numVertices = other.numVertices;
+    gpuQuads = other.gpuQuads;
+    capacity = other.capacity;
     vertices = std::move(other.vertices);
+    compactVertices = std::move(other.compactVertices);
+    compactQuads = std::move(other.compactQuads);
     drawOffset = other.drawOffset;
-    drawElements = other.drawElements;
+    jobs = other.jobs;
     inUse = other.inUse;
     other.vao = 0;
     other.vbo = 0;
     other.ibo = 0;
     other.shader = 0;
+    other.quadBuffer = 0;
+    other.quadTexture = 0;
     other.numVertices = 0;
+    other.gpuQuads = 0;
     other.vertices = nullptr;
+    other.compactVertices = nullptr;
+    other.compactQuads = nullptr;
     other.drawOffset = 0;
-    other.drawElements = 0;
     other.inUse = false;
 }
 
@@ -95,6 +193,8 @@ BatchRenderer::BatchRenderer(BatchRenderer &&other) noexcept {
 BatchRenderer::~BatchRenderer() {
     glDeleteBuffers(1, &vbo);
     glDeleteBuffers(1, &ibo);
+    glDeleteBuffers(1, &quadBuffer);
+    glDeleteTextures(1, &quadTexture);
     glDeleteVertexArrays(1, &vao);
     glDeleteProgram(shader);
 }
@@ -103,37 +203,44 @@ void BatchRenderer::begin(const glm::mat4 &projView) {
     assert(!inUse);
     inUse = true;
     drawOffset = 0;
-    drawElements = 0;
 
     glBindVertexArray(vao);
+    // Note: Array buffer binding is not part of the VAO, flush uploads into the bound one
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glUseProgram(shader);
-    // Note: Uniform location is cached
-    static GLint uTransformLoc = glGetUniformLocation(shader, "uProjView");
-    glUniformMatrix4fv(uTransformLoc, 1, GL_FALSE, &projView[0][0]);
+    glUniformMatrix4fv(uProjViewLoc, 1, GL_FALSE, &projView[0][0]);
+    currentStats.stateChanges += 4;
 
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
+    currentStats.stateChanges += 3;
 
-    glEnable(GL_PRIMITIVE_RESTART);
-    glPrimitiveRestartIndex(UINT16_MAX);
+    if (topology == Topology::StripRestart) {
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(restartIndex);
+        currentStats.stateChanges += 2;
+    } else {
+        glDisable(GL_PRIMITIVE_RESTART);
+        currentStats.stateChanges++;
+    }
+
+    if (vertexFormat == VertexFormat::Compact) {
+        // Note: Other renderers may have rebound the texture units since the last frame
+        usedSlots = 0;
+        glActiveTexture(GL_TEXTURE0 + textureSlots);
+        glBindTexture(GL_TEXTURE_BUFFER, quadTexture);
+        currentStats.stateChanges += 2;
+    }
 }
 
 void BatchRenderer::drawSprite(const UVRegion &region, glm::vec2 pos, glm::vec2 size, glm::vec2 origin, float rotation, Color color) {
     assert(inUse);
-    if (region.texture != boundSampler) {
-        flush();
-        boundSampler = region.texture;
-        static GLint uTexLoc = glGetUniformLocation(shader, "uTex");
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, region.texture);
-        glUniform1i(uTexLoc, 0);
-
+    bindTexture(region.texture);
+    if (drawOffset >= numVertices && !growBatch(1)) {
+        flush(FlushReason::CapacityFull);
     }
-    if (drawOffset >= numVertices) {
-        flush();
-    }
-
+    currentStats.sprites++;
 
     // Construct model matrix
     // Origin is for rotation
@@ -158,6 +265,12 @@ void BatchRenderer::drawSprite(const UVRegion &region, glm::vec2 pos, glm::vec2
     glm::vec2 topRight = model * glm::vec4(1.0f, 1.0f, 0.0f, 1.0f);
     glm::vec2 topLeft = model * glm::vec4(0.0f, 1.0f, 0.0f, 1.0f);
 #endif
+    if (vertexFormat == VertexFormat::Compact) {
+        writeCompactQuad(drawOffset / 4, region, {bottomLeft, bottomRight, topRight, topLeft}, color);
+        drawOffset += 4;
+        return;
+    }
+
     // Write vertices to buffer
     vertices[drawOffset++] = {
             bottomLeft,
@@ -179,25 +292,356 @@ void BatchRenderer::drawSprite(const UVRegion &region, glm::vec2 pos, glm::vec2
             {region.u0, region.v0},
             color
     };
-    drawElements += 5;
+}
+
+void BatchRenderer::drawSprites(const UVRegion &region, const SpriteSpan &sprites) {
+    assert(inUse);
+    bindTexture(region.texture);
+    currentStats.sprites += sprites.count;
+
+    size_t i = 0;
+    while (i < sprites.count) {
+        if (drawOffset >= numVertices && !growBatch(sprites.count - i)) {
+            flush(FlushReason::CapacityFull);
+        }
+        size_t n = std::min(sprites.count - i, (numVertices - drawOffset) / 4);
+        // Every quad has its own 4 vertices, so ranges can be written in any order
+        size_t firstQuad = drawOffset / 4;
+        size_t first = i;
+        auto generate = [&](size_t begin, size_t end) {
+            for (size_t q = begin; q < end; q++) {
+                size_t sprite = first + q;
+                auto model = buildTransformationMatrix(sprites.positions[sprite], sprites.sizes[sprite],
+                                                       sprites.origins[sprite], sprites.rotations[sprite]);
+                Color color = sprites.colors[sprite];
+                if (vertexFormat == VertexFormat::Compact) {
+                    writeCompactQuad(firstQuad + q, region,
+                                     {model * glm::vec3(0.0f, 0.0f, 1.0f), model * glm::vec3(1.0f, 0.0f, 1.0f),
+                                      model * glm::vec3(1.0f, 1.0f, 1.0f), model * glm::vec3(0.0f, 1.0f, 1.0f)},
+                                     color);
+                    continue;
+                }
+                Vertex *quad = &vertices[(firstQuad + q) * 4];
+                quad[0] = {model * glm::vec3(0.0f, 0.0f, 1.0f), {region.u0, region.v1}, color};
+                quad[1] = {model * glm::vec3(1.0f, 0.0f, 1.0f), {region.u1, region.v1}, color};
+                quad[2] = {model * glm::vec3(1.0f, 1.0f, 1.0f), {region.u1, region.v0}, color};
+                quad[3] = {model * glm::vec3(0.0f, 1.0f, 1.0f), {region.u0, region.v0}, color};
+            }
+        };
+        if (jobs) {
+            jobs->parallelFor(n, jobGrain, generate);
+        } else {
+            generate(0, n);
+        }
+        drawOffset += n * 4;
+        i += n;
+    }
+}
+
+bool BatchRenderer::growBatch(size_t quads) {
+    if (!capacity.grow(drawOffset / 4 + quads)) {
+        return false;
+    }
+    // Note: GPU buffers are reallocated on flush, several grows within a batch need only one
+    numVertices = capacity.capacity() * 4;
+    if (vertexFormat == VertexFormat::Standard) {
+        resizeStaging(vertices, drawOffset, numVertices);
+    } else {
+        resizeStaging(compactVertices, drawOffset, numVertices);
+        resizeStaging(compactQuads, drawOffset / 4, capacity.capacity());
+    }
+    return true;
+}
+
+void BatchRenderer::allocateGpuBuffers() {
+    // Note: Index buffer binding is part of the VAO, which must be bound
+    gpuQuads = capacity.capacity();
+    size_t numIndices = indexCount(topology, gpuQuads);
+    auto indices = std::make_unique_for_overwrite<GLuint[]>(numIndices);
+    generateIndices(topology, gpuQuads, indices.get());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr) (numIndices * sizeof(GLuint)), indices.get(), GL_STATIC_DRAW);
+    currentStats.bytesUploaded += numIndices * sizeof(GLuint);
+
+    size_t vertexSize = vertexFormat == VertexFormat::Standard ? sizeof(Vertex) : sizeof(CompactVertex);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (gpuQuads * 4 * vertexSize), nullptr, GL_DYNAMIC_DRAW);
+    if (vertexFormat == VertexFormat::Compact) {
+        glBindBuffer(GL_TEXTURE_BUFFER, quadBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr) (gpuQuads * sizeof(CompactQuad)), nullptr, GL_DYNAMIC_DRAW);
+    }
+}
+
+void BatchRenderer::setCapacity(const BatchCapacity::Options &options) {
+    assert(!inUse);
+    capacity = BatchCapacity(limitCapacity(options));
+    numVertices = capacity.capacity() * 4;
+    if (vertexFormat == VertexFormat::Standard) {
+        resizeStaging(vertices, 0, numVertices);
+    } else {
+        resizeStaging(compactVertices, 0, numVertices);
+        resizeStaging(compactQuads, 0, capacity.capacity());
+    }
+}
+
+BatchCapacity::Stats BatchRenderer::capacityStats() const {
+    return capacity.stats();
+}
+
+void BatchRenderer::setJobSystem(JobSystem *jobs) {
+    this->jobs = jobs;
+}
+
+void BatchRenderer::bindTexture(GLuint texture) {
+    if (vertexFormat == VertexFormat::Compact) {
+        bindTextureSlot(texture);
+        return;
+    }
+    if (texture == boundSampler) {
+        return;
+    }
+    flush(FlushReason::TextureChange);
+    boundSampler = texture;
+    PhaseTimer::Scope phase{RenderPhase::Bind};
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUniform1i(uTexLoc, 0);
+    currentStats.textureBinds++;
+    currentStats.stateChanges++;
+}
+
+void BatchRenderer::bindTextureSlot(GLuint texture) {
+    if (usedSlots > 0 && slotTextures[currentSlot] == texture) {
+        return;
+    }
+    for (int i = 0; i < usedSlots; i++) {
+        if (slotTextures[i] == texture) {
+            currentSlot = i;
+            return;
+        }
+    }
+    if (usedSlots == textureSlots) {
+        flush(FlushReason::TextureChange);
+        usedSlots = 0;
+    }
+    currentSlot = usedSlots++;
+    slotTextures[currentSlot] = texture;
+    PhaseTimer::Scope phase{RenderPhase::Bind};
+    glActiveTexture(GL_TEXTURE0 + currentSlot);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    GLint width = 0, height = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    slotUVScales[currentSlot] = 65535.0f / glm::vec2(std::max(width, 1), std::max(height, 1));
+    currentStats.textureBinds++;
+    currentStats.stateChanges++;
+}
+
+BatchCapacity::Options BatchRenderer::limitCapacity(BatchCapacity::Options options) const {
+    if (vertexFormat == VertexFormat::Compact) {
+        // Note: GL 3.3 only guarantees 65536 texels in a buffer texture
+        options.initial = std::min(options.initial, maxQuads);
+        options.max = std::min(options.max, maxQuads);
+    }
+    return options;
+}
+
+void BatchRenderer::writeCompactQuad(size_t quad, const UVRegion &region, const glm::vec2 (&corners)[4], Color color) {
+    // Corners are offsets from the unquantized center, with as many fraction bits as the largest one leaves room for.
+    // Offsets below 32 pixels get 1/1024 pixel, finer than the rasterizer snaps vertices to.
+    glm::vec2 center = (corners[0] + corners[2]) * 0.5f;
+    glm::vec2 offsets[4];
+    float largest = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        offsets[i] = corners[i] - center;
+        largest = std::max({largest, std::abs(offsets[i].x), std::abs(offsets[i].y)});
+    }
+    int exponent;
+    std::frexp(largest, &exponent); // largest < 2^exponent
+    int shift = std::clamp(15 - exponent, 0, 24);
+    if (shift > 0 && std::round(std::ldexp(largest, shift)) > float(INT16_MAX)) {
+        shift--;
+    }
+
+    CompactVertex *vertex = &compactVertices[quad * 4];
+    for (int i = 0; i < 4; i++) {
+        // Note: Only quads larger than 32767 pixels get clamped
+        glm::vec2 fixed = glm::round(offsets[i] * std::ldexp(1.0f, shift));
+        vertex[i].offset = glm::i16vec2(glm::clamp(fixed, glm::vec2(-INT16_MAX), glm::vec2(INT16_MAX)));
+    }
+    glm::vec2 uvScale = slotUVScales[currentSlot];
+    glm::vec4 uv = glm::vec4(region.u0, region.v0, region.u1, region.v1) * glm::vec4(uvScale, uvScale);
+    compactQuads[quad] = {
+            .center = center,
+            .uv = glm::u16vec4(glm::round(uv)),
+            .color = color,
+            .slot = uint8_t(currentSlot),
+            .shift = uint8_t(shift),
+            .padding = 0,
+    };
 }
 
 void BatchRenderer::end() {
     assert(inUse);
-    flush();
+    flush(FlushReason::End);
+    endFrameStats();
     inUse = false;
 }
 
-void BatchRenderer::flush() {
+void BatchRenderer::endFrame() {
+    assert(!inUse);
+    if (capacity.endFrame()) {
+        numVertices = capacity.capacity() * 4;
+        if (vertexFormat == VertexFormat::Standard) {
+            resizeStaging(vertices, 0, numVertices);
+        } else {
+            resizeStaging(compactVertices, 0, numVertices);
+        resizeStaging(compactQuads, 0, capacity.capacity());
+        }
+    }
+}
+
+void BatchRenderer::flush(FlushReason reason) {
     assert(inUse);
     if (drawOffset == 0) {
         return;
     }
-    // Send vertex data to GPU
-    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (drawOffset * sizeof(*vertices.get())), vertices.get());
-    glDrawElements(GL_TRIANGLE_STRIP, drawElements, GL_UNSIGNED_INT, (void *)0);
+    capacity.batchFlushed(drawOffset / 4);
+    currentStats.flushes[int(reason)]++;
+    currentStats.drawCalls++;
+    currentStats.vertices += drawOffset;
+    {
+        PhaseTimer::Scope phase{RenderPhase::Upload};
+        if (gpuQuads != capacity.capacity()) {
+            allocateGpuBuffers();
+            capacity.countGpuReallocation();
+        }
+        // Send vertex data to GPU
+        if (vertexFormat == VertexFormat::Standard) {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (drawOffset * sizeof(Vertex)), vertices.get());
+            currentStats.bytesUploaded += drawOffset * sizeof(Vertex);
+        } else {
+            size_t quads = drawOffset / 4;
+            glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (drawOffset * sizeof(CompactVertex)),
+                            compactVertices.get());
+            glBindBuffer(GL_TEXTURE_BUFFER, quadBuffer);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr) (quads * sizeof(CompactQuad)), compactQuads.get());
+            currentStats.bytesUploaded += drawOffset * sizeof(CompactVertex) + quads * sizeof(CompactQuad);
+            currentStats.stateChanges++;
+        }
+    }
+    PhaseTimer::Scope phase{RenderPhase::Draw};
+    glDrawElements(primitiveMode(topology), GLsizei(indexCount(topology, drawOffset / 4)), GL_UNSIGNED_INT, (void *)0);
 
     // Reset draw offset
     drawOffset = 0;
-    drawElements = 0;
+}
+
+size_t BatchRenderer::indexCount(Topology topology, size_t numQuads) {
+    if (numQuads == 0) {
+        return 0;
+    }
+    switch (topology) {
+        case Topology::Triangles:
+            return numQuads * 6;
+        case Topology::StripRestart:
+            return numQuads * 5 - 1; // Last quad doesn't need a restart
+        case Topology::StripDegenerate:
+            return numQuads * 6 - 2; // First quad doesn't need to be stitched
+    }
+    return 0;
+}
+
+void BatchRenderer::generateIndices(Topology topology, size_t numQuads, GLuint *indices) {
+    // Note: Quads are split along the bottom right - top left diagonal, each
+    // triangle uses the same winding as the triangle strip.
+    size_t i = 0;
+    for (GLuint q = 0, offset = 0; q < numQuads; q++, offset += 4) {
+        switch (topology) {
+            case Topology::Triangles:
+                indices[i++] = offset + 0; // bottom left
+                indices[i++] = offset + 3; // top left
+                indices[i++] = offset + 1; // bottom right
+                indices[i++] = offset + 1; // bottom right
+                indices[i++] = offset + 3; // top left
+                indices[i++] = offset + 2; // top right
+                break;
+            case Topology::StripRestart:
+                indices[i++] = offset + 0; // bottom left
+                indices[i++] = offset + 3; // top left
+                indices[i++] = offset + 1; // bottom right
+                indices[i++] = offset + 2; // top right
+                if (q + 1 < numQuads) {
+                    indices[i++] = restartIndex;
+                }
+                break;
+            case Topology::StripDegenerate:
+                if (q > 0) {
+                    // Repeat last vertex of previous quad and first vertex of this quad.
+                    // Keeps the number of indices per quad even so winding is preserved.
+                    indices[i++] = offset - 2; // previous top right
+                    indices[i++] = offset + 0; // bottom left
+                }
+                indices[i++] = offset + 0; // bottom left
+                indices[i++] = offset + 3; // top left
+                indices[i++] = offset + 1; // bottom right
+                indices[i++] = offset + 2; // top right
+                break;
+        }
+    }
+    assert(i == indexCount(topology, numQuads));
+}
+
+GLenum BatchRenderer::primitiveMode(Topology topology) {
+    if (topology == Topology::Triangles) {
+        return GL_TRIANGLES;
+    }
+    return GL_TRIANGLE_STRIP;
+}
+
+const char *BatchRenderer::topologyName(Topology topology) {
+    switch (topology) {
+        case Topology::Triangles:
+            return "triangles";
+        case Topology::StripRestart:
+            return "strip_restart";
+        case Topology::StripDegenerate:
+            return "strip_degenerate";
+    }
+    return "unknown";
+}
+
+const char *BatchRenderer::vertexFormatName(VertexFormat vertexFormat) {
+    switch (vertexFormat) {
+        case VertexFormat::Standard:
+            return "standard";
+        case VertexFormat::Compact:
+            return "compact";
+    }
+    return "unknown";
+}
+
+bool BatchRenderer::parseVertexFormat(const char *str, VertexFormat &vertexFormat) {
+    if (!str) {
+        return false;
+    }
+    for (auto f: {VertexFormat::Standard, VertexFormat::Compact}) {
+        if (strcmp(str, vertexFormatName(f)) == 0) {
+            vertexFormat = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BatchRenderer::parseTopology(const char *str, Topology &topology) {
+    if (!str) {
+        return false;
+    }
+    for (auto t: {Topology::Triangles, Topology::StripRestart, Topology::StripDegenerate}) {
+        if (strcmp(str, topologyName(t)) == 0) {
+            topology = t;
+            return true;
+        }
+    }
+    return false;
 }
@@ -3,6 +3,8 @@
 
 #include <memory>
 #include "../base_renderer.h"
+#include "../job_system.h"
+#include "batch_capacity.h"
 
 class BatchRenderer : public IRenderer {
 private:
@@ -11,13 +13,41 @@ private:
     constexpr static int aColorLoc = 2;
 
 public:
+    enum class Topology {
+        Triangles,       // GL_TRIANGLES, 6 indices per quad
+        StripRestart,    // GL_TRIANGLE_STRIP, 4 indices + primitive restart
+        StripDegenerate, // GL_TRIANGLE_STRIP, 4 indices + 2 for degenerate triangles
+    };
+
     struct Vertex {
         glm::vec2 position; // 8 B
         glm::u16vec2 uv;    // 4 B
         glm::u8vec4 color;  // 4 B
     }; // 16 B total
 
-    explicit BatchRenderer(int numQuads = 4000);
+    enum class VertexFormat {
+        Standard, // Vertex
+        Compact,  // CompactVertex and CompactQuad, 40 B per quad instead of 64 B
+    };
+
+    // Corner of a compact quad, the vertex shader fetches the rest from the CompactQuad at gl_VertexID / 4
+    struct CompactVertex {
+        glm::i16vec2 offset; // 4 B, fixed point relative to the quad center with CompactQuad::shift fraction bits
+    }; // 4 B total
+    static_assert(sizeof(CompactVertex) == 4);
+
+    struct CompactQuad {
+        glm::vec2 center;  // 8 B, unquantized
+        glm::u16vec4 uv;   // 8 B, normalized u0, v0, u1, v1
+        glm::u8vec4 color; // 4 B, flat
+        uint8_t slot;      // texture slot, flat
+        uint8_t shift;     // fraction bits of the corner offsets, as many as the largest offset leaves room for
+        uint16_t padding;
+    }; // 24 B total, 3 RG32UI texels of the quad buffer texture
+    static_assert(sizeof(CompactQuad) == 24);
+
+    explicit BatchRenderer(int numQuads = 4000, Topology topology = Topology::StripRestart,
+                           VertexFormat vertexFormat = VertexFormat::Standard);
 
     BatchRenderer(const BatchRenderer &other) = delete;
     BatchRenderer(BatchRenderer &&other) noexcept;
@@ -26,24 +56,84 @@ public:
 
     void begin(const glm::mat4 &projView) override;
     void drawSprite(const UVRegion &region, glm::vec2 pos, glm::vec2 size, glm::vec2 origin, float rotation, Color color) override;
+    // Vertices are generated on the job system if one is set
+    void drawSprites(const UVRegion &region, const SpriteSpan &sprites) override;
 
     void end() override;
+    void endFrame() override;
+
+    void flush(FlushReason reason = FlushReason::Explicit);
+
+    // Job system for vertex generation in drawSprites, nullptr to generate on the calling thread
+    void setJobSystem(JobSystem *jobs);
+
+    // Capacity in quads, replaces numQuads given to the constructor. Not while in use.
+    void setCapacity(const BatchCapacity::Options &options);
+    [[nodiscard]]
+    BatchCapacity::Stats capacityStats() const;
 
-    void flush();
+    // Index buffer layout for quads with vertices in order: bottom left, bottom right, top right, top left
+    static size_t indexCount(Topology topology, size_t numQuads);
+    static void generateIndices(Topology topology, size_t numQuads, GLuint *indices);
+    static GLenum primitiveMode(Topology topology);
+
+    static const char *topologyName(Topology topology);
+    static bool parseTopology(const char *str, Topology &topology);
+    static const char *vertexFormatName(VertexFormat vertexFormat);
+    static bool parseVertexFormat(const char *str, VertexFormat &vertexFormat);
+
+    constexpr static GLuint restartIndex = UINT32_MAX;
 
 private:
+    // Textures a compact batch can draw from, must match the compact fragment shader
+    constexpr static int textureSlots = 8;
+    // Texels of the quad buffer texture per CompactQuad
+    constexpr static size_t quadTexels = sizeof(CompactQuad) / 8;
+    // Quads per job, smaller ranges are not worth scheduling
+    constexpr static size_t jobGrain = 1024;
+
+    void bindTexture(GLuint texture);
+    // Compact format: selects the slot of texture, binding it to a free one or flushing if all are taken
+    void bindTextureSlot(GLuint texture);
+    // Caps capacity options to what the quad buffer texture can hold
+    BatchCapacity::Options limitCapacity(BatchCapacity::Options options) const;
+    // Grows the current batch to fit quads more, returns false if it is at its maximum capacity
+    bool growBatch(size_t quads);
+    // Resizes vertex and index buffers to capacity, VAO must be bound
+    void allocateGpuBuffers();
+    // Writes quad of the current batch, only touches that quad so jobs can write ranges in parallel
+    void writeCompactQuad(size_t quad, const UVRegion &region, const glm::vec2 (&corners)[4], Color color);
+
     GLuint vao{};
     GLuint vbo{};
     GLuint ibo{};
     GLuint shader{};
+    GLuint quadBuffer{};  // compact format, CompactQuad of every quad
+    GLuint quadTexture{}; // buffer texture of quadBuffer
+
+    GLint uProjViewLoc{};
+    GLint uTexLoc{};
+
+    Topology topology{};
+    VertexFormat vertexFormat{};
 
     GLuint boundSampler{};
+    GLuint slotTextures[textureSlots]{};
+    glm::vec2 slotUVScales[textureSlots]{}; // texels to normalized 16-bit UVs
+    int usedSlots{};
+    int currentSlot{};
+    size_t maxQuads{}; // compact format, quads the quad buffer texture can hold
 
+    BatchCapacity capacity{};
     size_t numVertices{};
+    size_t gpuQuads{}; // capacity of vertex and index buffers
     std::unique_ptr<Vertex[]> vertices{};
+    std::unique_ptr<CompactVertex[]> compactVertices{};
+    std::unique_ptr<CompactQuad[]> compactQuads{};
+
+    size_t drawOffset{};
 
-    int drawOffset{};
-    int drawElements{};
+    JobSystem *jobs{};
 
     bool inUse{};
 };
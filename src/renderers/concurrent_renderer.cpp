@@ -0,0 +1,222 @@
+#include "concurrent_renderer.h"
+
+#include <algorithm>
+#include <cstring>
+#include "../phase_timer.h"
+
+ConcurrentRenderer::Producer::Producer(ConcurrentRenderer *renderer) : renderer(renderer) {
+}
+
+ConcurrentRenderer::Producer::Producer(Producer &&other) noexcept
+        : renderer(other.renderer), cursor(other.cursor), chunkEnd(other.chunkEnd), active(other.active) {
+    other.active = false;
+}
+
+ConcurrentRenderer::Producer::~Producer() {
+    finish();
+}
+
+void ConcurrentRenderer::Producer::start() {
+    assert(!active);
+    active = true;
+    cursor = nullptr;
+    chunkEnd = nullptr;
+    renderer->activeProducers.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ConcurrentRenderer::Producer::drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size,
+                                              glm::vec2 origin, float rotation, Color color) {
+    assert(active);
+    if (cursor == chunkEnd) {
+        // Reserve next chunk, only shared state touched per chunk
+        size_t first = renderer->reserved.fetch_add(renderer->chunkSize, std::memory_order_relaxed);
+        if (first >= renderer->maxInstances) {
+            renderer->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        cursor = renderer->mapped + first;
+        chunkEnd = renderer->mapped + std::min(first + renderer->chunkSize, renderer->maxInstances);
+    }
+
+    GLuint expected = 0;
+    if (!renderer->texture.compare_exchange_strong(expected, region.texture, std::memory_order_relaxed)) {
+        assert(expected == region.texture && "All sprites must use the same texture");
+    }
+
+    *cursor++ = Instance::make(region, position, size, origin, rotation, color);
+}
+
+void ConcurrentRenderer::Producer::finish() {
+    if (!active) {
+        return;
+    }
+    active = false;
+    // Zero size instances in the unused part of the chunk produce no fragments
+    if (cursor != chunkEnd) {
+        memset((void *) cursor, 0, (chunkEnd - cursor) * sizeof(Instance));
+        renderer->padding.fetch_add(chunkEnd - cursor, std::memory_order_relaxed);
+    }
+    cursor = chunkEnd = nullptr;
+    renderer->activeProducers.fetch_sub(1, std::memory_order_release);
+    renderer->activeProducers.notify_all();
+}
+
+ConcurrentRenderer::ConcurrentRenderer(int maxInstances, int chunkSize, bool persistent) {
+    shader = SpriteInstance::compileShader();
+    assert(shader);
+
+    uProjViewLoc = glGetUniformLocation(shader, "uProjView");
+    uTexLoc = glGetUniformLocation(shader, "uTex");
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &instVBO);
+    glGenBuffers(1, &vbo);
+
+    assert(vao && instVBO && vbo);
+
+    glBindVertexArray(vao);
+
+    SpriteInstance::setupVertexArray(vbo);
+
+    // Reserve space for instance data
+    assert(maxInstances > 0 && chunkSize > 0);
+    this->maxInstances = maxInstances;
+    this->chunkSize = chunkSize;
+    this->persistent = persistent && GLAD_GL_ARB_buffer_storage;
+    glBindBuffer(GL_ARRAY_BUFFER, instVBO);
+    if (this->persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr size = (GLsizeiptr) (numRegions * maxInstances * sizeof(Instance));
+        glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        persistentData = (Instance *) glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        assert(persistentData);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (maxInstances * sizeof(Instance)), nullptr, GL_STREAM_DRAW);
+    }
+}
+
+ConcurrentRenderer::~ConcurrentRenderer() {
+    for (auto fence: fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    if (persistent) {
+        glBindBuffer(GL_ARRAY_BUFFER, instVBO);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    glDeleteProgram(shader);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &instVBO);
+    glDeleteVertexArrays(1, &vao);
+}
+
+void ConcurrentRenderer::bindInstanceAttributes(size_t firstInstance) {
+    currentStats.stateChanges += Instance::bindAttributes(instVBO, firstInstance);
+}
+
+void ConcurrentRenderer::begin(const glm::mat4 &projView) {
+    assert(!inUse);
+    inUse = true;
+    reserved.store(0, std::memory_order_relaxed);
+    dropped.store(0, std::memory_order_relaxed);
+    padding.store(0, std::memory_order_relaxed);
+    texture.store(0, std::memory_order_relaxed);
+
+    glBindVertexArray(vao);
+    glUseProgram(shader);
+    glUniformMatrix4fv(uProjViewLoc, 1, GL_FALSE, &projView[0][0]);
+
+    {
+        PhaseTimer::Scope phase{RenderPhase::Upload};
+        glBindBuffer(GL_ARRAY_BUFFER, instVBO);
+        if (persistent) {
+            // Wait until GPU is done reading this region, it was used numRegions frames ago
+            if (fences[region]) {
+                glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(fences[region]);
+                fences[region] = nullptr;
+            }
+            mapped = persistentData + region * maxInstances;
+        } else {
+            // Note: Invalidating orphans the previous frame's storage, so no need to synchronize
+            mapped = (Instance *) glMapBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (maxInstances * sizeof(Instance)),
+                                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            assert(mapped);
+        }
+    }
+    ownProducer.start();
+
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glFrontFace(GL_CCW);
+    currentStats.stateChanges += 7;
+}
+
+void ConcurrentRenderer::drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin,
+                                    float rotation, Color color) {
+    assert(inUse);
+    ownProducer.drawSprite(region, position, size, origin, rotation, color);
+}
+
+ConcurrentRenderer::Producer ConcurrentRenderer::producer() {
+    assert(inUse);
+    Producer p{this};
+    p.start();
+    return p;
+}
+
+void ConcurrentRenderer::end() {
+    assert(inUse);
+    ownProducer.finish();
+    // Wait for all producers to signal
+    int active;
+    while ((active = activeProducers.load(std::memory_order_acquire)) != 0) {
+        activeProducers.wait(active, std::memory_order_acquire);
+    }
+
+    size_t count = std::min(reserved.load(std::memory_order_relaxed), maxInstances);
+    lastDropped = dropped.load(std::memory_order_relaxed);
+
+    {
+        PhaseTimer::Scope phase{RenderPhase::Upload};
+        glBindBuffer(GL_ARRAY_BUFFER, instVBO);
+        if (!persistent) {
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+    }
+    if (count > 0) {
+        bindInstanceAttributes(persistent ? region * maxInstances : 0);
+        {
+            PhaseTimer::Scope phase{RenderPhase::Bind};
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, texture.load(std::memory_order_relaxed));
+            glUniform1i(uTexLoc, 0);
+        }
+        PhaseTimer::Scope phase{RenderPhase::Draw};
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) count);
+        // Note: Producers write straight into the mapped buffer, so everything drawn was uploaded
+        currentStats.sprites += count - padding.load(std::memory_order_relaxed);
+        currentStats.instances += count;
+        currentStats.bytesUploaded += count * sizeof(Instance);
+        currentStats.drawCalls++;
+        currentStats.textureBinds++;
+        currentStats.stateChanges++;
+        currentStats.flushes[int(FlushReason::End)]++;
+    }
+    if (persistent) {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region = (region + 1) % numRegions;
+    }
+    mapped = nullptr;
+    endFrameStats();
+    inUse = false;
+}
+
+bool ConcurrentRenderer::isPersistent() const {
+    return persistent;
+}
+
+size_t ConcurrentRenderer::droppedCount() const {
+    return lastDropped;
+}
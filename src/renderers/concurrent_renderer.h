@@ -0,0 +1,90 @@
+#ifndef DIPLOMA_CONCURRENT_RENDERER_H
+#define DIPLOMA_CONCURRENT_RENDERER_H
+
+#include <atomic>
+#include "../base_renderer.h"
+#include "sprite_instance.h"
+
+// For sprites whose draw order does not matter (eg. additive particles), all sprites must use one texture.
+// Any number of threads append instances directly into a mapped buffer between begin() and end(),
+// slots are reserved in chunks with an atomic fetch-add. end() waits for all producers to finish, then draws.
+// Uses a persistently mapped buffer when GL_ARB_buffer_storage is available, otherwise maps each frame.
+class ConcurrentRenderer : public IRenderer {
+private:
+    // Persistent buffer is split into regions, so CPU writes one while GPU reads another
+    constexpr static int numRegions = 3;
+public:
+    using Instance = SpriteInstance;
+
+    // Appends sprites from one thread, finishes when destroyed.
+    class Producer {
+    public:
+        Producer(Producer &&other) noexcept;
+        Producer(const Producer &other) = delete;
+        ~Producer();
+
+        void drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin, float rotation, Color color);
+        // Signals renderer that this producer is done, unused reserved slots are cleared
+        void finish();
+
+    private:
+        friend class ConcurrentRenderer;
+        explicit Producer(ConcurrentRenderer *renderer);
+        void start();
+
+        ConcurrentRenderer *renderer;
+        Instance *cursor{};
+        Instance *chunkEnd{};
+        bool active{};
+    };
+
+    explicit ConcurrentRenderer(int maxInstances = 4000, int chunkSize = 256, bool persistent = true);
+    ~ConcurrentRenderer() override;
+
+    void begin(const glm::mat4 &projView) override;
+    // Appends on the calling thread
+    void drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin, float rotation, Color color) override;
+    void end() override;
+
+    // Thread safe, only between begin() and end()
+    Producer producer();
+
+    [[nodiscard]]
+    bool isPersistent() const;
+    // Sprites that did not fit into the buffer in the last frame
+    [[nodiscard]]
+    size_t droppedCount() const;
+
+private:
+    void bindInstanceAttributes(size_t firstInstance);
+
+    GLuint vao{};
+    GLuint instVBO{};
+    GLuint vbo{};
+    GLuint shader{};
+
+    GLint uProjViewLoc{};
+    GLint uTexLoc{};
+
+    size_t maxInstances{};
+    size_t chunkSize{};
+
+    bool persistent{};
+    Instance *persistentData{};
+    GLsync fences[numRegions]{};
+    int region{};
+
+    // Current frame
+    Instance *mapped{};
+    std::atomic<size_t> reserved{};
+    std::atomic<int> activeProducers{};
+    std::atomic<size_t> dropped{};
+    std::atomic<size_t> padding{}; // cleared slots at the ends of chunks
+    std::atomic<GLuint> texture{};
+    Producer ownProducer{this}; // for drawSprite
+    size_t lastDropped{};
+
+    bool inUse{};
+};
+
+#endif //DIPLOMA_CONCURRENT_RENDERER_H
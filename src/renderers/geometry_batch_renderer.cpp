@@ -1,5 +1,7 @@
 #include "geometry_batch_renderer.h"
 
+#include "../phase_timer.h"
+
 GeometryBatchRenderer::GeometryBatchRenderer(int numQuads) {
     shader = compileShaderProgram({.vertex = R"(
         #version 330 core
@@ -10,36 +12,30 @@ GeometryBatchRenderer::GeometryBatchRenderer(int numQuads) {
         layout (location = 4) in vec4 aColor;
         layout (location = 5) in vec2 aUV[4]; // Location 5, 6, 7, 8
 
-        uniform mat4 uProjView;
-
         out VertexStage {
             vec4 color;
             vec2 UV[4];
-            mat4 mvp;
+            mat3 model;
         } vertex;
 
-        mat4 buildMatrix(const vec2 pos, const vec2 size,
+        mat3 buildMatrix(const vec2 pos, const vec2 size,
                          const vec2 origin, const float rot) {
             float c = cos(rot);
             float s = sin(rot);
 
             // Note: column-major order
-            mat4 mat = mat4(1.0,              0.0,              0.0, 0.0,
-                            0.0,              1.0,              0.0, 0.0,
-                            0.0,              0.0,              1.0, 0.0,
-                            pos.x + origin.x, pos.y + origin.y, 0.0, 1.0);
-            mat = mat * mat4(c,   s,   0.0, 0.0,
-                             -s,  c,   0.0, 0.0,
-                             0.0, 0.0, 0.0, 0.0,
-                             0.0, 0.0, 0.0, 1.0);
-            mat = mat * mat4(1.0,       0.0,       0.0, 0.0,
-                             0.0,       1.0,       0.0, 0.0,
-                             0.0,       0.0,       0.0, 0.0,
-                             -origin.x, -origin.y, 0.0, 1.0);
-            mat = mat * mat4(size.x, 0.0,    0.0, 0.0,
-                             0.0,    size.y, 0.0, 0.0,
-                             0.0,    0.0,    0.0, 0.0,
-                             0.0,    0.0,    0.0, 1.0);
+            mat3 mat = mat3(1.0,              0.0,              0.0,
+                            0.0,              1.0,              0.0,
+                            pos.x + origin.x, pos.y + origin.y, 1.0);
+            mat = mat * mat3(c,   s,   0.0,
+                             -s,  c,   0.0,
+                             0.0, 0.0, 1.0) ;
+            mat = mat * mat3(1.0,       0.0,       0.0,
+                             0.0,       1.0,       0.0,
+                             -origin.x, -origin.y, 1.0);
+            mat = mat * mat3(size.x, 0.0,    0.0,
+                             0.0,    size.y, 0.0,
+                             0.0,    0.0,    1.0);
             return mat;
         }
 
@@ -48,7 +44,9 @@ GeometryBatchRenderer::GeometryBatchRenderer(int numQuads) {
             for (int i = 0; i < 4; i++) {
                 vertex.UV[i] = aUV[i];
             }
-            vertex.mvp = uProjView * buildMatrix(aPos, aSize, aOrigin, aRotation);
+            // Note: Corners are transformed in the geometry shader the same way as in the instanced renderers,
+            // projection is applied per corner, so rounding and texel edge ties match them
+            vertex.model = buildMatrix(aPos, aSize, aOrigin, aRotation);
         }
 
     )", .fragment = R"(
@@ -68,6 +66,8 @@ GeometryBatchRenderer::GeometryBatchRenderer(int numQuads) {
         layout(points) in;
         layout(triangle_strip, max_vertices = 4) out;
 
+        uniform mat4 uProjView;
+
         uniform sampler2D uTex;
 
         out vec2 UV;
@@ -76,21 +76,21 @@ GeometryBatchRenderer::GeometryBatchRenderer(int numQuads) {
         in VertexStage {
             vec4 color;
             vec2 UV[4];
-            mat4 mvp;
+            mat3 model;
         } vertex[];
 
         void main() {
             const vec2 positions[4] = vec2[4](
-                vec2(1.0, 0.0), // Bottom right
                 vec2(0.0, 0.0), // Bottom left
-                vec2(1.0, 1.0), // Top right
-                vec2(0.0, 1.0)  // Top left
+                vec2(0.0, 1.0), // Top left
+                vec2(1.0, 0.0), // Bottom right
+                vec2(1.0, 1.0)  // Top right
             );
 
             color = vertex[0].color;
             vec2 texSize = textureSize(uTex, 0);
             for (int i = 0; i < 4; i++) {
-                gl_Position = vertex[0].mvp * vec4(positions[i], 0.0, 1.0);
+                gl_Position = uProjView * vec4(vertex[0].model * vec3(positions[i], 1.0), 1.0);
                 UV = vertex[0].UV[i] / texSize;
                 EmitVertex();
             }
@@ -106,9 +106,11 @@ GeometryBatchRenderer::GeometryBatchRenderer(int numQuads) {
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     // Reserve space for vertex data on CPU
-    numVertices = numQuads;
+    capacity = BatchCapacity({.initial = size_t(numQuads)});
+    numVertices = capacity.capacity();
     vertices = std::make_unique<Vertex[]>(numVertices);
     // Allocate buffer on GPU
+    gpuVertices = numVertices;
     glBufferData(GL_ARRAY_BUFFER, GLsizeiptr (numVertices * sizeof(*vertices.get())), nullptr, GL_DYNAMIC_DRAW);
 
     glEnableVertexAttribArray(aPosLoc); // aPos
@@ -138,6 +140,8 @@ void GeometryBatchRenderer::begin(const glm::mat4 &projView) {
     inUse = true;
 
     glBindVertexArray(vao);
+    // Note: Array buffer binding is not part of the VAO, flush uploads into the bound one
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glUseProgram(shader);
 
     glEnable(GL_CULL_FACE);
@@ -146,23 +150,27 @@ void GeometryBatchRenderer::begin(const glm::mat4 &projView) {
 
     static GLint uProjViewLoc = glGetUniformLocation(shader, "uProjView");
     glUniformMatrix4fv(uProjViewLoc, 1, GL_FALSE, &projView[0][0]);
+    currentStats.stateChanges += 7;
 }
 
 void GeometryBatchRenderer::drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin, float rotation,
                                   Color color) {
     assert(inUse);
     if (region.texture != boundSampler) {
-        flush();
+        flush(FlushReason::TextureChange);
         boundSampler = region.texture;
         static GLint uTexLoc = glGetUniformLocation(shader, "uTex");
+        PhaseTimer::Scope phase{RenderPhase::Bind};
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, region.texture);
         glUniform1i(uTexLoc, 0);
-
+        currentStats.textureBinds++;
+        currentStats.stateChanges++;
     }
-    if (drawOffset >= numVertices) {
-        flush();
+    if (drawOffset >= numVertices && !growBatch()) {
+        flush(FlushReason::CapacityFull);
     }
+    currentStats.sprites++;
 
     const Vertex vertex = {
             .position = position,
@@ -171,9 +179,11 @@ void GeometryBatchRenderer::drawSprite(const UVRegion &region, glm::vec2 positio
             .rotation = rotation,
             .color = color,
             .uv = {
+                    // Note: Strip corner order of the geometry shader: bottom left, top left, bottom right, top right,
+                    // the same split diagonal as the other renderers, so ties at texel edges sample the same texel
                     {region.u0, region.v1},
-                    {region.u1, region.v1},
                     {region.u0, region.v0},
+                    {region.u1, region.v1},
                     {region.u1, region.v0},
             },
     };
@@ -183,18 +193,63 @@ void GeometryBatchRenderer::drawSprite(const UVRegion &region, glm::vec2 positio
 
 void GeometryBatchRenderer::end() {
     assert(inUse);
-    flush();
+    flush(FlushReason::End);
+    endFrameStats();
     inUse = false;
 }
 
-void GeometryBatchRenderer::flush() {
+void GeometryBatchRenderer::endFrame() {
+    assert(!inUse);
+    if (capacity.endFrame()) {
+        numVertices = capacity.capacity();
+        resizeStaging(vertices, 0, numVertices);
+    }
+}
+
+bool GeometryBatchRenderer::growBatch() {
+    if (!capacity.grow(drawOffset + 1)) {
+        return false;
+    }
+    // Note: GPU buffer is reallocated on flush, several grows within a batch need only one
+    numVertices = capacity.capacity();
+    resizeStaging(vertices, drawOffset, numVertices);
+    return true;
+}
+
+void GeometryBatchRenderer::setCapacity(const BatchCapacity::Options &options) {
+    assert(!inUse);
+    capacity = BatchCapacity(options);
+    numVertices = capacity.capacity();
+    resizeStaging(vertices, 0, numVertices);
+}
+
+BatchCapacity::Stats GeometryBatchRenderer::capacityStats() const {
+    return capacity.stats();
+}
+
+void GeometryBatchRenderer::flush(FlushReason reason) {
     assert(inUse);
     if (drawOffset == 0) {
         return;
     }
-    // Send vertex data to GPU
-    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (drawOffset * sizeof(*vertices.get())), vertices.get());
-    glDrawArrays(GL_POINTS, 0, drawOffset);
+    capacity.batchFlushed(drawOffset);
+    currentStats.flushes[int(reason)]++;
+    currentStats.drawCalls++;
+    currentStats.vertices += drawOffset;
+    currentStats.bytesUploaded += drawOffset * sizeof(Vertex);
+    {
+        PhaseTimer::Scope phase{RenderPhase::Upload};
+        if (gpuVertices != capacity.capacity()) {
+            gpuVertices = capacity.capacity();
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferData(GL_ARRAY_BUFFER, GLsizeiptr (gpuVertices * sizeof(Vertex)), nullptr, GL_DYNAMIC_DRAW);
+            capacity.countGpuReallocation();
+        }
+        // Send vertex data to GPU
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (drawOffset * sizeof(*vertices.get())), vertices.get());
+    }
+    PhaseTimer::Scope phase{RenderPhase::Draw};
+    glDrawArrays(GL_POINTS, 0, GLsizei(drawOffset));
 
     drawOffset = 0;
 }
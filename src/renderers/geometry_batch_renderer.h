@@ -3,6 +3,7 @@
 
 #include <memory>
 #include "../base_renderer.h"
+#include "batch_capacity.h"
 
 class GeometryBatchRenderer : public IRenderer{
 public:
@@ -23,8 +24,14 @@ public:
     void begin(const glm::mat4 &projView) override;
     void drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin, float rotation, Color color) override;
     void end() override;
+    void endFrame() override;
 
-    void flush();
+    void flush(FlushReason reason = FlushReason::Explicit);
+
+    // Capacity in quads, replaces numQuads given to the constructor. Not while in use.
+    void setCapacity(const BatchCapacity::Options &options);
+    [[nodiscard]]
+    BatchCapacity::Stats capacityStats() const;
 
 private:
     constexpr static int aPosLoc = 0;
@@ -35,16 +42,21 @@ private:
     constexpr static int aUVLoc = 5; // array of 4
     // Total of 9 attributes
 
+    // Grows the current batch by at least one quad, returns false if it is at its maximum capacity
+    bool growBatch();
+
     GLuint shader = 0;
     GLuint vao = 0;
     GLuint vbo = 0;
 
     GLuint boundSampler = 0;
 
+    BatchCapacity capacity{};
     size_t numVertices = 0;
+    size_t gpuVertices = 0; // capacity of the vertex buffer
     std::unique_ptr<Vertex[]> vertices;
 
-    int drawOffset = 0;
+    size_t drawOffset = 0;
 
     bool inUse = false;
 };
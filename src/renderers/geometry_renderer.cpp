@@ -1,5 +1,7 @@
 #include "geometry_renderer.h"
 
+#include "../phase_timer.h"
+
 GeometryRenderer::GeometryRenderer() {
     shader = compileShaderProgram({.vertex = R"(
         #version 330 core
@@ -10,36 +12,30 @@ GeometryRenderer::GeometryRenderer() {
         layout (location = 4) in vec4 aColor;
         layout (location = 5) in vec2 aUV[4]; // Location 5, 6, 7, 8
 
-        uniform mat4 uProjView;
-
         out VertexStage {
             vec4 color;
             vec2 UV[4];
-            mat4 mvp;
+            mat3 model;
         } vertex;
 
-        mat4 buildMatrix(const vec2 pos, const vec2 size,
+        mat3 buildMatrix(const vec2 pos, const vec2 size,
                          const vec2 origin, const float rot) {
             float c = cos(rot);
             float s = sin(rot);
 
             // Note: column-major order
-            mat4 mat = mat4(1.0,              0.0,              0.0, 0.0,
-                            0.0,              1.0,              0.0, 0.0,
-                            0.0,              0.0,              1.0, 0.0,
-                            pos.x + origin.x, pos.y + origin.y, 0.0, 1.0);
-            mat = mat * mat4(c,   s,   0.0, 0.0,
-                             -s,  c,   0.0, 0.0,
-                             0.0, 0.0, 0.0, 0.0,
-                             0.0, 0.0, 0.0, 1.0);
-            mat = mat * mat4(1.0,       0.0,       0.0, 0.0,
-                             0.0,       1.0,       0.0, 0.0,
-                             0.0,       0.0,       0.0, 0.0,
-                             -origin.x, -origin.y, 0.0, 1.0);
-            mat = mat * mat4(size.x, 0.0,    0.0, 0.0,
-                             0.0,    size.y, 0.0, 0.0,
-                             0.0,    0.0,    0.0, 0.0,
-                             0.0,    0.0,    0.0, 1.0);
+            mat3 mat = mat3(1.0,              0.0,              0.0,
+                            0.0,              1.0,              0.0,
+                            pos.x + origin.x, pos.y + origin.y, 1.0);
+            mat = mat * mat3(c,   s,   0.0,
+                             -s,  c,   0.0,
+                             0.0, 0.0, 1.0) ;
+            mat = mat * mat3(1.0,       0.0,       0.0,
+                             0.0,       1.0,       0.0,
+                             -origin.x, -origin.y, 1.0);
+            mat = mat * mat3(size.x, 0.0,    0.0,
+                             0.0,    size.y, 0.0,
+                             0.0,    0.0,    1.0);
             return mat;
         }
 
@@ -48,7 +44,9 @@ GeometryRenderer::GeometryRenderer() {
             for (int i = 0; i < 4; i++) {
                 vertex.UV[i] = aUV[i];
             }
-            vertex.mvp = uProjView * buildMatrix(aPos, aSize, aOrigin, aRotation);
+            // Note: Corners are transformed in the geometry shader the same way as in the instanced renderers,
+            // projection is applied per corner, so rounding and texel edge ties match them
+            vertex.model = buildMatrix(aPos, aSize, aOrigin, aRotation);
         }
     )", .fragment = R"(
         #version 330 core
@@ -67,6 +65,8 @@ GeometryRenderer::GeometryRenderer() {
         layout(points) in;
         layout(triangle_strip, max_vertices = 4) out;
 
+        uniform mat4 uProjView;
+
         out vec2 UV;
         out vec4 color;
 
@@ -75,21 +75,21 @@ GeometryRenderer::GeometryRenderer() {
         in VertexStage {
             vec4 color;
             vec2 UV[4];
-            mat4 mvp;
+            mat3 model;
         } vertex[];
 
         void main() {
             const vec2 positions[4] = vec2[4](
-                vec2(1.0, 0.0), // Bottom right
                 vec2(0.0, 0.0), // Bottom left
-                vec2(1.0, 1.0), // Top right
-                vec2(0.0, 1.0)  // Top left
+                vec2(0.0, 1.0), // Top left
+                vec2(1.0, 0.0), // Bottom right
+                vec2(1.0, 1.0)  // Top right
             );
 
             color = vertex[0].color;
             vec2 texSize = textureSize(uTex, 0);
             for (int i = 0; i < 4; i++) {
-                gl_Position = vertex[0].mvp * vec4(positions[i], 0.0, 1.0);
+                gl_Position = uProjView * vec4(vertex[0].model * vec3(positions[i], 1.0), 1.0);
                 UV = vertex[0].UV[i] / texSize;
                 EmitVertex();
             }
@@ -138,14 +138,20 @@ void GeometryRenderer::begin(const glm::mat4 &projView) {
 
     static GLint uProjViewLoc = glGetUniformLocation(shader, "uProjView");
     glUniformMatrix4fv(uProjViewLoc, 1, GL_FALSE, &projView[0][0]);
+    currentStats.stateChanges += 6;
 }
 
 void GeometryRenderer::drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin, float rotation,
                                   Color color) {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, region.texture);
-    static GLint texLoc = glGetUniformLocation(shader, "tex");
-    glUniform1i(texLoc, 0);
+    {
+        PhaseTimer::Scope phase{RenderPhase::Bind};
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, region.texture);
+        static GLint texLoc = glGetUniformLocation(shader, "tex");
+        glUniform1i(texLoc, 0);
+    }
+    currentStats.textureBinds++;
+    currentStats.stateChanges++;
     Vertex vertex = {
         .position = position,
         .size = size,
@@ -153,18 +159,28 @@ void GeometryRenderer::drawSprite(const UVRegion &region, glm::vec2 position, gl
         .rotation = rotation,
         .color = color,
         .uv = {
+            // Note: Strip corner order of the geometry shader: bottom left, top left, bottom right, top right,
+            // the same split diagonal as the other renderers, so ties at texel edges sample the same texel
             {region.u0, region.v1},
-            {region.u1, region.v1},
             {region.u0, region.v0},
+            {region.u1, region.v1},
             {region.u1, region.v0},
         },
     };
 
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertex), &vertex);
+    {
+        PhaseTimer::Scope phase{RenderPhase::Upload};
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertex), &vertex);
+    }
+    PhaseTimer::Scope phase{RenderPhase::Draw};
     glDrawArrays(GL_POINTS, 0, 1);
+    currentStats.drawCalls++;
+    currentStats.sprites++;
+    currentStats.vertices++;
+    currentStats.bytesUploaded += sizeof(Vertex);
 
 }
 
 void GeometryRenderer::end() {
-
+    endFrameStats();
 }
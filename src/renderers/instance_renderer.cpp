@@ -1,63 +1,132 @@
 #include "instance_renderer.h"
 
-InstanceRenderer::InstanceRenderer(int maxInstances) {
-    shader = compileShaderProgram({.vertex = R"(
-        #version 330 core
-        layout (location = 0) in vec2 aPos;
-        layout (location = 1) in vec2 aInstPos;
-        layout (location = 2) in vec2 aInstSize;
-        layout (location = 3) in vec2 aInstOrigin;
-        layout (location = 4) in float aInstRotation;
-        layout (location = 5) in vec4 aInstColor;
-        layout (location = 6) in vec2 aInstUV[4]; // loc: 6, 7, 8, 9
-
-        out vec2 UV;
-        out vec4 color;
-        uniform mat4 uProjView;
-        uniform sampler2D uTex;
-
-        mat3 buildMatrix(const vec2 pos, const vec2 size,
-                         const vec2 origin, const float rot) {
-            float c = cos(rot);
-            float s = sin(rot);
-
-            // Note: column-major order
-            mat3 mat = mat3(1.0,              0.0,              0.0,
-                            0.0,              1.0,              0.0,
-                            pos.x + origin.x, pos.y + origin.y, 1.0);
-            mat = mat * mat3(c,   s,   0.0,
-                             -s,  c,   0.0,
-                             0.0, 0.0, 1.0) ;
-            mat = mat * mat3(1.0,       0.0,       0.0,
-                             0.0,       1.0,       0.0,
-                             -origin.x, -origin.y, 1.0);
-            mat = mat * mat3(size.x, 0.0,    0.0,
-                             0.0,    size.y, 0.0,
-                             0.0,    0.0,    1.0);
-            return mat;
-        }
+#include <algorithm>
+#include <cstring>
+#include "../phase_timer.h"
 
-        void main() {
-            vec2 texSize = textureSize(uTex, 0);
-            UV = aInstUV[gl_VertexID] / texSize;
-            color = aInstColor;
+InstanceRenderer::InstanceRenderer(int maxInstances, Layout layout) : layout(layout) {
+    if (layout == Layout::Full) {
+        shader = compileShaderProgram({.vertex = R"(
+            #version 330 core
+            layout (location = 0) in vec2 aPos;
+            layout (location = 1) in vec2 aInstPos;
+            layout (location = 2) in vec2 aInstSize;
+            layout (location = 3) in vec2 aInstOrigin;
+            layout (location = 4) in float aInstRotation;
+            layout (location = 5) in vec4 aInstColor;
+            layout (location = 6) in vec2 aInstUV[4]; // loc: 6, 7, 8, 9
 
-            mat3 model = buildMatrix(aInstPos, aInstSize, aInstOrigin, aInstRotation);
+            out vec2 UV;
+            out vec4 color;
+            uniform mat4 uProjView;
+            uniform sampler2D uTex;
 
-            gl_Position = uProjView * vec4(model * vec3(aPos, 1.0), 1.0);
-        }
-    )", .fragment = R"(
-        #version 330 core
-        out vec4 FragColor;
-        in vec2 UV;
-        in vec4 color;
-        uniform sampler2D uTex;
-        void main() {
-            FragColor = texture(uTex, UV) * color;
-        }
-    )"});
+            mat3 buildMatrix(const vec2 pos, const vec2 size,
+                             const vec2 origin, const float rot) {
+                float c = cos(rot);
+                float s = sin(rot);
+
+                // Note: column-major order
+                mat3 mat = mat3(1.0,              0.0,              0.0,
+                                0.0,              1.0,              0.0,
+                                pos.x + origin.x, pos.y + origin.y, 1.0);
+                mat = mat * mat3(c,   s,   0.0,
+                                 -s,  c,   0.0,
+                                 0.0, 0.0, 1.0) ;
+                mat = mat * mat3(1.0,       0.0,       0.0,
+                                 0.0,       1.0,       0.0,
+                                 -origin.x, -origin.y, 1.0);
+                mat = mat * mat3(size.x, 0.0,    0.0,
+                                 0.0,    size.y, 0.0,
+                                 0.0,    0.0,    1.0);
+                return mat;
+            }
+
+            void main() {
+                vec2 texSize = textureSize(uTex, 0);
+                UV = aInstUV[gl_VertexID] / texSize;
+                color = aInstColor;
+
+                mat3 model = buildMatrix(aInstPos, aInstSize, aInstOrigin, aInstRotation);
+
+                gl_Position = uProjView * vec4(model * vec3(aPos, 1.0), 1.0);
+            }
+        )", .fragment = R"(
+            #version 330 core
+            out vec4 FragColor;
+            in vec2 UV;
+            in vec4 color;
+            uniform sampler2D uTex;
+            void main() {
+                FragColor = texture(uTex, UV) * color;
+            }
+        )"});
+    } else {
+        shader = compileShaderProgram({.vertex = R"(
+            #version 330 core
+            layout (location = 0) in vec2 aPos;
+            layout (location = 1) in vec2 aInstPos;
+            layout (location = 2) in vec2 aInstSize;
+            layout (location = 3) in vec2 aInstOrigin;
+            layout (location = 4) in float aInstRotation;
+            layout (location = 5) in vec4 aInstColor;
+            layout (location = 6) in vec4 aInstUVRect; // u0, v0, u1, v1
+
+            out vec2 UV;
+            out vec4 color;
+            uniform mat4 uProjView;
+            uniform sampler2D uTex;
+            uniform float uRotationScale; // pi for snorm rotation, 1 for radians
+
+            mat3 buildMatrix(const vec2 pos, const vec2 size,
+                             const vec2 origin, const float rot) {
+                float c = cos(rot);
+                float s = sin(rot);
+
+                // Note: column-major order
+                mat3 mat = mat3(1.0,              0.0,              0.0,
+                                0.0,              1.0,              0.0,
+                                pos.x + origin.x, pos.y + origin.y, 1.0);
+                mat = mat * mat3(c,   s,   0.0,
+                                 -s,  c,   0.0,
+                                 0.0, 0.0, 1.0) ;
+                mat = mat * mat3(1.0,       0.0,       0.0,
+                                 0.0,       1.0,       0.0,
+                                 -origin.x, -origin.y, 1.0);
+                mat = mat * mat3(size.x, 0.0,    0.0,
+                                 0.0,    size.y, 0.0,
+                                 0.0,    0.0,    1.0);
+                return mat;
+            }
+
+            void main() {
+                vec2 texSize = textureSize(uTex, 0);
+                // aPos is (0, 0) in bottom left and (1, 1) in top right corner
+                UV = vec2(mix(aInstUVRect.x, aInstUVRect.z, aPos.x),
+                          mix(aInstUVRect.w, aInstUVRect.y, aPos.y)) / texSize;
+                color = aInstColor;
+
+                mat3 model = buildMatrix(aInstPos, aInstSize, aInstOrigin, aInstRotation * uRotationScale);
+
+                gl_Position = uProjView * vec4(model * vec3(aPos, 1.0), 1.0);
+            }
+        )", .fragment = R"(
+            #version 330 core
+            out vec4 FragColor;
+            in vec2 UV;
+            in vec4 color;
+            uniform sampler2D uTex;
+            void main() {
+                FragColor = texture(uTex, UV) * color;
+            }
+        )"});
+    }
     assert(shader);
 
+    uProjViewLoc = glGetUniformLocation(shader, "uProjView");
+    uTexLoc = glGetUniformLocation(shader, "uTex");
+    uRotationScaleLoc = glGetUniformLocation(shader, "uRotationScale");
+
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &instVBO);
     glGenBuffers(1, &vbo);
@@ -81,40 +150,108 @@ InstanceRenderer::InstanceRenderer(int maxInstances) {
 
     // Reserve space for instance data
     glBindBuffer(GL_ARRAY_BUFFER, instVBO);
-    this->maxInstances = maxInstances;
-    instanceData = std::make_unique<Instance[]>(maxInstances);
+    capacity = BatchCapacity({.initial = size_t(maxInstances)});
+    this->maxInstances = capacity.capacity();
+    resizeInstanceData(0);
+    if (layout == Layout::Split) {
+        staticStream = std::make_unique<StaticInstanceStream<StaticInstance>>();
+    }
     // Allocate buffer on GPU
-    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (maxInstances * sizeof(Instance)), nullptr, GL_DYNAMIC_DRAW);
+    gpuInstances = this->maxInstances;
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (gpuInstances * instanceSize(layout)), nullptr, GL_DYNAMIC_DRAW);
 
     // Instance attributes
-    glEnableVertexAttribArray(aInstPosLoc);
-    glVertexAttribPointer(aInstPosLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, pos)));
-    glVertexAttribDivisor(aInstPosLoc, 1);
+    if (layout == Layout::Full) {
+        glEnableVertexAttribArray(aInstPosLoc);
+        glVertexAttribPointer(aInstPosLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, pos)));
+        glVertexAttribDivisor(aInstPosLoc, 1);
+
+        glEnableVertexAttribArray(aInstSizeLoc);
+        glVertexAttribPointer(aInstSizeLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, size)));
+        glVertexAttribDivisor(aInstSizeLoc, 1);
+
+        glEnableVertexAttribArray(aInstOriginLoc);
+        glVertexAttribPointer(aInstOriginLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, origin)));
+        glVertexAttribDivisor(aInstOriginLoc, 1);
 
-    glEnableVertexAttribArray(aInstSizeLoc);
-    glVertexAttribPointer(aInstSizeLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, size)));
-    glVertexAttribDivisor(aInstSizeLoc, 1);
+        glEnableVertexAttribArray(aInstRotationLoc);
+        glVertexAttribPointer(aInstRotationLoc, 1, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, rotation)));
+        glVertexAttribDivisor(aInstRotationLoc, 1);
 
-    glEnableVertexAttribArray(aInstOriginLoc);
-    glVertexAttribPointer(aInstOriginLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, origin)));
-    glVertexAttribDivisor(aInstOriginLoc, 1);
+        glEnableVertexAttribArray(aInstColorLoc);
+        glVertexAttribPointer(aInstColorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void *) (offsetof(Instance, color)));
+        glVertexAttribDivisor(aInstColorLoc, 1);
+
+        for (int i = 0; i < 4; i++) {
+            glEnableVertexAttribArray(aInstUVLoc + i);
+            glVertexAttribPointer(aInstUVLoc + i, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Instance),
+                                  (void *) (offsetof(Instance, uv) + i * sizeof(glm::u16vec2)));
+            glVertexAttribDivisor(aInstUVLoc + i, 1);
+        }
+    } else if (layout == Layout::Half) {
+        glEnableVertexAttribArray(aInstPosLoc);
+        glVertexAttribPointer(aInstPosLoc, 2, GL_FLOAT, GL_FALSE, sizeof(HalfInstance), (void *) (offsetof(HalfInstance, pos)));
+        glVertexAttribDivisor(aInstPosLoc, 1);
 
-    glEnableVertexAttribArray(aInstRotationLoc);
-    glVertexAttribPointer(aInstRotationLoc, 1, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, rotation)));
-    glVertexAttribDivisor(aInstRotationLoc, 1);
+        glEnableVertexAttribArray(aInstSizeLoc);
+        glVertexAttribPointer(aInstSizeLoc, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(HalfInstance), (void *) (offsetof(HalfInstance, size)));
+        glVertexAttribDivisor(aInstSizeLoc, 1);
 
-    glEnableVertexAttribArray(aInstColorLoc);
-    glVertexAttribPointer(aInstColorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void *) (offsetof(Instance, color)));
-    glVertexAttribDivisor(aInstColorLoc, 1);
+        glEnableVertexAttribArray(aInstOriginLoc);
+        glVertexAttribPointer(aInstOriginLoc, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(HalfInstance), (void *) (offsetof(HalfInstance, origin)));
+        glVertexAttribDivisor(aInstOriginLoc, 1);
 
-    for (int i = 0; i < 4; i++) {
-        glEnableVertexAttribArray(aInstUVLoc + i);
-        glVertexAttribPointer(aInstUVLoc + i, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Instance),
-                              (void *) (offsetof(Instance, uv) + i * sizeof(glm::u16vec2)));
-        glVertexAttribDivisor(aInstUVLoc + i, 1);
+        glEnableVertexAttribArray(aInstRotationLoc);
+        glVertexAttribPointer(aInstRotationLoc, 1, GL_SHORT, GL_TRUE, sizeof(HalfInstance), (void *) (offsetof(HalfInstance, rotation)));
+        glVertexAttribDivisor(aInstRotationLoc, 1);
+
+        glEnableVertexAttribArray(aInstColorLoc);
+        glVertexAttribPointer(aInstColorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(HalfInstance), (void *) (offsetof(HalfInstance, color)));
+        glVertexAttribDivisor(aInstColorLoc, 1);
+
+        glEnableVertexAttribArray(aInstUVLoc);
+        glVertexAttribPointer(aInstUVLoc, 4, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(HalfInstance), (void *) (offsetof(HalfInstance, uvRect)));
+        glVertexAttribDivisor(aInstUVLoc, 1);
+    } else {
+        // Per frame stream, static stream is bound in flush
+        glEnableVertexAttribArray(aInstPosLoc);
+        glVertexAttribPointer(aInstPosLoc, 2, GL_FLOAT, GL_FALSE, sizeof(DynamicInstance), (void *) (offsetof(DynamicInstance, pos)));
+        glVertexAttribDivisor(aInstPosLoc, 1);
+
+        glEnableVertexAttribArray(aInstRotationLoc);
+        glVertexAttribPointer(aInstRotationLoc, 1, GL_FLOAT, GL_FALSE, sizeof(DynamicInstance), (void *) (offsetof(DynamicInstance, rotation)));
+        glVertexAttribDivisor(aInstRotationLoc, 1);
+
+        for (int loc: {aInstSizeLoc, aInstOriginLoc, aInstColorLoc, aInstUVLoc}) {
+            glEnableVertexAttribArray(loc);
+            glVertexAttribDivisor(loc, 1);
+        }
     }
 }
 
+void InstanceRenderer::bindStaticAttributes(size_t firstInstance) {
+    size_t offset = instanceOffset(firstInstance, sizeof(StaticInstance));
+    glBindBuffer(GL_ARRAY_BUFFER, staticStream->buffer());
+    glVertexAttribPointer(aInstSizeLoc, 2, GL_FLOAT, GL_FALSE, sizeof(StaticInstance), (void *) (offset + offsetof(StaticInstance, size)));
+    glVertexAttribPointer(aInstOriginLoc, 2, GL_FLOAT, GL_FALSE, sizeof(StaticInstance), (void *) (offset + offsetof(StaticInstance, origin)));
+    glVertexAttribPointer(aInstColorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(StaticInstance), (void *) (offset + offsetof(StaticInstance, color)));
+    glVertexAttribPointer(aInstUVLoc, 4, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(StaticInstance), (void *) (offset + offsetof(StaticInstance, uvRect)));
+}
+
+void InstanceRenderer::bindTexture(GLuint texture) {
+    if (texture == boundSampler) {
+        return;
+    }
+    flush(FlushReason::TextureChange);
+    boundSampler = texture;
+    PhaseTimer::Scope phase{RenderPhase::Bind};
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUniform1i(uTexLoc, 0);
+    currentStats.textureBinds++;
+    currentStats.stateChanges++;
+}
+
 InstanceRenderer::~InstanceRenderer() {
     glDeleteProgram(shader);
     glDeleteBuffers(1, &vbo);
@@ -126,32 +263,58 @@ void InstanceRenderer::begin(const glm::mat4 &projView) {
     assert(!inUse);
     inUse = true;
     instanceCount = 0;
+    frameOffset = 0;
 
     glBindVertexArray(vao);
     glUseProgram(shader);
-    static GLint uProjViewLoc = glGetUniformLocation(shader, "uProjView");
     glUniformMatrix4fv(uProjViewLoc, 1, GL_FALSE, &projView[0][0]);
+    currentStats.stateChanges += 3;
+    if (layout != Layout::Full) {
+        glUniform1f(uRotationScaleLoc, layout == Layout::Half ? glm::pi<float>() : 1.0f);
+        currentStats.stateChanges++;
+    }
 
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
+    currentStats.stateChanges += 3;
 }
 
 void InstanceRenderer::drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin,
                                   float rotation,
                                   Color color) {
     assert(inUse);
-    if (region.texture != boundSampler) {
-        flush();
-        boundSampler = region.texture;
-        static GLint uTexLoc = glGetUniformLocation(shader, "uTex");
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, region.texture);
-        glUniform1i(uTexLoc, 0);
+    bindTexture(region.texture);
+    if (instanceCount >= maxInstances && !growBatch(1)) {
+        flush(FlushReason::CapacityFull);
+    }
+    currentStats.sprites++;
 
+    if (layout == Layout::Half) {
+        // Wrap rotation to [-pi, pi] so it fits the snorm range
+        float wrapped = rotation - glm::two_pi<float>() * glm::round(rotation / glm::two_pi<float>());
+        halfInstanceData[instanceCount++] = HalfInstance{
+            .pos = position,
+            .size = glm::packHalf(size),
+            .origin = glm::packHalf(origin),
+            .uvRect = {region.u0, region.v0, region.u1, region.v1},
+            .color = color,
+            .rotation = int16_t(glm::packSnorm1x16(wrapped / glm::pi<float>())),
+        };
+        return;
     }
-    if (instanceCount >= maxInstances) {
-        flush();
+    if (layout == Layout::Split) {
+        staticStream->write(frameOffset + instanceCount, StaticInstance{
+            .size = size,
+            .origin = origin,
+            .uvRect = {region.u0, region.v0, region.u1, region.v1},
+            .color = color,
+        });
+        dynamicInstanceData[instanceCount++] = DynamicInstance{
+            .pos = position,
+            .rotation = rotation,
+        };
+        return;
     }
 
     instanceData[instanceCount++] = Instance{
@@ -169,24 +332,182 @@ void InstanceRenderer::drawSprite(const UVRegion &region, glm::vec2 position, gl
     };
 }
 
+void InstanceRenderer::drawSprites(const UVRegion &region, const SpriteSpan &sprites) {
+    if (layout != Layout::Full) {
+        IRenderer::drawSprites(region, sprites);
+        return;
+    }
+    assert(inUse);
+    bindTexture(region.texture);
+    currentStats.sprites += sprites.count;
+
+    // Texture and UVs are the same for the whole span, only checked once
+    Instance instance{
+            .pos = {},
+            .size = {},
+            .origin = {},
+            .rotation = 0.0f,
+            .color = {},
+            .uv = {
+                    {region.u0, region.v1},
+                    {region.u0, region.v0},
+                    {region.u1, region.v1},
+                    {region.u1, region.v0},
+            },
+    };
+    size_t i = 0;
+    while (i < sprites.count) {
+        if (instanceCount >= maxInstances && !growBatch(sprites.count - i)) {
+            flush(FlushReason::CapacityFull);
+        }
+        size_t n = std::min(sprites.count - i, maxInstances - instanceCount);
+        for (size_t end = i + n; i < end; i++) {
+            instance.pos = sprites.positions[i];
+            instance.size = sprites.sizes[i];
+            instance.origin = sprites.origins[i];
+            instance.rotation = sprites.rotations[i];
+            instance.color = sprites.colors[i];
+            instanceData[instanceCount++] = instance;
+        }
+    }
+}
+
 void InstanceRenderer::end() {
     assert(inUse);
-    flush();
+    flush(FlushReason::End);
+    endFrameStats();
     inUse = false;
 }
 
-void InstanceRenderer::flush() {
+void InstanceRenderer::endFrame() {
+    assert(!inUse);
+    if (capacity.endFrame()) {
+        maxInstances = capacity.capacity();
+        resizeInstanceData(0);
+    }
+}
+
+bool InstanceRenderer::growBatch(size_t instances) {
+    if (!capacity.grow(instanceCount + instances)) {
+        return false;
+    }
+    // Note: GPU buffer is reallocated on flush, several grows within a batch need only one
+    maxInstances = capacity.capacity();
+    resizeInstanceData(instanceCount);
+    return true;
+}
+
+void InstanceRenderer::resizeInstanceData(size_t used) {
+    switch (layout) {
+        case Layout::Full:
+            resizeStaging(instanceData, used, maxInstances);
+            break;
+        case Layout::Half:
+            resizeStaging(halfInstanceData, used, maxInstances);
+            break;
+        case Layout::Split:
+            resizeStaging(dynamicInstanceData, used, maxInstances);
+            break;
+    }
+}
+
+void InstanceRenderer::setCapacity(const BatchCapacity::Options &options) {
+    assert(!inUse);
+    capacity = BatchCapacity(options);
+    maxInstances = capacity.capacity();
+    resizeInstanceData(0);
+}
+
+BatchCapacity::Stats InstanceRenderer::capacityStats() const {
+    return capacity.stats();
+}
+
+void InstanceRenderer::flush(FlushReason reason) {
     assert(inUse);
     if (instanceCount == 0) {
         return;
     }
+    currentStats.flushes[int(reason)]++;
+    currentStats.drawCalls++;
+    currentStats.instances += instanceCount;
 
-    // Send instance data to GPU
-    glBindBuffer(GL_ARRAY_BUFFER, instVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (instanceCount * sizeof(Instance)), instanceData.get());
+    {
+        PhaseTimer::Scope phase{RenderPhase::Upload};
+        if (layout == Layout::Split) {
+            // Only changed static data is sent to GPU
+            currentStats.bytesUploaded += staticStream->upload();
+            bindStaticAttributes(frameOffset);
+            currentStats.stateChanges += 5;
+        }
+
+        // Send instance data to GPU
+        glBindBuffer(GL_ARRAY_BUFFER, instVBO);
+        currentStats.stateChanges++;
+        if (gpuInstances != capacity.capacity()) {
+            gpuInstances = capacity.capacity();
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (gpuInstances * instanceSize(layout)), nullptr, GL_DYNAMIC_DRAW);
+            capacity.countGpuReallocation();
+        }
+        capacity.batchFlushed(instanceCount);
+        const void *data = nullptr;
+        switch (layout) {
+            case Layout::Full:
+                data = instanceData.get();
+                break;
+            case Layout::Half:
+                data = halfInstanceData.get();
+                break;
+            case Layout::Split:
+                data = dynamicInstanceData.get();
+                break;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (instanceCount * instanceSize(layout)), data);
+        currentStats.bytesUploaded += instanceCount * instanceSize(layout);
+    }
 
     // Draw
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instanceCount);
+    {
+        PhaseTimer::Scope phase{RenderPhase::Draw};
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(instanceCount));
+    }
 
+    frameOffset += instanceCount;
     instanceCount = 0;
 }
+
+size_t InstanceRenderer::instanceSize(Layout layout) {
+    switch (layout) {
+        case Layout::Full:
+            return sizeof(Instance);
+        case Layout::Half:
+            return sizeof(HalfInstance);
+        case Layout::Split:
+            return sizeof(DynamicInstance); // Per frame stream only
+    }
+    return 0;
+}
+
+const char *InstanceRenderer::layoutName(Layout layout) {
+    switch (layout) {
+        case Layout::Full:
+            return "full";
+        case Layout::Half:
+            return "half";
+        case Layout::Split:
+            return "split";
+    }
+    return "unknown";
+}
+
+bool InstanceRenderer::parseLayout(const char *str, Layout &layout) {
+    if (!str) {
+        return false;
+    }
+    for (auto l: {Layout::Full, Layout::Half, Layout::Split}) {
+        if (strcmp(str, layoutName(l)) == 0) {
+            layout = l;
+            return true;
+        }
+    }
+    return false;
+}
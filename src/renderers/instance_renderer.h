@@ -3,6 +3,8 @@
 
 #include <memory>
 #include "../base_renderer.h"
+#include "batch_capacity.h"
+#include "static_instance_stream.h"
 
 class InstanceRenderer : public IRenderer {
 private:
@@ -12,8 +14,14 @@ private:
     constexpr static int aInstOriginLoc = 3;
     constexpr static int aInstRotationLoc = 4;
     constexpr static int aInstColorLoc = 5;
-    constexpr static int aInstUVLoc = 6; // 6, 7, 8, 9
+    constexpr static int aInstUVLoc = 6; // 6, 7, 8, 9 (Layout::Full), 6 (Layout::Half, Layout::Split)
 public:
+    enum class Layout {
+        Full,  // Instance
+        Half,  // HalfInstance
+        Split, // DynamicInstance each frame, StaticInstance only when changed
+    };
+
     struct Instance {
         glm::vec2 pos;     // 8 B
         glm::vec2 size;    // 8 B
@@ -25,26 +33,80 @@ public:
     }; // 42 total
     static_assert(sizeof(Instance) == 48);
 
-    explicit InstanceRenderer(int maxInstances = 4000);
+    struct HalfInstance {
+        glm::vec2 pos;       // 8 B
+        glm::u16vec2 size;   // 4 B, half float
+        glm::u16vec2 origin; // 4 B, half float
+        glm::u16vec4 uvRect; // 8 B, u0, v0, u1, v1, corners derived in shader
+        glm::u8vec4 color;   // 4 B
+        int16_t rotation;    // 2 B, snorm, [-pi, pi]
+    }; // 30 total + 2 B padding
+    static_assert(sizeof(HalfInstance) == 32);
+
+    struct DynamicInstance {
+        glm::vec2 pos;  // 8 B
+        float rotation; // 4 B
+    }; // 12 total
+    static_assert(sizeof(DynamicInstance) == 12);
+
+    struct StaticInstance {
+        glm::vec2 size;      // 8 B
+        glm::vec2 origin;    // 8 B
+        glm::u16vec4 uvRect; // 8 B, u0, v0, u1, v1, corners derived in shader
+        glm::u8vec4 color;   // 4 B
+    }; // 28 total
+    static_assert(sizeof(StaticInstance) == 28);
+
+    explicit InstanceRenderer(int maxInstances = 4000, Layout layout = Layout::Full);
     ~InstanceRenderer() override;
 
     void begin(const glm::mat4 &projView) override;
     void drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin, float rotation, Color color) override;
+    void drawSprites(const UVRegion &region, const SpriteSpan &sprites) override;
     void end() override;
-    void flush();
+    void endFrame() override;
+    void flush(FlushReason reason = FlushReason::Explicit);
+
+    // Capacity in instances, replaces maxInstances given to the constructor. Not while in use.
+    void setCapacity(const BatchCapacity::Options &options);
+    [[nodiscard]]
+    BatchCapacity::Stats capacityStats() const;
+
+    static size_t instanceSize(Layout layout);
+    static const char *layoutName(Layout layout);
+    static bool parseLayout(const char *str, Layout &layout);
 
 private:
+    void bindStaticAttributes(size_t firstInstance);
+    // Grows the current batch to fit instances more, returns false if it is at its maximum capacity
+    bool growBatch(size_t instances);
+    // Resizes instance data of the layout to maxInstances, keeping the first used instances
+    void resizeInstanceData(size_t used);
+    void bindTexture(GLuint texture);
+
     GLuint vao{};
     GLuint instVBO{};
     GLuint vbo{};
     GLuint shader{};
 
+    GLint uProjViewLoc{};
+    GLint uTexLoc{};
+    GLint uRotationScaleLoc{};
+
+    Layout layout{};
+
     GLuint boundSampler{};
 
+    BatchCapacity capacity{};
     size_t maxInstances{};
+    size_t gpuInstances{}; // capacity of the instance buffer
     std::unique_ptr<Instance[]> instanceData{};
+    std::unique_ptr<HalfInstance[]> halfInstanceData{};
+    std::unique_ptr<DynamicInstance[]> dynamicInstanceData{};
+    std::unique_ptr<StaticInstanceStream<StaticInstance>> staticStream{};
 
-    int instanceCount{};
+    size_t instanceCount{};
+    size_t frameOffset{}; // Instances drawn by previous batches this frame
 
     bool inUse{};
 };
@@ -1,35 +1,74 @@
 #include "instance_renderer_cpu.h"
 
-InstanceRendererCPU::InstanceRendererCPU(int maxInstances) {
-    shader = compileShaderProgram({.vertex = R"(
-        #version 330 core
-        layout (location = 0) in vec2 aPos;
-        layout (location = 1) in mat3 aInstModel; // Location 1, 2, 3
-        layout (location = 4) in vec2 aInstUV[4]; // Location 4, 5, 6, 7
-        layout (location = 8) in vec4 aInstColor;
-
-        out vec2 UV;
-        out vec4 color;
-        uniform mat4 uProjView;
-        uniform sampler2D uTex;
-        void main() {
-            vec2 texSize = textureSize(uTex, 0);
-            UV = aInstUV[gl_VertexID] / texSize;
-            color = aInstColor;
-            gl_Position = uProjView * vec4(aInstModel * vec3(aPos, 1.0), 1.0);
-        }
-    )", .fragment = R"(
-        #version 330 core
-        out vec4 FragColor;
-        in vec2 UV;
-        in vec4 color;
-        uniform sampler2D uTex;
-        void main() {
-            FragColor = texture(uTex, UV) * color;
-        }
-    )"});
+#include <algorithm>
+#include <cstring>
+#include "../phase_timer.h"
+
+InstanceRendererCPU::InstanceRendererCPU(int maxInstances, Layout layout) : layout(layout) {
+    if (layout == Layout::Full) {
+        shader = compileShaderProgram({.vertex = R"(
+            #version 330 core
+            layout (location = 0) in vec2 aPos;
+            layout (location = 1) in mat3 aInstModel; // Location 1, 2, 3
+            layout (location = 4) in vec2 aInstUV[4]; // Location 4, 5, 6, 7
+            layout (location = 8) in vec4 aInstColor;
+
+            out vec2 UV;
+            out vec4 color;
+            uniform mat4 uProjView;
+            uniform sampler2D uTex;
+            void main() {
+                vec2 texSize = textureSize(uTex, 0);
+                UV = aInstUV[gl_VertexID] / texSize;
+                color = aInstColor;
+                gl_Position = uProjView * vec4(aInstModel * vec3(aPos, 1.0), 1.0);
+            }
+        )", .fragment = R"(
+            #version 330 core
+            out vec4 FragColor;
+            in vec2 UV;
+            in vec4 color;
+            uniform sampler2D uTex;
+            void main() {
+                FragColor = texture(uTex, UV) * color;
+            }
+        )"});
+    } else {
+        shader = compileShaderProgram({.vertex = R"(
+            #version 330 core
+            layout (location = 0) in vec2 aPos;
+            layout (location = 1) in mat3x2 aInstModel; // Location 1, 2, 3
+            layout (location = 4) in vec4 aInstUVRect;  // u0, v0, u1, v1
+            layout (location = 8) in vec4 aInstColor;
+
+            out vec2 UV;
+            out vec4 color;
+            uniform mat4 uProjView;
+            uniform sampler2D uTex;
+            void main() {
+                vec2 texSize = textureSize(uTex, 0);
+                // aPos is (0, 0) in bottom left and (1, 1) in top right corner
+                UV = vec2(mix(aInstUVRect.x, aInstUVRect.z, aPos.x),
+                          mix(aInstUVRect.w, aInstUVRect.y, aPos.y)) / texSize;
+                color = aInstColor;
+                gl_Position = uProjView * vec4(aInstModel * vec3(aPos, 1.0), 0.0, 1.0);
+            }
+        )", .fragment = R"(
+            #version 330 core
+            out vec4 FragColor;
+            in vec2 UV;
+            in vec4 color;
+            uniform sampler2D uTex;
+            void main() {
+                FragColor = texture(uTex, UV) * color;
+            }
+        )"});
+    }
     assert(shader);
 
+    uProjViewLoc = glGetUniformLocation(shader, "uProjView");
+    uTexLoc = glGetUniformLocation(shader, "uTex");
+
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &instVBO);
     glGenBuffers(1, &vbo);
@@ -52,24 +91,61 @@ InstanceRendererCPU::InstanceRendererCPU(int maxInstances) {
 
     // Reserve space for instance data
     glBindBuffer(GL_ARRAY_BUFFER, instVBO);
-    this->maxInstances = maxInstances;
-    instanceData = std::make_unique<Instance[]>(maxInstances);
+    capacity = BatchCapacity({.initial = size_t(maxInstances)});
+    this->maxInstances = capacity.capacity();
+    resizeInstanceData(0);
+    if (layout == Layout::Split) {
+        staticStream = std::make_unique<StaticInstanceStream<StaticInstance>>();
+    }
     // Allocate buffer on GPU
-    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (maxInstances * sizeof(Instance)), nullptr, GL_DYNAMIC_DRAW);
+    gpuInstances = this->maxInstances;
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (gpuInstances * instanceSize(layout)), nullptr, GL_DYNAMIC_DRAW);
 
-    for (int i = 0; i < 3; i++) {
-        glEnableVertexAttribArray(aModelMatLoc + i); // aInstModel
-        glVertexAttribPointer(aModelMatLoc + i, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, model) + i * sizeof(glm::vec3)));
-        glVertexAttribDivisor(aModelMatLoc + i, 1); // per instance
-    }
-    for (int i = 0; i < 4; i++) {
-        glEnableVertexAttribArray(aUVLoc + i); // aInstUV
-        glVertexAttribPointer(aUVLoc + i, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, uv) + i * sizeof(glm::u16vec2)));
-        glVertexAttribDivisor(aUVLoc + i, 1); // per instance
+    if (layout == Layout::Full) {
+        for (int i = 0; i < 3; i++) {
+            glEnableVertexAttribArray(aModelMatLoc + i); // aInstModel
+            glVertexAttribPointer(aModelMatLoc + i, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, model) + i * sizeof(glm::vec3)));
+            glVertexAttribDivisor(aModelMatLoc + i, 1); // per instance
+        }
+        for (int i = 0; i < 4; i++) {
+            glEnableVertexAttribArray(aUVLoc + i); // aInstUV
+            glVertexAttribPointer(aUVLoc + i, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Instance), (void *) (offsetof(Instance, uv) + i * sizeof(glm::u16vec2)));
+            glVertexAttribDivisor(aUVLoc + i, 1); // per instance
+        }
+        glEnableVertexAttribArray(aColorLoc); // aInstColor
+        glVertexAttribPointer(aColorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void *) offsetof(Instance, color));
+        glVertexAttribDivisor(aColorLoc, 1); // per instance
+    } else if (layout == Layout::Affine) {
+        for (int i = 0; i < 3; i++) {
+            glEnableVertexAttribArray(aModelMatLoc + i); // aInstModel
+            glVertexAttribPointer(aModelMatLoc + i, 2, GL_FLOAT, GL_FALSE, sizeof(AffineInstance), (void *) (offsetof(AffineInstance, model) + i * sizeof(glm::vec2)));
+            glVertexAttribDivisor(aModelMatLoc + i, 1); // per instance
+        }
+        glEnableVertexAttribArray(aUVLoc); // aInstUVRect
+        glVertexAttribPointer(aUVLoc, 4, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(AffineInstance), (void *) offsetof(AffineInstance, uvRect));
+        glVertexAttribDivisor(aUVLoc, 1); // per instance
+        glEnableVertexAttribArray(aColorLoc); // aInstColor
+        glVertexAttribPointer(aColorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(AffineInstance), (void *) offsetof(AffineInstance, color));
+        glVertexAttribDivisor(aColorLoc, 1); // per instance
+    } else {
+        // Per frame stream, static stream is bound in flush
+        for (int i = 0; i < 3; i++) {
+            glEnableVertexAttribArray(aModelMatLoc + i); // aInstModel
+            glVertexAttribPointer(aModelMatLoc + i, 2, GL_FLOAT, GL_FALSE, sizeof(glm::mat3x2), (void *) (i * sizeof(glm::vec2)));
+            glVertexAttribDivisor(aModelMatLoc + i, 1); // per instance
+        }
+        glEnableVertexAttribArray(aUVLoc); // aInstUVRect
+        glVertexAttribDivisor(aUVLoc, 1); // per instance
+        glEnableVertexAttribArray(aColorLoc); // aInstColor
+        glVertexAttribDivisor(aColorLoc, 1); // per instance
     }
-    glEnableVertexAttribArray(aColorLoc); // aInstColor
-    glVertexAttribPointer(aColorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void *) offsetof(Instance, color));
-    glVertexAttribDivisor(aColorLoc, 1); // per instance
+}
+
+void InstanceRendererCPU::bindStaticAttributes(size_t firstInstance) {
+    size_t offset = instanceOffset(firstInstance, sizeof(StaticInstance));
+    glBindBuffer(GL_ARRAY_BUFFER, staticStream->buffer());
+    glVertexAttribPointer(aUVLoc, 4, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(StaticInstance), (void *) (offset + offsetof(StaticInstance, uvRect)));
+    glVertexAttribPointer(aColorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(StaticInstance), (void *) (offset + offsetof(StaticInstance, color)));
 }
 
 InstanceRendererCPU::~InstanceRendererCPU() {
@@ -83,36 +159,47 @@ void InstanceRendererCPU::begin(const glm::mat4 &projView) {
     assert(!inUse);
     inUse = true;
     instanceCount = 0;
+    frameOffset = 0;
 
     glBindVertexArray(vao);
     glUseProgram(shader);
-    static GLint uProjViewLoc = glGetUniformLocation(shader, "uProjView");
     glUniformMatrix4fv(uProjViewLoc, 1, GL_FALSE, &projView[0][0]);
 
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
+    currentStats.stateChanges += 6;
 }
 
 void InstanceRendererCPU::drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin, float rotation,
                                      Color color) {
     assert(inUse);
-    if (region.texture != boundSampler) {
-        flush();
-        boundSampler = region.texture;
-        static GLint uTexLoc = glGetUniformLocation(shader, "uTex");
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, region.texture);
-        glUniform1i(uTexLoc, 0);
-
-    }
-    if (instanceCount >= maxInstances) {
-        flush();
+    bindTexture(region.texture);
+    if (instanceCount >= maxInstances && !growBatch(1)) {
+        flush(FlushReason::CapacityFull);
     }
+    currentStats.sprites++;
 
     // Convert model matrix
     auto model = buildTransformationMatrix(position, size, origin, rotation);
 
+    if (layout == Layout::Affine) {
+        affineInstanceData[instanceCount++] = AffineInstance {
+            .model = glm::mat3x2(model),
+            .uvRect = {region.u0, region.v0, region.u1, region.v1},
+            .color = color,
+        };
+        return;
+    }
+    if (layout == Layout::Split) {
+        staticStream->write(frameOffset + instanceCount, StaticInstance{
+            .uvRect = {region.u0, region.v0, region.u1, region.v1},
+            .color = color,
+        });
+        modelData[instanceCount++] = glm::mat3x2(model);
+        return;
+    }
+
     instanceData[instanceCount++] = Instance {
         .model = model,
         .uv = {
@@ -125,24 +212,213 @@ void InstanceRendererCPU::drawSprite(const UVRegion &region, glm::vec2 position,
     };
 }
 
+void InstanceRendererCPU::drawSprites(const UVRegion &region, const SpriteSpan &sprites) {
+    if (layout == Layout::Split) {
+        // Note: Static stream tracks changes per instance, so writes stay in order on the calling thread
+        IRenderer::drawSprites(region, sprites);
+        return;
+    }
+    assert(inUse);
+    bindTexture(region.texture);
+    currentStats.sprites += sprites.count;
+
+    size_t i = 0;
+    while (i < sprites.count) {
+        if (instanceCount >= maxInstances && !growBatch(sprites.count - i)) {
+            flush(FlushReason::CapacityFull);
+        }
+        size_t n = std::min(sprites.count - i, maxInstances - instanceCount);
+        size_t first = i;
+        size_t offset = instanceCount;
+        auto generate = [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                size_t sprite = first + k;
+                auto model = buildTransformationMatrix(sprites.positions[sprite], sprites.sizes[sprite],
+                                                       sprites.origins[sprite], sprites.rotations[sprite]);
+                if (layout == Layout::Affine) {
+                    affineInstanceData[offset + k] = AffineInstance{
+                            .model = glm::mat3x2(model),
+                            .uvRect = {region.u0, region.v0, region.u1, region.v1},
+                            .color = sprites.colors[sprite],
+                    };
+                } else {
+                    instanceData[offset + k] = Instance{
+                            .model = model,
+                            .uv = {
+                                    {region.u0, region.v1},
+                                    {region.u0, region.v0},
+                                    {region.u1, region.v1},
+                                    {region.u1, region.v0},
+                            },
+                            .color = sprites.colors[sprite],
+                    };
+                }
+            }
+        };
+        if (jobs) {
+            jobs->parallelFor(n, jobGrain, generate);
+        } else {
+            generate(0, n);
+        }
+        instanceCount += n;
+        i += n;
+    }
+}
+
+void InstanceRendererCPU::setJobSystem(JobSystem *jobs) {
+    this->jobs = jobs;
+}
+
+void InstanceRendererCPU::bindTexture(GLuint texture) {
+    if (texture == boundSampler) {
+        return;
+    }
+    flush(FlushReason::TextureChange);
+    boundSampler = texture;
+    PhaseTimer::Scope phase{RenderPhase::Bind};
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUniform1i(uTexLoc, 0);
+    currentStats.textureBinds++;
+    currentStats.stateChanges++;
+}
+
 void InstanceRendererCPU::end() {
     assert(inUse);
-    flush();
+    flush(FlushReason::End);
+    endFrameStats();
     inUse = false;
 }
 
-void InstanceRendererCPU::flush() {
+void InstanceRendererCPU::endFrame() {
+    assert(!inUse);
+    if (capacity.endFrame()) {
+        maxInstances = capacity.capacity();
+        resizeInstanceData(0);
+    }
+}
+
+bool InstanceRendererCPU::growBatch(size_t instances) {
+    if (!capacity.grow(instanceCount + instances)) {
+        return false;
+    }
+    // Note: GPU buffer is reallocated on flush, several grows within a batch need only one
+    maxInstances = capacity.capacity();
+    resizeInstanceData(instanceCount);
+    return true;
+}
+
+void InstanceRendererCPU::resizeInstanceData(size_t used) {
+    switch (layout) {
+        case Layout::Full:
+            resizeStaging(instanceData, used, maxInstances);
+            break;
+        case Layout::Affine:
+            resizeStaging(affineInstanceData, used, maxInstances);
+            break;
+        case Layout::Split:
+            resizeStaging(modelData, used, maxInstances);
+            break;
+    }
+}
+
+void InstanceRendererCPU::setCapacity(const BatchCapacity::Options &options) {
+    assert(!inUse);
+    capacity = BatchCapacity(options);
+    maxInstances = capacity.capacity();
+    resizeInstanceData(0);
+}
+
+BatchCapacity::Stats InstanceRendererCPU::capacityStats() const {
+    return capacity.stats();
+}
+
+void InstanceRendererCPU::flush(FlushReason reason) {
     assert(inUse);
     if (instanceCount == 0) {
         return;
     }
+    currentStats.flushes[int(reason)]++;
+    currentStats.drawCalls++;
+    currentStats.instances += instanceCount;
 
-    // Send instance data to GPU
-    glBindBuffer(GL_ARRAY_BUFFER, instVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (instanceCount * sizeof(Instance)), instanceData.get());
+    {
+        PhaseTimer::Scope phase{RenderPhase::Upload};
+        if (layout == Layout::Split) {
+            // Only changed static data is sent to GPU
+            currentStats.bytesUploaded += staticStream->upload();
+            bindStaticAttributes(frameOffset);
+            currentStats.stateChanges += 3;
+        }
+
+        // Send instance data to GPU
+        glBindBuffer(GL_ARRAY_BUFFER, instVBO);
+        currentStats.stateChanges++;
+        if (gpuInstances != capacity.capacity()) {
+            gpuInstances = capacity.capacity();
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (gpuInstances * instanceSize(layout)), nullptr, GL_DYNAMIC_DRAW);
+            capacity.countGpuReallocation();
+        }
+        capacity.batchFlushed(instanceCount);
+        const void *data = nullptr;
+        switch (layout) {
+            case Layout::Full:
+                data = instanceData.get();
+                break;
+            case Layout::Affine:
+                data = affineInstanceData.get();
+                break;
+            case Layout::Split:
+                data = modelData.get();
+                break;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (instanceCount * instanceSize(layout)), data);
+        currentStats.bytesUploaded += instanceCount * instanceSize(layout);
+    }
 
     // Draw
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instanceCount);
+    {
+        PhaseTimer::Scope phase{RenderPhase::Draw};
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(instanceCount));
+    }
 
+    frameOffset += instanceCount;
     instanceCount = 0;
 }
+
+size_t InstanceRendererCPU::instanceSize(Layout layout) {
+    switch (layout) {
+        case Layout::Full:
+            return sizeof(Instance);
+        case Layout::Affine:
+            return sizeof(AffineInstance);
+        case Layout::Split:
+            return sizeof(glm::mat3x2); // Per frame stream only
+    }
+    return 0;
+}
+
+const char *InstanceRendererCPU::layoutName(Layout layout) {
+    switch (layout) {
+        case Layout::Full:
+            return "full";
+        case Layout::Affine:
+            return "affine";
+        case Layout::Split:
+            return "split";
+    }
+    return "unknown";
+}
+
+bool InstanceRendererCPU::parseLayout(const char *str, Layout &layout) {
+    if (!str) {
+        return false;
+    }
+    for (auto l: {Layout::Full, Layout::Affine, Layout::Split}) {
+        if (strcmp(str, layoutName(l)) == 0) {
+            layout = l;
+            return true;
+        }
+    }
+    return false;
+}
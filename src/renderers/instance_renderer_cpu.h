@@ -3,14 +3,23 @@
 
 #include <memory>
 #include "../base_renderer.h"
+#include "../job_system.h"
+#include "batch_capacity.h"
+#include "static_instance_stream.h"
 
 class InstanceRendererCPU : public IRenderer {
 private:
     constexpr static int aPosLoc = 0;
     constexpr static int aModelMatLoc = 1; // Location 1, 2, 3
-    constexpr static int aUVLoc = 4; // Location 4, 5, 6, 7
+    constexpr static int aUVLoc = 4; // Location 4, 5, 6, 7 (Layout::Full), 4 (Layout::Affine, Layout::Split)
     constexpr static int aColorLoc = 8;
 public:
+    enum class Layout {
+        Full,   // Instance
+        Affine, // AffineInstance
+        Split,  // glm::mat3x2 each frame, StaticInstance only when changed
+    };
+
     struct Instance {
         glm::mat3 model; // 36 B
         glm::u16vec2 uv[4]; // 16 B
@@ -18,26 +27,77 @@ public:
     }; // 56 total
     static_assert(sizeof(Instance) == 56);
 
-    explicit InstanceRendererCPU(int maxInstances = 4000);
+    struct AffineInstance {
+        glm::mat3x2 model;   // 24 B, 2x3 affine, last row is implicit
+        glm::u16vec4 uvRect; // 8 B, u0, v0, u1, v1, corners derived in shader
+        glm::u8vec4 color;   // 4 B
+    }; // 36 total
+    static_assert(sizeof(AffineInstance) == 36);
+
+    struct StaticInstance {
+        glm::u16vec4 uvRect; // 8 B, u0, v0, u1, v1
+        glm::u8vec4 color;   // 4 B
+    }; // 12 total
+    static_assert(sizeof(StaticInstance) == 12);
+
+    explicit InstanceRendererCPU(int maxInstances = 4000, Layout layout = Layout::Full);
     ~InstanceRendererCPU() override;
 
     void begin(const glm::mat4 &projView) override;
     void drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin, float rotation, Color color) override;
+    // Layout::Full and Layout::Affine only, matrices are built on the job system if one is set
+    void drawSprites(const UVRegion &region, const SpriteSpan &sprites) override;
     void end() override;
-    void flush();
+    void endFrame() override;
+    void flush(FlushReason reason = FlushReason::Explicit);
+
+    // Capacity in instances, replaces maxInstances given to the constructor. Not while in use.
+    void setCapacity(const BatchCapacity::Options &options);
+    [[nodiscard]]
+    BatchCapacity::Stats capacityStats() const;
+
+    // Job system for matrix generation in drawSprites, nullptr to build them on the calling thread
+    void setJobSystem(JobSystem *jobs);
+
+    static size_t instanceSize(Layout layout);
+    static const char *layoutName(Layout layout);
+    static bool parseLayout(const char *str, Layout &layout);
 
 private:
+    // Instances per job, smaller ranges are not worth scheduling
+    constexpr static size_t jobGrain = 1024;
+
+    void bindTexture(GLuint texture);
+    void bindStaticAttributes(size_t firstInstance);
+    // Grows the current batch to fit instances more, returns false if it is at its maximum capacity
+    bool growBatch(size_t instances);
+    // Resizes instance data of the layout to maxInstances, keeping the first used instances
+    void resizeInstanceData(size_t used);
+
     GLuint vao{};
     GLuint instVBO{};
     GLuint vbo{};
     GLuint shader{};
 
+    GLint uProjViewLoc{};
+    GLint uTexLoc{};
+
+    Layout layout{};
+
     GLuint boundSampler{};
 
+    BatchCapacity capacity{};
     size_t maxInstances{};
+    size_t gpuInstances{}; // capacity of the instance buffer
     std::unique_ptr<Instance[]> instanceData{};
+    std::unique_ptr<AffineInstance[]> affineInstanceData{};
+    std::unique_ptr<glm::mat3x2[]> modelData{};
+    std::unique_ptr<StaticInstanceStream<StaticInstance>> staticStream{};
+
+    size_t instanceCount{};
+    size_t frameOffset{}; // Instances drawn by previous batches this frame
 
-    int instanceCount{};
+    JobSystem *jobs{};
 
     bool inUse{};
 };
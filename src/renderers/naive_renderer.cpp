@@ -1,5 +1,7 @@
 #include "naive_renderer.h"
 
+#include "../phase_timer.h"
+
 NaiveRenderer::NaiveRenderer() {
     shader = compileShaderProgram({.vertex = R"(
         #version 330 core
@@ -82,15 +84,19 @@ void NaiveRenderer::begin(const glm::mat4 &projView) {
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
-
+    currentStats.stateChanges += 6;
 }
 
 void NaiveRenderer::drawSprite(const UVRegion &region, glm::vec2 pos, glm::vec2 size, glm::vec2 origin, float rotation,
                                Color color) {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, region.texture);
-    static GLint texLoc = glGetUniformLocation(shader, "tex");
-    glUniform1i(texLoc, 0);
+    {
+        PhaseTimer::Scope phase{RenderPhase::Bind};
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, region.texture);
+        static GLint texLoc = glGetUniformLocation(shader, "tex");
+        glUniform1i(texLoc, 0);
+    }
+    currentStats.textureBinds++;
 
 #if 0
     auto model = glm::mat4(1.0f);
@@ -108,6 +114,7 @@ void NaiveRenderer::drawSprite(const UVRegion &region, glm::vec2 pos, glm::vec2
     static GLint colorLoc = glGetUniformLocation(shader, "uColor");
     uint32_t packedColor = (color.r << 24) | (color.g << 16) | (color.b << 8) | (color.a);
     glUniform1ui(colorLoc, packedColor);
+    currentStats.stateChanges += 3;
 
     if (region != currRegion) {
         currRegion = region;
@@ -117,13 +124,19 @@ void NaiveRenderer::drawSprite(const UVRegion &region, glm::vec2 pos, glm::vec2
                 {region.U1(), region.V1()},
                 {region.U1(), region.V0()},
         };
+        PhaseTimer::Scope phase{RenderPhase::Upload};
         glBufferData(GL_ARRAY_BUFFER, sizeof(uvs), uvs, GL_STATIC_DRAW);
+        currentStats.bytesUploaded += sizeof(uvs);
     }
 
+    PhaseTimer::Scope phase{RenderPhase::Draw};
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    currentStats.drawCalls++;
+    currentStats.sprites++;
+    currentStats.vertices += 4;
 }
 
 void NaiveRenderer::end() {
-
+    endFrameStats();
 }
 
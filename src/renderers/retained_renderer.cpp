@@ -0,0 +1,327 @@
+#include "retained_renderer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <functional>
+#include "../phase_timer.h"
+
+RetainedRenderer::RetainedRenderer(int initialCapacity, UploadMode uploadMode) : uploadMode(uploadMode) {
+    shader = SpriteInstance::compileShader();
+    assert(shader);
+
+    uProjViewLoc = glGetUniformLocation(shader, "uProjView");
+    uTexLoc = glGetUniformLocation(shader, "uTex");
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &retainedVBO);
+    glGenBuffers(1, &transientVBO);
+
+    assert(vao && vbo && retainedVBO && transientVBO);
+
+    glBindVertexArray(vao);
+
+    SpriteInstance::setupVertexArray(vbo);
+
+    // Reserve space for instance data
+    assert(initialCapacity > 0);
+    retainedCapacity = initialCapacity;
+    glBindBuffer(GL_ARRAY_BUFFER, retainedVBO);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (retainedCapacity * sizeof(Instance)), nullptr, GL_DYNAMIC_DRAW);
+    instances.reserve(initialCapacity);
+    textures.reserve(initialCapacity);
+    generations.reserve(initialCapacity);
+
+    transientCapacity = initialCapacity;
+    glBindBuffer(GL_ARRAY_BUFFER, transientVBO);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (transientCapacity * sizeof(Instance)), nullptr, GL_STREAM_DRAW);
+}
+
+RetainedRenderer::~RetainedRenderer() {
+    glDeleteProgram(shader);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &retainedVBO);
+    glDeleteBuffers(1, &transientVBO);
+    glDeleteVertexArrays(1, &vao);
+}
+
+SpriteHandle RetainedRenderer::createSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin,
+                                            float rotation, Color color) {
+    uint32_t index;
+    if (!freeSlots.empty()) {
+        std::pop_heap(freeSlots.begin(), freeSlots.end(), std::greater<>{});
+        index = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        index = (uint32_t) instances.size();
+        instances.push_back({});
+        textures.push_back(textures.empty() ? region.texture : textures.back());
+        generations.push_back(0);
+        liveSlots.push_back(0);
+        dirtyBits.resize((instances.size() + 63) / 64);
+        // Note: New slot is always uploaded, since it was never written to GPU
+        dirtyBits[index / 64] |= uint64_t(1) << (index % 64);
+    }
+    liveSlots[index] = 1;
+    liveSprites++;
+    drawSlots = std::max(drawSlots, size_t(index) + 1);
+
+    setTexture(index, region.texture);
+    writeSprite(index, Instance::make(region, position, size, origin, rotation, color));
+    return SpriteHandle{.index = index, .generation = generations[index]};
+}
+
+void RetainedRenderer::updateSprite(SpriteHandle handle, const UVRegion &region, glm::vec2 position, glm::vec2 size,
+                                    glm::vec2 origin, float rotation, Color color) {
+    assert(handle.index < instances.size() && generations[handle.index] == handle.generation);
+    setTexture(handle.index, region.texture);
+    writeSprite(handle.index, Instance::make(region, position, size, origin, rotation, color));
+}
+
+void RetainedRenderer::updateSpriteTransform(SpriteHandle handle, glm::vec2 position, float rotation) {
+    assert(handle.index < instances.size() && generations[handle.index] == handle.generation);
+    Instance instance = instances[handle.index];
+    instance.pos = position;
+    instance.rotation = rotation;
+    writeSprite(handle.index, instance);
+}
+
+void RetainedRenderer::destroySprite(SpriteHandle handle) {
+    assert(handle.index < instances.size() && generations[handle.index] == handle.generation);
+    // Slots before the last live sprite stay in the draw range until reused, zero size makes them
+    // produce no fragments. Texture is kept, so it does not split texture runs.
+    Instance instance = instances[handle.index];
+    instance.size = {0.0f, 0.0f};
+    instance.color = {0, 0, 0, 0};
+    writeSprite(handle.index, instance);
+
+    generations[handle.index]++;
+    liveSlots[handle.index] = 0;
+    freeSlots.push_back(handle.index);
+    std::push_heap(freeSlots.begin(), freeSlots.end(), std::greater<>{});
+    liveSprites--;
+    while (drawSlots > 0 && !liveSlots[drawSlots - 1]) {
+        drawSlots--;
+    }
+}
+
+size_t RetainedRenderer::spriteCount() const {
+    return liveSprites;
+}
+
+void RetainedRenderer::setFrameArena(FrameArena *arena) {
+    assert(!inUse);
+    dirtyRanges.setArena(arena);
+    transientInstances.setArena(arena);
+    transientTextures.setArena(arena);
+}
+
+void RetainedRenderer::writeSprite(uint32_t index, const Instance &instance) {
+    // Note: Instance must not contain padding
+    if (memcmp(&instances[index], &instance, sizeof(Instance)) == 0) {
+        return;
+    }
+    instances[index] = instance;
+    dirtyBits[index / 64] |= uint64_t(1) << (index % 64);
+}
+
+bool RetainedRenderer::textureBoundary(size_t index) const {
+    // Is there a texture change between slot index - 1 and index
+    return index > 0 && index < textures.size() && textures[index - 1] != textures[index];
+}
+
+void RetainedRenderer::setTexture(uint32_t index, GLuint texture) {
+    if (textures[index] == texture) {
+        return;
+    }
+    textureBoundaries -= textureBoundary(index) + textureBoundary(index + 1);
+    textures[index] = texture;
+    textureBoundaries += textureBoundary(index) + textureBoundary(index + 1);
+}
+
+void RetainedRenderer::collectDirtyRanges() {
+    dirtyRanges.clear();
+    for (size_t word = 0; word < dirtyBits.size(); word++) {
+        uint64_t bits = dirtyBits[word];
+        while (bits) {
+            size_t index = word * 64 + std::countr_zero(bits);
+            bits &= bits - 1;
+            markDirty(dirtyRanges, index);
+        }
+        dirtyBits[word] = 0;
+    }
+}
+
+void RetainedRenderer::uploadRetained() {
+    collectDirtyRanges();
+    if (dirtyRanges.empty()) {
+        return;
+    }
+
+    PhaseTimer::Scope phase{RenderPhase::Upload};
+    glBindBuffer(GL_ARRAY_BUFFER, retainedVBO);
+    currentStats.stateChanges++;
+    if (retainedCapacity < instances.size()) {
+        // Buffer on GPU is too small, reallocate and upload everything
+        retainedCapacity = std::max(instances.size(), retainedCapacity * 2);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (retainedCapacity * sizeof(Instance)), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (instances.size() * sizeof(Instance)), instances.data());
+        currentStats.bytesUploaded += instances.size() * sizeof(Instance);
+        return;
+    }
+
+    if (uploadMode == UploadMode::SubData) {
+        for (auto range: dirtyRanges) {
+            glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) (range.begin * sizeof(Instance)),
+                            (GLsizeiptr) ((range.end - range.begin) * sizeof(Instance)), &instances[range.begin]);
+            currentStats.bytesUploaded += (range.end - range.begin) * sizeof(Instance);
+        }
+        return;
+    }
+
+    // Map span covering all dirty ranges once, only dirty ranges are flushed.
+    // Note: Not invalidated, clean sprites between the ranges must be kept.
+    size_t spanBegin = dirtyRanges.front().begin;
+    size_t spanEnd = dirtyRanges.back().end;
+    auto *mapped = (Instance *) glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr) (spanBegin * sizeof(Instance)),
+                                                 (GLsizeiptr) ((spanEnd - spanBegin) * sizeof(Instance)),
+                                                 GL_MAP_WRITE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+    assert(mapped);
+    for (auto range: dirtyRanges) {
+        size_t size = (range.end - range.begin) * sizeof(Instance);
+        memcpy(mapped + (range.begin - spanBegin), &instances[range.begin], size);
+        currentStats.bytesUploaded += size;
+        glFlushMappedBufferRange(GL_ARRAY_BUFFER, (GLintptr) ((range.begin - spanBegin) * sizeof(Instance)),
+                                 (GLsizeiptr) size);
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+
+void RetainedRenderer::uploadTransient() {
+    PhaseTimer::Scope phase{RenderPhase::Upload};
+    glBindBuffer(GL_ARRAY_BUFFER, transientVBO);
+    if (transientCapacity < transientInstances.size()) {
+        transientCapacity = std::max(transientInstances.size(), transientCapacity * 2);
+    }
+    // Orphan previous frame's data
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (transientCapacity * sizeof(Instance)), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (transientInstances.size() * sizeof(Instance)),
+                    transientInstances.data());
+    currentStats.bytesUploaded += transientInstances.size() * sizeof(Instance);
+    currentStats.stateChanges++;
+}
+
+void RetainedRenderer::bindInstanceAttributes(GLuint buffer, size_t firstInstance) {
+    currentStats.stateChanges += Instance::bindAttributes(buffer, firstInstance);
+}
+
+void RetainedRenderer::bindTexture(GLuint texture) {
+    if (texture == boundSampler) {
+        return;
+    }
+    boundSampler = texture;
+    PhaseTimer::Scope phase{RenderPhase::Bind};
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUniform1i(uTexLoc, 0);
+    currentStats.textureBinds++;
+    currentStats.stateChanges++;
+}
+
+void RetainedRenderer::drawInstances(GLuint buffer, const GLuint *instanceTextures, size_t count,
+                                     bool singleTexture) {
+    if (count == 0) {
+        return;
+    }
+    if (singleTexture) {
+        bindInstanceAttributes(buffer, 0);
+        bindTexture(instanceTextures[0]);
+        PhaseTimer::Scope phase{RenderPhase::Draw};
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) count);
+        currentStats.drawCalls++;
+        currentStats.instances += count;
+        currentStats.flushes[int(FlushReason::End)]++;
+        return;
+    }
+
+    // One draw call per run of instances sharing a texture
+    size_t runBegin = 0;
+    for (size_t i = 1; i <= count; i++) {
+        if (i < count && instanceTextures[i] == instanceTextures[runBegin]) {
+            continue;
+        }
+        bindInstanceAttributes(buffer, runBegin);
+        bindTexture(instanceTextures[runBegin]);
+        PhaseTimer::Scope phase{RenderPhase::Draw};
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) (i - runBegin));
+        currentStats.drawCalls++;
+        currentStats.instances += i - runBegin;
+        currentStats.flushes[int(i < count ? FlushReason::TextureChange : FlushReason::End)]++;
+        runBegin = i;
+    }
+}
+
+void RetainedRenderer::begin(const glm::mat4 &projView) {
+    assert(!inUse);
+    inUse = true;
+    transientInstances.clear();
+    transientTextures.clear();
+
+    glBindVertexArray(vao);
+    glUseProgram(shader);
+    glUniformMatrix4fv(uProjViewLoc, 1, GL_FALSE, &projView[0][0]);
+    // Note: Texture binding might have been changed by other renderers
+    boundSampler = 0;
+
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glFrontFace(GL_CCW);
+    currentStats.stateChanges += 6;
+}
+
+void RetainedRenderer::drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin,
+                                  float rotation, Color color) {
+    assert(inUse);
+    transientInstances.push_back(Instance::make(region, position, size, origin, rotation, color));
+    transientTextures.push_back(region.texture);
+    currentStats.sprites++;
+}
+
+void RetainedRenderer::end() {
+    assert(inUse);
+    // Only sprites changed since last frame are sent to GPU
+    uploadRetained();
+    currentStats.sprites += liveSprites;
+    drawInstances(retainedVBO, textures.data(), drawSlots, textureBoundaries == 0);
+
+    if (!transientInstances.empty()) {
+        uploadTransient();
+        drawInstances(transientVBO, transientTextures.data(), transientInstances.size(), false);
+    }
+    endFrameStats();
+    inUse = false;
+}
+
+const char *RetainedRenderer::uploadModeName(UploadMode uploadMode) {
+    switch (uploadMode) {
+        case UploadMode::SubData:
+            return "subdata";
+        case UploadMode::MapFlush:
+            return "map_flush";
+    }
+    return "unknown";
+}
+
+bool RetainedRenderer::parseUploadMode(const char *str, UploadMode &uploadMode) {
+    if (!str) {
+        return false;
+    }
+    for (auto m: {UploadMode::SubData, UploadMode::MapFlush}) {
+        if (strcmp(str, uploadModeName(m)) == 0) {
+            uploadMode = m;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,97 @@
+#ifndef DIPLOMA_RETAINED_RENDERER_H
+#define DIPLOMA_RETAINED_RENDERER_H
+
+#include <vector>
+#include "../base_renderer.h"
+#include "../frame_arena.h"
+#include "sprite_instance.h"
+#include "static_instance_stream.h"
+
+struct SpriteHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// Sprites live on the GPU until destroyed, only sprites changed since the last end() are uploaded.
+// Retained sprites are drawn in slot order at end(), sprites drawn with drawSprite are only
+// drawn for the current frame, on top of the retained ones. Free slots are reused lowest first,
+// free slots after the last live sprite are not drawn.
+class RetainedRenderer : public IRenderer {
+public:
+    enum class UploadMode {
+        SubData, // glBufferSubData per dirty range
+        MapFlush, // Map dirty span once, glFlushMappedBufferRange per dirty range
+    };
+
+    using Instance = SpriteInstance;
+
+    explicit RetainedRenderer(int initialCapacity = 4000, UploadMode uploadMode = UploadMode::SubData);
+    ~RetainedRenderer() override;
+
+    SpriteHandle createSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin, float rotation, Color color);
+    void updateSprite(SpriteHandle handle, const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin, float rotation, Color color);
+    void updateSpriteTransform(SpriteHandle handle, glm::vec2 position, float rotation);
+    void destroySprite(SpriteHandle handle);
+
+    [[nodiscard]]
+    size_t spriteCount() const;
+
+    // Per-frame data (transient sprites, dirty ranges) is allocated from the arena, nullptr for the heap.
+    // Arena frame must not end between begin() and end().
+    void setFrameArena(FrameArena *arena);
+
+    void begin(const glm::mat4 &projView) override;
+    void drawSprite(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin, float rotation, Color color) override;
+    void end() override;
+
+    static const char *uploadModeName(UploadMode uploadMode);
+    static bool parseUploadMode(const char *str, UploadMode &uploadMode);
+
+private:
+    void writeSprite(uint32_t index, const Instance &instance);
+    void setTexture(uint32_t index, GLuint texture);
+    bool textureBoundary(size_t index) const;
+    void collectDirtyRanges();
+    void uploadRetained();
+    void uploadTransient();
+    void bindInstanceAttributes(GLuint buffer, size_t firstInstance);
+    void bindTexture(GLuint texture);
+    void drawInstances(GLuint buffer, const GLuint *instanceTextures, size_t count, bool singleTexture);
+
+    GLuint vao{};
+    GLuint vbo{};
+    GLuint retainedVBO{};
+    GLuint transientVBO{};
+    GLuint shader{};
+
+    GLint uProjViewLoc{};
+    GLint uTexLoc{};
+
+    UploadMode uploadMode{};
+
+    GLuint boundSampler{};
+
+    // Retained sprites, indexed by slot
+    std::vector<Instance> instances{};
+    std::vector<GLuint> textures{};
+    std::vector<uint32_t> generations{};
+    std::vector<uint8_t> liveSlots{}; // 1 if the slot holds a sprite
+    std::vector<uint32_t> freeSlots{}; // min-heap
+    size_t drawSlots{}; // slots up to the last live sprite, drawn at end()
+    std::vector<uint64_t> dirtyBits{};
+    ArenaArray<DirtyRange> dirtyRanges{}; // this frame
+    size_t retainedCapacity{}; // in instances, on GPU
+    size_t liveSprites{};
+    // Number of neighbouring slots with different textures, when 0 all slots share one texture
+    size_t textureBoundaries{};
+
+    // Sprites drawn with drawSprite this frame
+    ArenaArray<Instance> transientInstances{};
+    ArenaArray<GLuint> transientTextures{};
+    size_t transientCapacity{}; // in instances, on GPU
+
+    bool inUse{};
+};
+
+
+#endif //DIPLOMA_RETAINED_RENDERER_H
@@ -0,0 +1,121 @@
+#include "sprite_instance.h"
+
+#include <cstddef>
+
+SpriteInstance SpriteInstance::make(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin,
+                                    float rotation, Color color) {
+    return SpriteInstance{
+            .pos = position,
+            .size = size,
+            .origin = origin,
+            .rotation = rotation,
+            .color = color,
+            .uv = {
+                    {region.u0, region.v1},
+                    {region.u0, region.v0},
+                    {region.u1, region.v1},
+                    {region.u1, region.v0},
+            },
+    };
+}
+
+GLuint SpriteInstance::compileShader() {
+    return compileShaderProgram({.vertex = R"(
+        #version 330 core
+        layout (location = 0) in vec2 aPos;
+        layout (location = 1) in vec2 aInstPos;
+        layout (location = 2) in vec2 aInstSize;
+        layout (location = 3) in vec2 aInstOrigin;
+        layout (location = 4) in float aInstRotation;
+        layout (location = 5) in vec4 aInstColor;
+        layout (location = 6) in vec2 aInstUV[4]; // loc: 6, 7, 8, 9
+
+        out vec2 UV;
+        out vec4 color;
+        uniform mat4 uProjView;
+        uniform sampler2D uTex;
+
+        mat3 buildMatrix(const vec2 pos, const vec2 size,
+                         const vec2 origin, const float rot) {
+            float c = cos(rot);
+            float s = sin(rot);
+
+            // Note: column-major order
+            mat3 mat = mat3(1.0,              0.0,              0.0,
+                            0.0,              1.0,              0.0,
+                            pos.x + origin.x, pos.y + origin.y, 1.0);
+            mat = mat * mat3(c,   s,   0.0,
+                             -s,  c,   0.0,
+                             0.0, 0.0, 1.0) ;
+            mat = mat * mat3(1.0,       0.0,       0.0,
+                             0.0,       1.0,       0.0,
+                             -origin.x, -origin.y, 1.0);
+            mat = mat * mat3(size.x, 0.0,    0.0,
+                             0.0,    size.y, 0.0,
+                             0.0,    0.0,    1.0);
+            return mat;
+        }
+
+        void main() {
+            vec2 texSize = textureSize(uTex, 0);
+            UV = aInstUV[gl_VertexID] / texSize;
+            color = aInstColor;
+
+            mat3 model = buildMatrix(aInstPos, aInstSize, aInstOrigin, aInstRotation);
+
+            gl_Position = uProjView * vec4(model * vec3(aPos, 1.0), 1.0);
+        }
+    )", .fragment = R"(
+        #version 330 core
+        out vec4 FragColor;
+        in vec2 UV;
+        in vec4 color;
+        uniform sampler2D uTex;
+        void main() {
+            FragColor = texture(uTex, UV) * color;
+        }
+    )"});
+}
+
+void SpriteInstance::setupVertexArray(GLuint meshVBO) {
+    glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+    glm::vec2 vertices[4] = {
+            {0.0f, 0.0f}, // bottom left
+            {0.0f, 1.0f}, // top left
+            {1.0f, 0.0f}, // bottom right
+            {1.0f, 1.0f}, // top right
+    };
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(aPosLoc); // aPos
+    glVertexAttribPointer(aPosLoc, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void *) 0);
+    glVertexAttribDivisor(aPosLoc, 0);
+
+    for (int loc: {aInstPosLoc, aInstSizeLoc, aInstOriginLoc, aInstRotationLoc, aInstColorLoc}) {
+        glEnableVertexAttribArray(loc);
+        glVertexAttribDivisor(loc, 1);
+    }
+    for (int i = 0; i < 4; i++) {
+        glEnableVertexAttribArray(aInstUVLoc + i);
+        glVertexAttribDivisor(aInstUVLoc + i, 1);
+    }
+}
+
+int SpriteInstance::bindAttributes(GLuint buffer, size_t firstInstance) {
+    size_t offset = instanceOffset(firstInstance, sizeof(SpriteInstance));
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(aInstPosLoc, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance),
+                          (void *) (offset + offsetof(SpriteInstance, pos)));
+    glVertexAttribPointer(aInstSizeLoc, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance),
+                          (void *) (offset + offsetof(SpriteInstance, size)));
+    glVertexAttribPointer(aInstOriginLoc, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance),
+                          (void *) (offset + offsetof(SpriteInstance, origin)));
+    glVertexAttribPointer(aInstRotationLoc, 1, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance),
+                          (void *) (offset + offsetof(SpriteInstance, rotation)));
+    glVertexAttribPointer(aInstColorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SpriteInstance),
+                          (void *) (offset + offsetof(SpriteInstance, color)));
+    for (int i = 0; i < 4; i++) {
+        glVertexAttribPointer(aInstUVLoc + i, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(SpriteInstance),
+                              (void *) (offset + offsetof(SpriteInstance, uv) + i * sizeof(glm::u16vec2)));
+    }
+    return 10;
+}
@@ -0,0 +1,39 @@
+#ifndef DIPLOMA_SPRITE_INSTANCE_H
+#define DIPLOMA_SPRITE_INSTANCE_H
+
+#include "../common.h"
+
+// One sprite drawn as an instance of the unit quad, transformed on the GPU.
+// Shared by renderers that keep instances in GPU buffers across draws (RetainedRenderer, ConcurrentRenderer).
+struct SpriteInstance {
+    constexpr static int aPosLoc = 0;
+    constexpr static int aInstPosLoc = 1;
+    constexpr static int aInstSizeLoc = 2;
+    constexpr static int aInstOriginLoc = 3;
+    constexpr static int aInstRotationLoc = 4;
+    constexpr static int aInstColorLoc = 5;
+    constexpr static int aInstUVLoc = 6; // 6, 7, 8, 9
+
+    glm::vec2 pos;     // 8 B
+    glm::vec2 size;    // 8 B
+    glm::vec2 origin;  // 8 B
+    float rotation;    // 4 B
+    glm::u8vec4 color; // 4 B
+
+    glm::u16vec2 uv[4]; // 16 B
+
+    static SpriteInstance make(const UVRegion &region, glm::vec2 position, glm::vec2 size, glm::vec2 origin,
+                               float rotation, Color color);
+
+    // Program with uProjView and uTex uniforms
+    static GLuint compileShader();
+    // Uploads the unit quad into meshVBO and enables all attributes of the bound VAO,
+    // instance attribute pointers are set by bindAttributes
+    static void setupVertexArray(GLuint meshVBO);
+    // Points instance attributes at buffer, starting at firstInstance.
+    // Returns the number of GL state changes made.
+    static int bindAttributes(GLuint buffer, size_t firstInstance);
+}; // 48 total
+static_assert(sizeof(SpriteInstance) == 48);
+
+#endif //DIPLOMA_SPRITE_INSTANCE_H
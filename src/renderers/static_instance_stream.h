@@ -0,0 +1,95 @@
+#ifndef DIPLOMA_STATIC_INSTANCE_STREAM_H
+#define DIPLOMA_STATIC_INSTANCE_STREAM_H
+
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include "../common.h"
+
+// Instances [begin, end) to upload
+struct DirtyRange {
+    size_t begin;
+    size_t end;
+};
+
+// Dirty ranges closer than this many instances are uploaded with a single call
+constexpr size_t dirtyMergeGap = 16;
+
+// Marks index as dirty, extending the last range when index is within dirtyMergeGap of it.
+// Ranges works with any container of DirtyRange with empty(), back() and push_back().
+template<typename Ranges>
+void markDirty(Ranges &ranges, size_t index) {
+    if (!ranges.empty()) {
+        DirtyRange &last = ranges.back();
+        if (index + dirtyMergeGap >= last.begin && index <= last.end + dirtyMergeGap) {
+            last.begin = std::min(last.begin, index);
+            last.end = std::max(last.end, index + 1);
+            return;
+        }
+    }
+    ranges.push_back({index, index + 1});
+}
+
+// Instance attributes that rarely change, kept in their own vertex buffer.
+// Instances are identified by their submission order within a frame. A CPU copy of
+// the last submitted data is compared against, and only ranges that changed are uploaded.
+template<typename T>
+class StaticInstanceStream {
+public:
+    StaticInstanceStream() {
+        glGenBuffers(1, &vbo);
+        assert(vbo);
+    }
+
+    StaticInstanceStream(const StaticInstanceStream &other) = delete;
+
+    ~StaticInstanceStream() {
+        glDeleteBuffers(1, &vbo);
+    }
+
+    [[nodiscard]]
+    GLuint buffer() const {
+        return vbo;
+    }
+
+    void write(size_t index, const T &value) {
+        if (index >= data.size()) {
+            // Note: Buffer on GPU is reallocated on next upload
+            data.resize(std::max(index + 1, data.size() * 2));
+        }
+        // Note: T must not contain padding
+        if (memcmp(&data[index], &value, sizeof(T)) == 0) {
+            return;
+        }
+        data[index] = value;
+        markDirty(dirty, index);
+    }
+
+    // Uploads dirty ranges, leaves the stream buffer bound to GL_ARRAY_BUFFER.
+    // Returns number of bytes uploaded.
+    size_t upload() {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        size_t uploaded = 0;
+        if (gpuCapacity < data.size()) {
+            gpuCapacity = data.size();
+            uploaded = gpuCapacity * sizeof(T);
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) uploaded, data.data(), GL_DYNAMIC_DRAW);
+        } else {
+            for (auto range: dirty) {
+                size_t size = (range.end - range.begin) * sizeof(T);
+                glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) (range.begin * sizeof(T)), (GLsizeiptr) size, &data[range.begin]);
+                uploaded += size;
+            }
+        }
+        dirty.clear();
+        return uploaded;
+    }
+
+private:
+    GLuint vbo{};
+    size_t gpuCapacity{};
+    std::vector<T> data{};
+    std::vector<DirtyRange> dirty{};
+};
+
+#endif //DIPLOMA_STATIC_INSTANCE_STREAM_H
@@ -0,0 +1,320 @@
+#include "scenario.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+void SpriteSet::add(glm::vec2 position, glm::vec2 velocity, glm::vec2 size, float rotation, Color color,
+                    uint16_t texture, uint8_t layer, BlendMode blendMode) {
+    positions.push_back(position);
+    velocities.push_back(velocity);
+    sizes.push_back(size);
+    origins.push_back(size * 0.5f);
+    rotations.push_back(rotation);
+    colors.push_back(color);
+    textures.push_back(texture);
+    layers.push_back(layer);
+    blendModes.push_back(blendMode);
+}
+
+size_t SpriteSet::size() const {
+    return positions.size();
+}
+
+// Note: No std distributions, their results differ between standard libraries and the same seed
+// must give the same sprites everywhere
+static int randRange(std::mt19937 &rng, int min, int max) {
+    int x = int(rng() % uint32_t(max - min));
+    return min + x;
+}
+
+static float randFloat(std::mt19937 &rng, float min, float max) {
+    return min + (max - min) * float(double(rng()) / 4294967296.0);
+}
+
+static int randVelocity(std::mt19937 &rng, int min, int max) {
+    int x = randRange(rng, min, max);
+    int rev = rng() % 2;
+    if (rev) {
+        return -x;
+    }
+    return x;
+}
+
+// Classic bunnymark: random bunnies of one texture, all moving
+class BunniesScenario : public Scenario {
+public:
+    [[nodiscard]]
+    const char *name() const override {
+        return "bunnies";
+    }
+
+    [[nodiscard]]
+    Traits traits() const override {
+        return {};
+    }
+
+    void generate(const ScenarioOpts &opts, std::mt19937 &rng, SpriteSet &sprites) const override {
+        for (int i = 0; i < opts.numSprites; i++) {
+            // Note: Braced lists keep the order of random numbers the same as in declaration
+            glm::vec2 position = {randRange(rng, 0, opts.width), randRange(rng, 0, opts.height)};
+            glm::vec2 size = {randRange(rng, 20, 60), randRange(rng, 20, 60)};
+            glm::vec2 velocity = {randVelocity(rng, 120, 140), randVelocity(rng, 120, 140)};
+            float rotation = float(randRange(rng, 0, 360)) / 360.0f;
+            Color color = {randRange(rng, 10, 255), randRange(rng, 10, 255), randRange(rng, 10, 255),
+                           randRange(rng, 80, 250)};
+            sprites.add(position, velocity, size, rotation, color, texture(opts, rng));
+        }
+        sprites.numMoving = sprites.size();
+    }
+
+protected:
+    virtual uint16_t texture([[maybe_unused]] const ScenarioOpts &opts, [[maybe_unused]] std::mt19937 &rng) const {
+        return 0;
+    }
+};
+
+// Bunnies with a random texture each, neighbours rarely share one, so batches break on every sprite
+class ManyTexturesScenario : public BunniesScenario {
+public:
+    [[nodiscard]]
+    const char *name() const override {
+        return "many_textures";
+    }
+
+    [[nodiscard]]
+    Traits traits() const override {
+        return {.multiTexture = true};
+    }
+
+protected:
+    uint16_t texture(const ScenarioOpts &opts, std::mt19937 &rng) const override {
+        return uint16_t(rng() % uint32_t(std::max(opts.numTextures, 1)));
+    }
+};
+
+// Bunnies where only a small part moves, the rest is static scenery
+class MostlyStaticScenario : public BunniesScenario {
+public:
+    [[nodiscard]]
+    const char *name() const override {
+        return "mostly_static";
+    }
+
+    void generate(const ScenarioOpts &opts, std::mt19937 &rng, SpriteSet &sprites) const override {
+        BunniesScenario::generate(opts, rng, sprites);
+        float fraction = std::clamp(opts.movingFraction, 0.0f, 1.0f);
+        sprites.numMoving = size_t(std::lround(double(sprites.size()) * fraction));
+        std::fill(sprites.velocities.begin() + ptrdiff_t(sprites.numMoving), sprites.velocities.end(), glm::vec2{});
+    }
+};
+
+// Large translucent sprites covering a quarter to half of the screen each, fill rate bound
+class OverdrawScenario : public Scenario {
+public:
+    [[nodiscard]]
+    const char *name() const override {
+        return "overdraw";
+    }
+
+    [[nodiscard]]
+    Traits traits() const override {
+        return {};
+    }
+
+    void generate(const ScenarioOpts &opts, std::mt19937 &rng, SpriteSet &sprites) const override {
+        float width = float(opts.width);
+        float height = float(opts.height);
+        for (int i = 0; i < opts.numSprites; i++) {
+            glm::vec2 position = {randFloat(rng, 0.0f, width), randFloat(rng, 0.0f, height)};
+            glm::vec2 size = {randFloat(rng, width * 0.25f, width * 0.5f),
+                              randFloat(rng, height * 0.25f, height * 0.5f)};
+            glm::vec2 velocity = {randVelocity(rng, 20, 40), randVelocity(rng, 20, 40)};
+            float rotation = randFloat(rng, 0.0f, 1.0f);
+            Color color = {randRange(rng, 10, 255), randRange(rng, 10, 255), randRange(rng, 10, 255),
+                           randRange(rng, 10, 40)};
+            sprites.add(position, velocity, size, rotation, color);
+        }
+        sprites.numMoving = sprites.size();
+    }
+};
+
+// Sprites smaller than a pixel, vertex and setup bound, almost no fragments
+class TinyScenario : public Scenario {
+public:
+    [[nodiscard]]
+    const char *name() const override {
+        return "tiny";
+    }
+
+    [[nodiscard]]
+    Traits traits() const override {
+        return {};
+    }
+
+    void generate(const ScenarioOpts &opts, std::mt19937 &rng, SpriteSet &sprites) const override {
+        for (int i = 0; i < opts.numSprites; i++) {
+            glm::vec2 position = {randFloat(rng, 0.0f, float(opts.width)),
+                                  randFloat(rng, 0.0f, float(opts.height))};
+            glm::vec2 size = {randFloat(rng, 0.25f, 1.0f), randFloat(rng, 0.25f, 1.0f)};
+            glm::vec2 velocity = {randVelocity(rng, 120, 140), randVelocity(rng, 120, 140)};
+            float rotation = randFloat(rng, 0.0f, 1.0f);
+            Color color = {randRange(rng, 10, 255), randRange(rng, 10, 255), randRange(rng, 10, 255), 255};
+            sprites.add(position, velocity, size, rotation, color);
+        }
+        sprites.numMoving = sprites.size();
+    }
+};
+
+// Layers drawn strictly back to front, each with its own texture. Back layers have larger sprites.
+class LayersScenario : public Scenario {
+    constexpr static int numLayers = 8;
+
+public:
+    [[nodiscard]]
+    const char *name() const override {
+        return "layers";
+    }
+
+    [[nodiscard]]
+    Traits traits() const override {
+        return {.multiTexture = true, .ordered = true};
+    }
+
+    void generate(const ScenarioOpts &opts, std::mt19937 &rng, SpriteSet &sprites) const override {
+        for (int i = 0; i < opts.numSprites; i++) {
+            // Note: Sprites are stored by layer, so storage order is the draw order
+            int layer = int(int64_t(i) * numLayers / std::max(opts.numSprites, 1));
+            float scale = float(numLayers - layer);
+            glm::vec2 position = {randRange(rng, 0, opts.width), randRange(rng, 0, opts.height)};
+            glm::vec2 size = glm::vec2{randRange(rng, 10, 20), randRange(rng, 10, 20)} * scale;
+            glm::vec2 velocity = glm::vec2{randVelocity(rng, 30, 40), randVelocity(rng, 30, 40)} * float(layer + 1);
+            Color color = {randRange(rng, 10, 255), randRange(rng, 10, 255), randRange(rng, 10, 255),
+                           randRange(rng, 180, 255)};
+            auto texture = uint16_t(layer % std::max(opts.numTextures, 1));
+            sprites.add(position, velocity, size, 0.0f, color, texture, uint8_t(layer));
+        }
+        sprites.numMoving = sprites.size();
+    }
+};
+
+// Alpha blended and additive sprites in runs of 1 to 64, like particles mixed into a scene
+class MixedBlendScenario : public BunniesScenario {
+public:
+    [[nodiscard]]
+    const char *name() const override {
+        return "mixed_blend";
+    }
+
+    [[nodiscard]]
+    Traits traits() const override {
+        return {.ordered = true, .blendModes = true};
+    }
+
+    void generate(const ScenarioOpts &opts, std::mt19937 &rng, SpriteSet &sprites) const override {
+        BunniesScenario::generate(opts, rng, sprites);
+        BlendMode mode = BlendMode::Alpha;
+        for (size_t i = 0; i < sprites.size();) {
+            size_t run = std::min(size_t(randRange(rng, 1, 65)), sprites.size() - i);
+            std::fill_n(sprites.blendModes.begin() + ptrdiff_t(i), run, mode);
+            i += run;
+            mode = mode == BlendMode::Alpha ? BlendMode::Additive : BlendMode::Alpha;
+        }
+    }
+};
+
+void Scenario::populate(const ScenarioOpts &opts, SpriteSet &sprites) const {
+    sprites = SpriteSet{};
+    size_t count = size_t(std::max(opts.numSprites, 0));
+    sprites.positions.reserve(count);
+    sprites.velocities.reserve(count);
+    sprites.sizes.reserve(count);
+    sprites.origins.reserve(count);
+    sprites.rotations.reserve(count);
+    sprites.colors.reserve(count);
+    sprites.textures.reserve(count);
+    sprites.layers.reserve(count);
+    sprites.blendModes.reserve(count);
+    std::mt19937 rng{opts.seed};
+    generate(opts, rng, sprites);
+}
+
+static const std::vector<std::function<std::unique_ptr<Scenario>()>> &builtinScenarios() {
+    static const std::vector<std::function<std::unique_ptr<Scenario>()>> scenarios = {
+            [] { return std::make_unique<BunniesScenario>(); },
+            [] { return std::make_unique<ManyTexturesScenario>(); },
+            [] { return std::make_unique<MostlyStaticScenario>(); },
+            [] { return std::make_unique<OverdrawScenario>(); },
+            [] { return std::make_unique<TinyScenario>(); },
+            [] { return std::make_unique<LayersScenario>(); },
+            [] { return std::make_unique<MixedBlendScenario>(); },
+    };
+    return scenarios;
+}
+
+std::unique_ptr<Scenario> Scenario::create(const char *name) {
+    if (!name) {
+        return nullptr;
+    }
+    for (auto &factory: builtinScenarios()) {
+        auto scenario = factory();
+        if (strcmp(scenario->name(), name) == 0) {
+            return scenario;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<const char *> Scenario::names() {
+    std::vector<const char *> names{};
+    for (auto &factory: builtinScenarios()) {
+        names.push_back(factory()->name());
+    }
+    return names;
+}
+
+std::vector<std::string> parseTextureList(const char *str) {
+    std::vector<std::string> paths = splitList(str);
+    std::erase_if(paths, [](const std::string &path) {
+        return path.empty();
+    });
+    return paths;
+}
+
+static bool parseKey(ScenarioConfig &config, const char *key, const char *value) {
+    if (strcmp(key, "scenario") == 0) {
+        config.scenario = value;
+        return Scenario::create(value) != nullptr;
+    } else if (strcmp(key, "seed") == 0) {
+        config.seed = strtoll(value, nullptr, 10);
+        return config.seed >= -1 && config.seed <= int64_t(UINT32_MAX);
+    } else if (strcmp(key, "width") == 0) {
+        config.width = atoi(value);
+        return config.width > 0;
+    } else if (strcmp(key, "height") == 0) {
+        config.height = atoi(value);
+        return config.height > 0;
+    } else if (strcmp(key, "num_sprites") == 0) {
+        config.numSprites = atoi(value);
+        return config.numSprites >= 0;
+    } else if (strcmp(key, "textures") == 0) {
+        config.textures = parseTextureList(value);
+        return !config.textures.empty();
+    } else if (strcmp(key, "num_textures") == 0) {
+        config.numTextures = atoi(value);
+        return config.numTextures > 0;
+    } else if (strcmp(key, "moving_fraction") == 0) {
+        config.movingFraction = strtof(value, nullptr);
+        return config.movingFraction >= 0.0f && config.movingFraction <= 1.0f;
+    }
+    // Note: Unknown keys are skipped, so older builds can read newer scenario files
+    return true;
+}
+
+bool loadScenarioConfig(const char *path, ScenarioConfig &config) {
+    return readKeyValueFile(path, [&](const char *key, const char *value) {
+        return parseKey(config, key, value);
+    });
+}
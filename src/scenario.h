@@ -0,0 +1,91 @@
+#ifndef DIPLOMA_SCENARIO_H
+#define DIPLOMA_SCENARIO_H
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "common.h"
+
+enum class BlendMode : uint8_t {
+    Alpha,
+    Additive,
+};
+
+// Sprites of a workload as structure of arrays. Sprites are drawn in storage order.
+// Only sprites [0, numMoving) move, the rest keep their position for the whole run.
+struct SpriteSet {
+    std::vector<glm::vec2> positions{};
+    std::vector<glm::vec2> velocities{};
+    std::vector<glm::vec2> sizes{};
+    std::vector<glm::vec2> origins{};
+    std::vector<float> rotations{};
+    std::vector<Color> colors{};
+    std::vector<uint16_t> textures{}; // index into the benchmark's texture set
+    std::vector<uint8_t> layers{};
+    std::vector<BlendMode> blendModes{};
+    size_t numMoving{};
+
+    void add(glm::vec2 position, glm::vec2 velocity, glm::vec2 size, float rotation, Color color,
+             uint16_t texture = 0, uint8_t layer = 0, BlendMode blendMode = BlendMode::Alpha);
+
+    [[nodiscard]]
+    size_t size() const;
+};
+
+struct ScenarioOpts {
+    int numSprites;
+    int width;
+    int height;
+    int numTextures; // scenarios pick texture indices below this
+    uint32_t seed;
+    float movingFraction; // sprites that move, in scenarios with a static part
+};
+
+// Workload BunnyMark draws. Implementations only generate sprites, they must draw the same sprites for
+// the same options, so runs with one seed are comparable. New workloads are added to the table in scenario.cpp.
+class Scenario {
+public:
+    // What a workload needs from the way it is drawn, not every renderer and mode supports all of it
+    struct Traits {
+        bool multiTexture = false; // sprites use more than one texture
+        bool ordered = false;      // draw order changes the picture, sprites can not be appended in any order
+        bool blendModes = false;   // blend mode changes, every run of one mode is drawn in its own renderer pass
+    };
+
+    virtual ~Scenario() = default;
+
+    [[nodiscard]]
+    virtual const char *name() const = 0;
+    [[nodiscard]]
+    virtual Traits traits() const = 0;
+    virtual void generate(const ScenarioOpts &opts, std::mt19937 &rng, SpriteSet &sprites) const = 0;
+
+    // Generates sprites with a generator seeded from opts.seed
+    void populate(const ScenarioOpts &opts, SpriteSet &sprites) const;
+
+    // nullptr if there is no built-in scenario with that name
+    static std::unique_ptr<Scenario> create(const char *name);
+    static std::vector<const char *> names();
+};
+
+// Workload of a benchmark, read from a scenario file. Stored as one key=value per line, lines starting
+// with # are comments. Keys: scenario, seed, width, height, num_sprites, textures, num_textures, moving_fraction.
+struct ScenarioConfig {
+    std::string scenario = "bunnies";
+    int64_t seed = -1; // -1 picks a random seed, printed with the results
+    int width = 1280;
+    int height = 720;
+    int numSprites = 0;
+    std::vector<std::string> textures = {"res/rabbit.png"}; // loaded round robin until there are numTextures
+    int numTextures = 8; // distinct GL textures, only used by multi-texture scenarios
+    float movingFraction = 0.05f;
+};
+
+// Returns false if the file can not be read or has invalid values, config keeps defaults for missing keys
+bool loadScenarioConfig(const char *path, ScenarioConfig &config);
+// Comma separated paths
+std::vector<std::string> parseTextureList(const char *str);
+
+#endif //DIPLOMA_SCENARIO_H
@@ -0,0 +1,59 @@
+#ifndef DIPLOMA_SPSC_RING_H
+#define DIPLOMA_SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Lock-free ring buffer for exactly one producer thread and one consumer thread.
+template<typename T>
+class SpscRing {
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size *= 2;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscRing(const SpscRing &other) = delete;
+
+    [[nodiscard]]
+    size_t capacity() const {
+        return slots.size();
+    }
+
+    // Producer only, returns false when full
+    bool push(const T &value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only, returns false when empty
+    bool pop(T &value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> slots{};
+    size_t mask{};
+    // Note: On separate cache lines, so producer and consumer do not invalidate each other
+    alignas(64) std::atomic<size_t> head{}; // written by consumer
+    alignas(64) std::atomic<size_t> tail{}; // written by producer
+};
+
+#endif //DIPLOMA_SPSC_RING_H
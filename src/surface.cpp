@@ -0,0 +1,270 @@
+#include "surface.h"
+
+#include <cstring>
+#include <GLFW/glfw3.h>
+#ifdef DIPLOMA_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// GLFW window, visible or hidden with an OSMesa context
+class GlfwSurface : public Surface {
+public:
+    GlfwSurface(Backend backend, int width, int height) : Surface(backend, width, height) {}
+
+    ~GlfwSurface() override {
+        if (glfwWindow) {
+            glfwMakeContextCurrent(glfwWindow);
+            destroyFramebuffer();
+            glfwDestroyWindow(glfwWindow);
+        }
+        glfwTerminate();
+    }
+
+    bool init(const char *title) {
+        if (!glfwInit()) {
+            return false;
+        }
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        if (headless()) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        }
+        glfwWindow = glfwCreateWindow(width(), height(), title, nullptr, nullptr);
+        if (!glfwWindow) {
+            return false;
+        }
+        glfwMakeContextCurrent(glfwWindow);
+        if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+            return false;
+        }
+        // Set fps to unlimited
+        glfwSwapInterval(0);
+        return !headless() || createFramebuffer();
+    }
+
+    void makeCurrent() override {
+        glfwMakeContextCurrent(glfwWindow);
+    }
+
+    void releaseCurrent() override {
+        glfwMakeContextCurrent(nullptr);
+    }
+
+    void swapBuffers() override {
+        if (headless()) {
+            glFlush();
+            return;
+        }
+        glfwSwapBuffers(glfwWindow);
+    }
+
+    void pollEvents() override {
+        glfwPollEvents();
+    }
+
+    [[nodiscard]]
+    GLFWwindow *window() const override {
+        return headless() ? nullptr : glfwWindow;
+    }
+
+private:
+    GLFWwindow *glfwWindow{};
+};
+
+#ifdef DIPLOMA_EGL
+// Context without any window system surface, drawing only into the FBO
+class EglSurface : public Surface {
+public:
+    EglSurface(int width, int height) : Surface(Backend::Egl, width, height) {}
+
+    ~EglSurface() override {
+        if (context != EGL_NO_CONTEXT) {
+            makeCurrent();
+            destroyFramebuffer();
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+        }
+        if (display != EGL_NO_DISPLAY) {
+            eglTerminate(display);
+        }
+    }
+
+    bool init() {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) {
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if (display == EGL_NO_DISPLAY) {
+            // Note: Drivers without the surfaceless platform may still support surfaceless contexts
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+            return false;
+        }
+        const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+            fprintf(stderr, "EGL_KHR_surfaceless_context is not supported\n");
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            return false;
+        }
+
+        const EGLint configAttribs[] = {
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_NONE,
+        };
+        EGLConfig config = nullptr;
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+            // Note: Surfaceless platform may have no configs, contexts are created without one (EGL_KHR_no_config_context)
+            config = nullptr;
+        }
+        const EGLint contextAttribs[] = {
+                EGL_CONTEXT_MAJOR_VERSION, 3,
+                EGL_CONTEXT_MINOR_VERSION, 3,
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                EGL_NONE,
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT) {
+            return false;
+        }
+        makeCurrent();
+        if (!gladLoadGLLoader((GLADloadproc) eglGetProcAddress)) {
+            return false;
+        }
+        return createFramebuffer();
+    }
+
+    void makeCurrent() override {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+    }
+
+    void releaseCurrent() override {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+
+    void swapBuffers() override {
+        glFlush();
+    }
+
+    void pollEvents() override {}
+
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+};
+#endif
+
+std::unique_ptr<Surface> Surface::create(Backend backend, int width, int height, const char *title) {
+    if (backend == Backend::Egl) {
+#ifdef DIPLOMA_EGL
+        auto surface = std::make_unique<EglSurface>(width, height);
+        if (!surface->init()) {
+            fprintf(stderr, "Could not create EGL surfaceless context (error 0x%x)\n", eglGetError());
+            return nullptr;
+        }
+        return surface;
+#else
+        fprintf(stderr, "EGL surface is not available, configure with -DDIPLOMA_EGL=ON\n");
+        return nullptr;
+#endif
+    }
+    auto surface = std::make_unique<GlfwSurface>(backend, width, height);
+    if (!surface->init(title)) {
+        const char *description = nullptr;
+        glfwGetError(&description);
+        fprintf(stderr, "Could not create %s surface: %s\n", backendName(backend), description ? description : "");
+        if (backend == Backend::OSMesa) {
+            fprintf(stderr, "OSMesa needs GLFW configured with -DGLFW_USE_OSMESA=ON and libOSMesa at runtime\n");
+        }
+        return nullptr;
+    }
+    return surface;
+}
+
+Surface::Surface(Backend backend, int width, int height)
+        : surfaceBackend(backend), surfaceWidth(width), surfaceHeight(height) {}
+
+GLFWwindow *Surface::window() const {
+    return nullptr;
+}
+
+Surface::Backend Surface::backend() const {
+    return surfaceBackend;
+}
+
+bool Surface::headless() const {
+    return surfaceBackend != Backend::Window;
+}
+
+int Surface::width() const {
+    return surfaceWidth;
+}
+
+int Surface::height() const {
+    return surfaceHeight;
+}
+
+bool Surface::createFramebuffer() {
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &colorBuffer);
+    glGenRenderbuffers(1, &depthBuffer);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, surfaceWidth, surfaceHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, surfaceWidth, surfaceHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    // Note: Renderers never bind framebuffers, so the FBO stays bound for the lifetime of the context
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Offscreen framebuffer is incomplete\n");
+        return false;
+    }
+    return true;
+}
+
+void Surface::destroyFramebuffer() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    fbo = 0;
+    colorBuffer = 0;
+    depthBuffer = 0;
+}
+
+const char *Surface::backendName(Backend backend) {
+    switch (backend) {
+        case Backend::Window:
+            return "window";
+        case Backend::OSMesa:
+            return "osmesa";
+        case Backend::Egl:
+            return "egl";
+    }
+    return "unknown";
+}
+
+bool Surface::parseBackend(const char *str, Backend &backend) {
+    if (!str) {
+        return false;
+    }
+    for (auto b: {Backend::Window, Backend::OSMesa, Backend::Egl}) {
+        if (strcmp(str, backendName(b)) == 0) {
+            backend = b;
+            return true;
+        }
+    }
+    return false;
+}
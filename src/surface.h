@@ -0,0 +1,66 @@
+#ifndef DIPLOMA_SURFACE_H
+#define DIPLOMA_SURFACE_H
+
+#include <memory>
+#include "common.h"
+
+struct GLFWwindow;
+
+// GL context and the framebuffer benchmarks render into. Headless surfaces render into an FBO of the
+// requested size, so the benchmark runs the same on machines without a display.
+class Surface {
+public:
+    enum class Backend {
+        Window, // visible GLFW window
+        OSMesa, // hidden GLFW window with an OSMesa context, no display needed when GLFW is built with
+                // GLFW_USE_OSMESA (its null platform)
+        Egl,    // EGL surfaceless platform (Mesa llvmpipe or a GPU driver), needs DIPLOMA_EGL
+    };
+
+    // Creates the context, makes it current and loads GL. Returns nullptr if the backend is not available.
+    static std::unique_ptr<Surface> create(Backend backend, int width, int height, const char *title);
+
+    Surface(const Surface &other) = delete;
+    virtual ~Surface() = default;
+
+    // Context can be moved to another thread by releasing it first
+    virtual void makeCurrent() = 0;
+    virtual void releaseCurrent() = 0;
+    // Presents a window, headless surfaces only flush the frame to the driver
+    virtual void swapBuffers() = 0;
+    // Main thread only
+    virtual void pollEvents() = 0;
+
+    // Window of the Window backend, nullptr otherwise
+    [[nodiscard]]
+    virtual GLFWwindow *window() const;
+
+    [[nodiscard]]
+    Backend backend() const;
+    [[nodiscard]]
+    bool headless() const;
+    [[nodiscard]]
+    int width() const;
+    [[nodiscard]]
+    int height() const;
+
+    static const char *backendName(Backend backend);
+    static bool parseBackend(const char *str, Backend &backend);
+
+protected:
+    Surface(Backend backend, int width, int height);
+
+    // Offscreen color and depth target, bound as the draw and read framebuffer
+    bool createFramebuffer();
+    void destroyFramebuffer();
+
+private:
+    Backend surfaceBackend;
+    int surfaceWidth;
+    int surfaceHeight;
+    GLuint fbo{};
+    GLuint colorBuffer{};
+    GLuint depthBuffer{};
+};
+
+#endif //DIPLOMA_SURFACE_H